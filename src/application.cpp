@@ -9,12 +9,22 @@
 #include "application.h"
 #include "k32w061.h"
 
+#include <algorithm>
+#include <deque>
+#include <fstream>
 #include <iostream>
 #include <unistd.h>
 #include <stdexcept>
+#include <thread>
 #include <boost/log/trivial.hpp>
 
-Application::Application(MCU& mcu, FTDI::Interface& ftdi) : mcu(mcu), ftdi(ftdi)
+/* writes and reads are split into blocks of this size for progress reporting,
+ * a multiple of the flash page so the frames stay the same */
+static const std::size_t BLOCK_SIZE = 16 * K32W061::FLASH_PAGE_SIZE;
+/* round trips a baudrate has to answer before it is used */
+static const unsigned int BAUDRATE_CHECKS = 3;
+
+Application::Application(MCU& mcu, FTDI::Interface& ftdi) : mcu(mcu), ftdi(ftdi), progressDone(0), progressTotal(0)
 {
 }
 
@@ -51,61 +61,340 @@ void Application::enableISPMode(){
   BOOST_LOG_TRIVIAL(info) <<  "Set all CBUS Pins to Output:0";
   ftdi.setCBUSPins(pins);
   pins.outputCBUS2 = 1;
-  usleep(1000);
+  std::this_thread::sleep_for(ispTiming.resetPulse);
   BOOST_LOG_TRIVIAL(info) <<  "Set CBUS Pin 2 to Output:1";
   ftdi.setCBUSPins(pins);
-  usleep(10000);
-  BOOST_LOG_TRIVIAL(info) <<  "Disable CBUS Mode";
-  ftdi.disableCBUSMode();
-  usleep(10000);
+  auto released = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(ispTiming.firstProbe);
 
+  /* the ISP select pin stays driven until the bootloader answered, so it
+   * is sampled correctly however long the board takes to boot */
   const std::vector<uint8_t> unlock_key={0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
   BOOST_LOG_TRIVIAL(info) <<  "Send \"Enable ISP Mode\" request to device";
-  auto ret = mcu.enableISPMode(unlock_key);
+  /* EnableISPMode with the key and its response */
+  auto timeout = probeTimeout(ispTiming.probeInterval, 9 + unlock_key.size() + 9);
+  mcu.setResponseTimeout(timeout);
+  unsigned int attempts = 0;
+  int ret = -1;
+  do{
+    attempts++;
+    auto probe = std::chrono::steady_clock::now();
+    try{
+      checkCancelled();
+      ret = mcu.enableISPMode(unlock_key);
+    }catch(const MCU::TimeoutError&){
+      ret = -1;
+    }catch(...){
+      mcu.setResponseTimeout(responseTimeout);
+      ftdi.disableCBUSMode();
+      throw;
+    }
+    if(ret != 0){
+      /* a transport that fails right away must not turn this into a busy loop */
+      std::this_thread::sleep_until(probe + timeout);
+    }
+  }while(ret != 0 && std::chrono::steady_clock::now() - released < ispTiming.timeout);
+  readyTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - released);
+  mcu.setResponseTimeout(responseTimeout);
+  if(ret == 0){
+    /* noise of the booting chip or a second answer must not be read as the next response */
+    ftdi.flushInput();
+  }
+
+  BOOST_LOG_TRIVIAL(info) <<  "Disable CBUS Mode";
+  ftdi.disableCBUSMode();
   if(ret != 0){
-    throw std::runtime_error("Could not enable ISP Mode");
+    throw std::runtime_error(std::string("Could not enable ISP Mode, no answer after ") + std::to_string(attempts) + std::string(" attempts"));
   }
+  BOOST_LOG_TRIVIAL(info) <<  "Bootloader ready after " << readyTime.count() << " ms, " << attempts << " attempt(s)";
 }
 
-void Application::eraseMemory(MCU::MemoryID id){
-  BOOST_LOG_TRIVIAL(info) <<  "Get Handle for memory";
-  auto handle = mcu.getMemoryHandle(id);
-  if(handle < 0){
-    throw std::runtime_error("Could not get Handle for Memory");
+bool Application::probeISPMode(uint32_t speed){
+  if(speed != K32W061::ISP_BAUDRATE && ftdi.setBaudrate(speed) != 0){
+    return false;
+  }
+  BOOST_LOG_TRIVIAL(info) <<  "Probe for an open ISP session at " << speed << " baud";
+  /* GetDeviceInfo and its response */
+  mcu.setResponseTimeout(probeTimeout(ispTiming.probeInterval * 4, 8 + 17));
+  MCU::DeviceInfo info{};
+  try{
+    info = mcu.getDeviceInfo();
+  }catch(const MCU::TimeoutError&){
+    /* no open session, enter ISP mode as usual */
+  }
+  mcu.setResponseTimeout(responseTimeout);
+  if(info.chipId == K32W061::CHIP_ID_K32W061){
+    return true;
   }
-  BOOST_LOG_TRIVIAL(info) <<  "Got handle " << handle;
+  if(speed != K32W061::ISP_BAUDRATE){
+    ftdi.setBaudrate(K32W061::ISP_BAUDRATE);
+  }
+  return false;
+}
 
-  BOOST_LOG_TRIVIAL(info) <<  "Erase memory with handle " << handle;
-  auto ret = mcu.eraseMemory(handle);
-  if(ret < 0){
-    throw std::runtime_error("Could not erase Memory");
+std::chrono::milliseconds Application::probeTimeout(std::chrono::milliseconds minimum, std::size_t bytes) const{
+  /* 10 bits per byte on the wire */
+  auto wire = std::chrono::microseconds(uint64_t(bytes) * 10 * 1000000 / K32W061::ISP_BAUDRATE);
+  auto deadline = std::chrono::duration_cast<std::chrono::milliseconds>(wire + ftdi.latency() + std::chrono::microseconds(999));
+  return std::max(minimum, deadline);
+}
+
+bool Application::answers(unsigned int count){
+  for(unsigned int i=0;i<count;i++){
+    checkCancelled();
+    try{
+      if(mcu.getDeviceInfo().chipId != K32W061::CHIP_ID_K32W061){
+        return false;
+      }
+    }catch(const MCU::TimeoutError&){
+      return false;
+    }
   }
+  return true;
+}
 
-  BOOST_LOG_TRIVIAL(info) <<  "Check if Memory has been erased ...";
-  ret = mcu.memoryIsErased(handle);
-  if(ret < 0){
-    throw std::runtime_error("Memory not successfully erased");
+void Application::recoverBaudrate(uint32_t failed, uint32_t speed){
+  /* the SetBaudRate response was lost, the device did not switch */
+  ftdi.setBaudrate(speed);
+  if(answers(1)){
+    return;
+  }
+  /* the device switched but does not answer reliably, ask it to go back */
+  ftdi.setBaudrate(failed);
+  try{
+    if(mcu.setBaudrate(speed) == 0 && answers(1)){
+      return;
+    }
+  }catch(const MCU::TimeoutError&){
+  }
+  BOOST_LOG_TRIVIAL(warning) << "Device lost at " << failed << " baud, enter ISP mode again";
+  ftdi.setBaudrate(K32W061::ISP_BAUDRATE);
+  enableISPMode();
+  if(speed != K32W061::ISP_BAUDRATE){
+    setBaudrate(speed);
   }
-  BOOST_LOG_TRIVIAL(info) <<  "Success";
+}
 
-  BOOST_LOG_TRIVIAL(info) <<  "Close memory Handle " << handle;
-  ret = mcu.closeMemory(handle);
-  if(ret < 0){
-    throw std::runtime_error("Closing Memory handle failed");
+bool Application::tryBaudrate(uint32_t speed, uint32_t current){
+  bool switched = false;
+  try{
+    switched = mcu.setBaudrate(speed) == 0;
+  }catch(const MCU::TimeoutError&){
+  }
+  if(switched && answers(BAUDRATE_CHECKS)){
+    return true;
   }
+  BOOST_LOG_TRIVIAL(warning) << speed << " baud is not stable, fall back to " << current << " baud";
+  recoverBaudrate(speed, current);
+  return false;
 }
 
-void Application::flashFirmware(const std::vector<uint8_t>& fw){
+uint32_t Application::negotiateBaudrate(uint32_t current, uint32_t maximum, uint32_t learned){
+  if(learned > current && (maximum == 0 || learned <= maximum) && ftdi.supportsBaudrate(learned)){
+    BOOST_LOG_TRIVIAL(info) << "Try learned " << learned << " baud";
+    if(tryBaudrate(learned, current)){
+      BOOST_LOG_TRIVIAL(info) << "Negotiated " << learned << " baud";
+      return learned;
+    }
+    /* the device changed since, stay below the learned rate */
+    maximum = learned - 1;
+  }
+  for(auto speed : K32W061::baudrates()){
+    if(speed <= current || (maximum != 0 && speed > maximum)){
+      continue;
+    }
+    if(!ftdi.supportsBaudrate(speed)){
+      BOOST_LOG_TRIVIAL(info) << "Transport does not support " << speed << " baud";
+      continue;
+    }
+    BOOST_LOG_TRIVIAL(info) << "Try " << speed << " baud";
+    if(!tryBaudrate(speed, current)){
+      break;
+    }
+    current = speed;
+  }
+  BOOST_LOG_TRIVIAL(info) << "Negotiated " << current << " baud";
+  return current;
+}
+
+void Application::program(const Session& session){
+  progressDone = 0;
+  progressTotal = 0;
+  for(const auto& step : session.steps()){
+    for(const auto& write : step.writes){
+      progressTotal += write.image->size();
+    }
+  }
+
+  for(const auto& step : session.steps()){
+    auto name = Session::memoryToString(step.memory);
+    BOOST_LOG_TRIVIAL(info) <<  "Get Handle for memory " << name;
+    auto handle = mcu.getMemoryHandle(step.memory);
+    if(handle < 0){
+      throw std::runtime_error("Could not get Handle for Memory");
+    }
+    BOOST_LOG_TRIVIAL(info) <<  "Got handle " << handle;
+
+    for(const auto& erase : step.erases){
+      checkCancelled();
+      BOOST_LOG_TRIVIAL(info) <<  "Erase " << erase.length << " bytes at address 0x" << std::hex << erase.address << std::dec << " of " << name;
+      auto started = std::chrono::steady_clock::now();
+      auto ret = mcu.eraseMemory(handle, erase.address, erase.length);
+      if(ret < 0){
+        throw std::runtime_error("Could not erase Memory");
+      }
+      eraseTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+      erasedBytes += erase.length;
+
+      BOOST_LOG_TRIVIAL(info) <<  "Check if Memory has been erased ...";
+      if(!mcu.memoryIsErased(handle, erase.address, erase.length)){
+        throw std::runtime_error("Memory not successfully erased");
+      }
+      BOOST_LOG_TRIVIAL(info) <<  "Success";
+    }
+
+    for(const auto& write : step.writes){
+      for(const auto& seg : write.image->segments()){
+        auto address = seg.address + write.offset;
+        BOOST_LOG_TRIVIAL(info) <<  "Write " << seg.size << " bytes at address 0x" << std::hex << address << std::dec << " of " << name;
+        writeRange(handle, address, seg.data, seg.size, patchesFor(step.memory));
+      }
+    }
+
+    BOOST_LOG_TRIVIAL(info) <<  "Close memory Handle " << handle;
+    auto ret = mcu.closeMemory(handle);
+    if(ret < 0){
+      throw std::runtime_error("Closing Memory handle failed");
+    }
+  }
+  transferred += progressTotal;
+}
+
+const PatchSet& Application::patchesFor(MCU::MemoryID memory) const{
+  static const PatchSet none;
+  return memory == MCU::MemoryID::flash ? patches : none;
+}
+
+void Application::writeRange(uint8_t handle, uint32_t address, const uint8_t* data, std::size_t size, const PatchSet& fields){
+  auto write = [&](uint32_t addr, const uint8_t* d, std::size_t n){
+    while(n > 0){
+      auto block = std::min<std::size_t>(n, BLOCK_SIZE - (addr % BLOCK_SIZE));
+      if(mcu.flashMemory(handle, addr, d, block) != 0){
+        throw std::runtime_error(std::string("Writing ") + std::to_string(block) + std::string(" bytes at address ") + std::to_string(addr) + std::string(" failed"));
+      }
+      addr += block;
+      d += block;
+      n -= block;
+      progressDone += block;
+      report(progressDone, progressTotal);
+    }
+  };
+
+  if(!fields.overlaps(address, size)){
+    write(address, data, size);
+    return;
+  }
+
+  /* only the frames touched by a patch field are copied, everything else
+   * is still sent straight from the image */
+  std::size_t done = 0;
+  std::size_t run = 0;
+  while(done + run < size){
+    auto chunk = K32W061::frameChunkSize(address + done + run, size - done - run);
+    if(!fields.overlaps(address + done + run, chunk)){
+      run += chunk;
+      continue;
+    }
+    if(run != 0){
+      write(address + done, data + done, run);
+      done += run;
+      run = 0;
+    }
+    std::vector<uint8_t> frame(data + done, data + done + chunk);
+    fields.apply(address + done, frame.data(), frame.size());
+    write(address + done, frame.data(), frame.size());
+    done += chunk;
+  }
+  if(run != 0){
+    write(address + done, data + done, run);
+  }
+}
+
+void Application::flashFirmware(FirmwareStream& fw){
   BOOST_LOG_TRIVIAL(info) <<  "Get Handle to Flash memory";
   auto handle = mcu.getMemoryHandle(MCU::MemoryID::flash);
   if(handle < 0){
     throw std::runtime_error("Could not get Handle for Memory");
   }
 
-  BOOST_LOG_TRIVIAL(info) <<  "Start flashing Firmware";
-  auto ret = mcu.flashMemory(handle, fw);
+  BOOST_LOG_TRIVIAL(info) <<  "Start flashing Firmware from stream";
+  uint32_t address = 0;
+  std::vector<uint8_t> chunk;
+  while(fw.next(chunk)){
+    patches.apply(address, chunk.data(), chunk.size());
+    auto ret = mcu.flashMemory(handle, address, chunk.data(), chunk.size());
+    if(ret != 0){
+      throw std::runtime_error(std::string("Writing ") + std::to_string(chunk.size()) + std::string(" bytes at address ") + std::to_string(address) + std::string(" failed"));
+    }
+    address += chunk.size();
+    report(address, 0);
+  }
+  BOOST_LOG_TRIVIAL(info) <<  "Wrote " << address << " bytes";
+
+  BOOST_LOG_TRIVIAL(info) <<  "Close Memory Handle " << handle;
+  auto ret = mcu.closeMemory(handle);
+  if(ret < 0){
+    throw std::runtime_error("Closing Memory handle failed");
+  }
+  transferred += address;
+}
+
+void Application::flashFirmware(const FrameStream& fw){
+  BOOST_LOG_TRIVIAL(info) <<  "Get Handle to memory " << fw.memory();
+  auto handle = mcu.getMemoryHandle(fw.memory());
+  if(handle < 0){
+    throw std::runtime_error("Could not get Handle for Memory");
+  }
+  /* the handle is part of every frame, frames compiled for another one are readdressed */
+  bool readdress = handle != fw.handle();
+  if(readdress){
+    BOOST_LOG_TRIVIAL(info) <<  "Frames were compiled for memory handle " << int(fw.handle()) << ", send them to " << handle;
+  }
+
+  BOOST_LOG_TRIVIAL(info) <<  "Send " << fw.frames().size() << " precompiled frames";
+  const auto& fields = patchesFor(fw.memory());
+  /* only the few frames with fields are copied, the others are sent from the mapped file */
+  std::deque<std::vector<uint8_t>> patched;
+  std::vector<MCU::Frame> frames;
+  frames.reserve(fw.frames().size());
+  for(const auto& frame : fw.frames()){
+    auto payload = frame.size - K32W061::WRITE_FRAME_OVERHEAD;
+    if(!readdress && !fields.overlaps(frame.address, payload)){
+      frames.push_back(MCU::Frame{frame.data, frame.size});
+      continue;
+    }
+    patched.emplace_back(frame.data, frame.data + frame.size);
+    auto& copy = patched.back();
+    if(readdress){
+      K32W061::setWriteFrameHandle(copy, handle);
+    }
+    fields.forEach(frame.address, payload, [&copy](std::size_t offset, const uint8_t* bytes, std::size_t n){
+      K32W061::patchWriteFrame(copy, offset, bytes, n);
+    });
+    frames.push_back(MCU::Frame{copy.data(), copy.size()});
+  }
+
+  std::size_t done = 0;
+  std::size_t acknowledged = 0;
+  auto ret = mcu.sendFrames(frames, [&](std::size_t index){
+    done += fw.frames()[index].size - K32W061::WRITE_FRAME_OVERHEAD;
+    acknowledged = index + 1;
+    report(done, fw.payloadSize());
+  });
   if(ret != 0){
-    throw std::runtime_error(std::string("Only ") + std::to_string(ret) + std::string(" bytes written of ") + std::to_string(fw.size()) + std::string(" bytes"));
+    /* responses arrive in order, report the first frame that was not acknowledged */
+    auto address = acknowledged < fw.frames().size() ? fw.frames()[acknowledged].address : 0;
+    throw std::runtime_error(std::string("Writing frame at address ") + std::to_string(address) + std::string(" failed"));
   }
 
   BOOST_LOG_TRIVIAL(info) <<  "Close Memory Handle " << handle;
@@ -113,6 +402,188 @@ void Application::flashFirmware(const std::vector<uint8_t>& fw){
   if(ret < 0){
     throw std::runtime_error("Closing Memory handle failed");
   }
+  transferred += fw.payloadSize();
+}
+
+void Application::verify(const Session& session){
+  uint64_t verified = 0;
+  std::vector<uint8_t> expected;
+  std::vector<uint8_t> actual;
+  for(const auto& step : session.steps()){
+    if(step.writes.empty()){
+      continue;
+    }
+    const auto& fields = patchesFor(step.memory);
+    auto name = Session::memoryToString(step.memory);
+    BOOST_LOG_TRIVIAL(info) <<  "Get Handle for memory " << name;
+    auto handle = mcu.getMemoryHandle(step.memory);
+    if(handle < 0){
+      throw std::runtime_error("Could not get Handle for Memory");
+    }
+
+    for(const auto& write : step.writes){
+      for(const auto& seg : write.image->segments()){
+        uint32_t address = seg.address + write.offset;
+        BOOST_LOG_TRIVIAL(info) <<  "Verify " << seg.size << " bytes at address 0x" << std::hex << address << std::dec << " of " << name;
+        for(std::size_t offset = 0; offset < seg.size; ){
+          auto block = std::min<std::size_t>(seg.size - offset, BLOCK_SIZE - ((address + offset) % BLOCK_SIZE));
+          expected.assign(seg.data + offset, seg.data + offset + block);
+          fields.apply(address + offset, expected.data(), expected.size());
+          actual.resize(block);
+          if(mcu.readMemory(handle, address + offset, actual.data(), actual.size()) != 0){
+            throw std::runtime_error(std::string("Reading ") + std::to_string(block) + std::string(" bytes at address ") + std::to_string(address + offset) + std::string(" failed"));
+          }
+          auto mismatch = std::mismatch(expected.begin(), expected.end(), actual.begin());
+          if(mismatch.first != expected.end()){
+            throw std::runtime_error(std::string("Verify failed at address ") + std::to_string(address + offset + (mismatch.first - expected.begin())) + std::string(" of ") + name);
+          }
+          offset += block;
+          checkCancelled();
+        }
+        verified += seg.size;
+      }
+    }
+
+    BOOST_LOG_TRIVIAL(info) <<  "Close memory Handle " << handle;
+    if(mcu.closeMemory(handle) < 0){
+      throw std::runtime_error("Closing Memory handle failed");
+    }
+  }
+  transferred += verified;
+}
+
+void Application::verify(const FrameStream& fw){
+  BOOST_LOG_TRIVIAL(info) <<  "Get Handle to memory " << fw.memory();
+  auto handle = mcu.getMemoryHandle(fw.memory());
+  if(handle < 0){
+    throw std::runtime_error("Could not get Handle for Memory");
+  }
+
+  BOOST_LOG_TRIVIAL(info) <<  "Verify " << fw.payloadSize() << " bytes of precompiled frames";
+  const auto& fields = patchesFor(fw.memory());
+  std::vector<uint8_t> expected;
+  std::vector<uint8_t> actual;
+  for(const auto& frame : fw.frames()){
+    auto payload = frame.data + K32W061::WRITE_FRAME_PAYLOAD_OFFSET;
+    expected.assign(payload, payload + frame.size - K32W061::WRITE_FRAME_OVERHEAD);
+    fields.apply(frame.address, expected.data(), expected.size());
+    actual.resize(expected.size());
+    if(mcu.readMemory(handle, frame.address, actual.data(), actual.size()) != 0){
+      throw std::runtime_error(std::string("Reading ") + std::to_string(actual.size()) + std::string(" bytes at address ") + std::to_string(frame.address) + std::string(" failed"));
+    }
+    auto mismatch = std::mismatch(expected.begin(), expected.end(), actual.begin());
+    if(mismatch.first != expected.end()){
+      throw std::runtime_error(std::string("Verify failed at address ") + std::to_string(frame.address + (mismatch.first - expected.begin())));
+    }
+    checkCancelled();
+  }
+
+  BOOST_LOG_TRIVIAL(info) <<  "Close memory Handle " << handle;
+  if(mcu.closeMemory(handle) < 0){
+    throw std::runtime_error("Closing Memory handle failed");
+  }
+  transferred += fw.payloadSize();
+}
+
+void Application::dump(MCU::MemoryID memory, uint32_t address, uint32_t length, const std::string& path){
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  if(!ofs.is_open()){
+    throw std::runtime_error(std::string("Could not open ") + path);
+  }
+
+  BOOST_LOG_TRIVIAL(info) <<  "Get Handle for memory " << Session::memoryToString(memory);
+  auto handle = mcu.getMemoryHandle(memory);
+  if(handle < 0){
+    throw std::runtime_error("Could not get Handle for Memory");
+  }
+
+  std::vector<uint8_t> data;
+  for(uint32_t done = 0; done < length; ){
+    auto block = std::min<std::size_t>(length - done, BLOCK_SIZE - ((address + done) % BLOCK_SIZE));
+    data.resize(block);
+    if(mcu.readMemory(handle, address + done, data.data(), data.size()) != 0){
+      throw std::runtime_error(std::string("Reading ") + std::to_string(block) + std::string(" bytes at address ") + std::to_string(address + done) + std::string(" failed"));
+    }
+    ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+    done += block;
+    report(done, length);
+  }
+  if(!ofs.good()){
+    throw std::runtime_error(std::string("Could not write ") + path);
+  }
+
+  BOOST_LOG_TRIVIAL(info) <<  "Close memory Handle " << handle;
+  if(mcu.closeMemory(handle) < 0){
+    throw std::runtime_error("Closing Memory handle failed");
+  }
+  transferred += length;
+}
+
+void Application::setIspTiming(const IspTiming& timing){
+  ispTiming = timing;
+}
+
+Application::IspTiming Application::IspTiming::profile(const std::string& name){
+  IspTiming timing;
+  if(name == "fast"){
+    timing.probeInterval = std::chrono::milliseconds(2);
+    timing.timeout = std::chrono::milliseconds(200);
+  }else if(name == "slow"){
+    timing.resetPulse = std::chrono::milliseconds(20);
+    timing.firstProbe = std::chrono::milliseconds(20);
+    timing.probeInterval = std::chrono::milliseconds(20);
+    timing.timeout = std::chrono::milliseconds(2000);
+  }else if(name != "default"){
+    throw std::runtime_error(std::string("Unknown timing profile \"") + name + std::string("\", expected default, fast or slow"));
+  }
+  return timing;
+}
+
+std::chrono::milliseconds Application::ispReadyTime() const{
+  return readyTime;
+}
+
+uint64_t Application::bytesTransferred() const{
+  return transferred;
+}
+
+std::chrono::microseconds Application::erasePerPage() const{
+  if(erasedBytes == 0){
+    return std::chrono::microseconds(0);
+  }
+  return eraseTime * K32W061::FLASH_PAGE_SIZE / erasedBytes;
+}
+
+void Application::setCancel(const std::atomic<bool>* cancel){
+  this->cancel = cancel;
+  mcu.setCancel(cancel);
+}
+
+void Application::setResponseTimeout(std::chrono::milliseconds timeout){
+  responseTimeout = timeout;
+  mcu.setResponseTimeout(timeout);
+}
+
+void Application::checkCancelled() const{
+  if(cancel && *cancel){
+    throw Cancelled();
+  }
+}
+
+void Application::report(std::size_t done, std::size_t total){
+  checkCancelled();
+  if(progress){
+    progress(done, total);
+  }
+}
+
+void Application::setProgress(Progress p){
+  progress = p;
+}
+
+void Application::setPatches(const PatchSet& p){
+  p.validate();
+  patches = p;
 }
 
 void Application::reset(){
@@ -11,25 +11,111 @@
 
 #include "mcu.h"
 #include "ftdi.hpp"
+#include "firmware_image.h"
+#include "firmware_stream.h"
+#include "frame_stream.h"
+#include "patch_set.h"
+#include "session.h"
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
 #include <string>
 
 class Application
 {
 public:
+  /* called with the number of bytes written so far and the total, 0 if unknown */
+  using Progress = std::function<void(std::size_t done, std::size_t total)>;
+
+  /* ISP entry: the reset line is pulsed, then EnableISPMode is sent every
+   * probeInterval until the bootloader answers or timeout has passed */
+  struct IspTiming{
+    std::chrono::milliseconds resetPulse{1};
+    /* wait after releasing reset before the first probe */
+    std::chrono::milliseconds firstProbe{0};
+    std::chrono::milliseconds probeInterval{5};
+    std::chrono::milliseconds timeout{500};
+
+    /* default, fast (direct CBUS wiring) or slow (RC delayed reset, e.g. on DTR/RTS) */
+    static IspTiming profile(const std::string& name);
+  };
+
+  using Cancelled = MCU::Cancelled;
+
   Application(MCU& mcu, FTDI::Interface& ftdi);
   ~Application();
 
   void enableISPMode();
+  /* true if the bootloader is still in ISP mode at this baudrate from an
+   * earlier session. Otherwise the transport is set back to ISP_BAUDRATE */
+  bool probeISPMode(uint32_t speed);
+  /* steps from current through the baudrates of the bootloader that the
+   * transport supports, up to maximum if not 0. Each rate has to answer
+   * a few GetDeviceInfo round trips, on the first failure the session
+   * falls back to the last good rate, entering ISP mode again if the
+   * device does not answer there. A rate learned by an earlier session is
+   * tried first and kept if it answers, otherwise only slower rates are
+   * tried. Returns the rate the session is left at */
+  uint32_t negotiateBaudrate(uint32_t current, uint32_t maximum=0, uint32_t learned=0);
   void deviceInfo();
-  void eraseMemory(MCU::MemoryID id);
-  void flashFirmware(const std::vector<uint8_t>& fw);
+  void program(const Session& session);
+  /* reads back everything the session writes and compares it */
+  void verify(const Session& session);
+  void verify(const FrameStream& fw);
+  void dump(MCU::MemoryID memory, uint32_t address, uint32_t length, const std::string& path);
+  void flashFirmware(FirmwareStream& fw);
+  void flashFirmware(const FrameStream& fw);
   void reset();
   void setBaudrate(uint32_t speed);
+  void setPatches(const PatchSet& patches);
+  void setProgress(Progress progress);
+  /* operations stop between two blocks and while waiting for a response
+   * once *cancel is set */
+  void setCancel(const std::atomic<bool>* cancel);
+  /* deadline of every request to the bootloader, 0 derives it per request */
+  void setResponseTimeout(std::chrono::milliseconds timeout);
+  void setIspTiming(const IspTiming& timing);
+  /* time from releasing reset until the bootloader answered, measured by enableISPMode */
+  std::chrono::milliseconds ispReadyTime() const;
+  /* erase time per flash page measured by program, 0 if nothing was erased */
+  std::chrono::microseconds erasePerPage() const;
+  /* bytes written, verified and dumped so far, each operation counts its whole size once it succeeded */
+  uint64_t bytesTransferred() const;
 
 private:
+  void checkCancelled() const;
+  void report(std::size_t done, std::size_t total);
+  void writeRange(uint8_t handle, uint32_t address, const uint8_t* data, std::size_t size, const PatchSet& fields);
+  /* patch fields are flash addresses, other memories are written unpatched */
+  const PatchSet& patchesFor(MCU::MemoryID memory) const;
+  /* at least minimum, and long enough for bytes of request and response at
+   * the ISP baudrate plus the adapter latency: an answer that arrives after
+   * the next probe was sent is taken for its answer and puts every later
+   * response one frame behind */
+  std::chrono::milliseconds probeTimeout(std::chrono::milliseconds minimum, std::size_t bytes) const;
+  /* true if count GetDeviceInfo requests are answered by the K32W061 */
+  bool answers(unsigned int count);
+  /* switches to speed and checks that it answers, otherwise brings the
+   * session back to current and returns false */
+  bool tryBaudrate(uint32_t speed, uint32_t current);
+  /* brings device and transport back to speed after a failed switch */
+  void recoverBaudrate(uint32_t failed, uint32_t speed);
+
   MCU& mcu;
   FTDI::Interface& ftdi;
+  PatchSet patches;
+  Progress progress;
+  const std::atomic<bool>* cancel = nullptr;
+  IspTiming ispTiming;
+  std::chrono::milliseconds responseTimeout{0};
+  std::chrono::milliseconds readyTime{0};
+  std::chrono::microseconds eraseTime{0};
+  uint64_t erasedBytes = 0;
+  uint64_t transferred = 0;
+  std::size_t progressDone;
+  std::size_t progressTotal;
 };
 
 #endif /* _APPLICATION_H_ */
\ No newline at end of file
@@ -0,0 +1,266 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "daemon.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/attributes/scoped_attribute.hpp>
+#include <boost/log/attributes/constant.hpp>
+
+namespace{
+
+struct sockaddr_un socketAddress(const std::string& path){
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.size() >= sizeof(addr.sun_path)){
+    throw std::runtime_error(std::string("Socket path too long: ") + path);
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  return addr;
+}
+
+bool sendLine(int fd, const std::string& type, const std::string& text){
+  auto line = text.empty() ? type : type + " " + text;
+  for(auto& c : line){
+    if(c == '\n' || c == '\r'){
+      c = ' ';
+    }
+  }
+  line += '\n';
+  std::size_t sent = 0;
+  while(sent < line.size()){
+    auto ret = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+    if(ret < 0 && errno == EINTR){
+      continue;
+    }
+    if(ret <= 0){
+      return false;
+    }
+    sent += ret;
+  }
+  return true;
+}
+
+/* returns false on end of stream */
+bool readLine(int fd, std::string& buffer, std::string& line){
+  while(true){
+    auto nl = buffer.find('\n');
+    if(nl != std::string::npos){
+      line = buffer.substr(0, nl);
+      buffer.erase(0, nl + 1);
+      return true;
+    }
+    char chunk[512];
+    auto ret = recv(fd, chunk, sizeof(chunk), 0);
+    if(ret < 0 && errno == EINTR){
+      continue;
+    }
+    if(ret <= 0){
+      return false;
+    }
+    buffer.append(chunk, ret);
+  }
+}
+
+/* forwards the log records of one job to its client */
+class LineBackend : public boost::log::sinks::basic_formatted_sink_backend<char, boost::log::sinks::synchronized_feeding>
+{
+public:
+  explicit LineBackend(int fd) : fd(fd){}
+  void consume(const boost::log::record_view&, const string_type& message){
+    sendLine(fd, "log", message);
+  }
+private:
+  int fd;
+};
+
+}
+
+Daemon::Daemon(const std::string& path, Handler handler) : path(path), handler(handler), nextId(0)
+{
+  auto addr = socketAddress(path);
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(listener < 0){
+    throw std::runtime_error(std::string("Could not create socket: ") + strerror(errno));
+  }
+  /* a socket left behind by a previous instance */
+  unlink(path.c_str());
+  if(bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listener, 16) < 0){
+    auto err = errno;
+    close(listener);
+    throw std::runtime_error(std::string("Could not listen on ") + path + std::string(": ") + strerror(err));
+  }
+  if(pipe2(wake, O_CLOEXEC | O_NONBLOCK) < 0){
+    close(listener);
+    unlink(path.c_str());
+    throw std::runtime_error(std::string("Could not create pipe: ") + strerror(errno));
+  }
+}
+
+Daemon::~Daemon(){
+  reap(true);
+  close(listener);
+  unlink(path.c_str());
+  close(wake[0]);
+  close(wake[1]);
+}
+
+void Daemon::stop(){
+  char c = 0;
+  if(write(wake[1], &c, 1) < 0){
+    /* pipe full, the daemon is stopping anyway */
+  }
+}
+
+void Daemon::run(){
+  BOOST_LOG_TRIVIAL(info) << "Listening on " << path;
+  struct pollfd fds[2] = {{listener, POLLIN, 0}, {wake[0], POLLIN, 0}};
+  while(true){
+    auto ret = poll(fds, 2, -1);
+    if(ret < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      throw std::runtime_error(std::string("Could not poll for connections: ") + strerror(errno));
+    }
+    if(fds[1].revents){
+      break;
+    }
+    int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if(fd < 0){
+      if(errno == EINTR || errno == ECONNABORTED || errno == EAGAIN){
+        continue;
+      }
+      /* EMFILE, ENFILE, ENOMEM: the connection stays pending and poll
+       * reports it again at once, so wait for running jobs to free
+       * resources, but still react to stop() */
+      BOOST_LOG_TRIVIAL(error) << "Could not accept connection: " << strerror(errno);
+      reap(false);
+      poll(&fds[1], 1, ACCEPT_BACKOFF_MS);
+      continue;
+    }
+    reap(false);
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    auto id = ++nextId;
+    connections.push_back(Connection{std::thread([this, fd, id, done](){
+      serve(fd, id);
+      close(fd);
+      *done = true;
+    }), done});
+  }
+  reap(true);
+}
+
+void Daemon::serve(int fd, unsigned int id){
+  BOOST_LOG_SCOPED_THREAD_TAG("Job", id);
+
+  std::string buffer;
+  std::string line;
+  std::string cwd;
+  std::vector<std::string> args;
+  bool complete = false;
+  while(readLine(fd, buffer, line)){
+    if(line == "run"){
+      complete = true;
+      break;
+    }else if(line.compare(0, 4, "cwd ") == 0){
+      cwd = line.substr(4);
+    }else if(line.compare(0, 4, "arg ") == 0){
+      args.push_back(line.substr(4));
+    }else{
+      sendLine(fd, "error", std::string("Unknown request \"") + line + std::string("\""));
+      return;
+    }
+  }
+  if(!complete){
+    return;
+  }
+
+  namespace expr = boost::log::expressions;
+  auto sink = boost::make_shared<boost::log::sinks::synchronous_sink<LineBackend>>(boost::make_shared<LineBackend>(fd));
+  sink->set_filter(expr::attr<unsigned int>("Job") == id);
+  sink->set_formatter(expr::stream << "[" << boost::log::trivial::severity << "] " << expr::smessage);
+  boost::log::core::get()->add_sink(sink);
+
+  BOOST_LOG_TRIVIAL(info) << "Start job " << id;
+  try{
+    handler(args, cwd, [fd](std::size_t done, std::size_t total){
+      sendLine(fd, "progress", std::to_string(done) + " " + std::to_string(total));
+    });
+    boost::log::core::get()->remove_sink(sink);
+    sendLine(fd, "ok", "");
+  }catch(const std::exception& e){
+    BOOST_LOG_TRIVIAL(error) << "Job " << id << " failed: " << e.what();
+    boost::log::core::get()->remove_sink(sink);
+    sendLine(fd, "error", e.what());
+  }
+}
+
+void Daemon::reap(bool all){
+  for(auto it = connections.begin(); it != connections.end(); ){
+    if(all || *it->done){
+      it->worker.join();
+      it = connections.erase(it);
+    }else{
+      ++it;
+    }
+  }
+}
+
+bool Daemon::request(const std::string& path, const std::vector<std::string>& args, const std::string& cwd, const Event& event, std::string& error){
+  auto addr = socketAddress(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0){
+    throw std::runtime_error(std::string("Could not create socket: ") + strerror(errno));
+  }
+  if(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0){
+    auto err = errno;
+    close(fd);
+    throw std::runtime_error(std::string("Could not connect to ") + path + std::string(": ") + strerror(err));
+  }
+
+  bool sent = sendLine(fd, "cwd", cwd);
+  for(const auto& arg : args){
+    sent = sent && sendLine(fd, "arg", arg);
+  }
+  sent = sent && sendLine(fd, "run", "");
+
+  std::string buffer;
+  std::string line;
+  bool success = false;
+  error = "Connection to daemon lost";
+  while(sent && readLine(fd, buffer, line)){
+    auto space = line.find(' ');
+    auto type = line.substr(0, space);
+    auto text = space == std::string::npos ? std::string() : line.substr(space + 1);
+    if(type == "ok"){
+      success = true;
+      error.clear();
+      break;
+    }else if(type == "error"){
+      error = text;
+      break;
+    }
+    event(type, text);
+  }
+  close(fd);
+  return success;
+}
@@ -0,0 +1,71 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Job server on a Unix domain socket. Every connection carries one job,
+ * using a line based protocol:
+ *
+ *   client: cwd <directory>       working directory for relative paths
+ *           arg <argument>        one line per command line argument
+ *           run
+ *   daemon: log <message>         log records of the job
+ *           progress <done> <total>
+ *           ok | error <message>  end of the job
+ *
+ * Jobs run concurrently, one thread per connection. */
+class Daemon
+{
+public:
+  using Progress = std::function<void(std::size_t done, std::size_t total)>;
+  using Handler = std::function<void(const std::vector<std::string>& args, const std::string& cwd, const Progress& progress)>;
+  using Event = std::function<void(const std::string& type, const std::string& text)>;
+
+  Daemon(const std::string& path, Handler handler);
+  ~Daemon();
+
+  /* blocks until stop() is called */
+  void run();
+  /* async-signal-safe */
+  void stop();
+
+  /* client side, calls event for every log and progress line and returns
+   * true if the job succeeded, otherwise error holds the reason */
+  static bool request(const std::string& path, const std::vector<std::string>& args, const std::string& cwd, const Event& event, std::string& error);
+
+private:
+  struct Connection{
+    std::thread worker;
+    std::shared_ptr<std::atomic<bool>> done;
+  };
+
+  void serve(int fd, unsigned int id);
+  void reap(bool all);
+
+  /* pause after accept failed for lack of descriptors or memory */
+  static const int ACCEPT_BACKOFF_MS=100;
+
+  std::string path;
+  Handler handler;
+  int listener;
+  int wake[2];
+  unsigned int nextId;
+  std::list<Connection> connections;
+};
+
+#endif /* _DAEMON_H_ */
@@ -0,0 +1,111 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "device_profiles.h"
+#include "state_lock.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <sys/stat.h>
+
+static bool parseLine(const std::string& line, std::string& adapter, DeviceProfiles::Profile& profile){
+  std::istringstream is(line);
+  long long ispReady = 0;
+  long long erasePerPage = 0;
+  long long updated = 0;
+  if(!(is >> adapter >> std::hex >> profile.chipId >> profile.version >> std::dec >> profile.speed >> ispReady >> erasePerPage >> updated)){
+    return false;
+  }
+  profile.ispReady = std::chrono::milliseconds(ispReady);
+  profile.erasePerPage = std::chrono::microseconds(erasePerPage);
+  profile.updated = updated;
+  return true;
+}
+
+DeviceProfiles::DeviceProfiles(const std::string& path) : path(path){
+}
+
+template<typename Match>
+bool DeviceProfiles::find(const std::string& adapter, Match match, Profile& profile) const{
+  /* nothing learned yet, its directory may not even exist */
+  if(access(path.c_str(), F_OK) != 0){
+    return false;
+  }
+  StateLock lock(path, LOCK_SH);
+  std::ifstream ifs(path);
+  std::string line;
+  bool found = false;
+  while(std::getline(ifs, line)){
+    std::string name;
+    Profile p;
+    if(parseLine(line, name, p) && name == adapter && match(p) && (!found || p.updated >= profile.updated)){
+      profile = p;
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool DeviceProfiles::lookup(const std::string& adapter, uint32_t chipId, uint32_t version, Profile& profile) const{
+  return find(adapter, [chipId, version](const Profile& p){ return p.chipId == chipId && p.version == version; }, profile);
+}
+
+bool DeviceProfiles::lookup(const std::string& adapter, Profile& profile) const{
+  return find(adapter, [](const Profile&){ return true; }, profile);
+}
+
+void DeviceProfiles::store(const std::string& adapter, const Profile& profile){
+  update(adapter, profile.chipId, profile.version, &profile);
+}
+
+void DeviceProfiles::forget(const std::string& adapter, uint32_t chipId, uint32_t version){
+  update(adapter, chipId, version, nullptr);
+}
+
+void DeviceProfiles::update(const std::string& adapter, uint32_t chipId, uint32_t version, const Profile* profile){
+  /* the directory of the default path does not exist before the first run */
+  auto slash = path.rfind('/');
+  if(profile && slash != std::string::npos && slash != 0){
+    mkdir(path.substr(0, slash).c_str(), 0700);
+  }
+
+  StateLock lock(path, LOCK_EX);
+  std::vector<std::string> lines;
+  {
+    std::ifstream ifs(path);
+    std::string line;
+    while(std::getline(ifs, line)){
+      std::string name;
+      Profile p;
+      if(parseLine(line, name, p) && !(name == adapter && p.chipId == chipId && p.version == version)){
+        lines.push_back(line);
+      }
+    }
+  }
+  if(profile){
+    std::ostringstream os;
+    os << adapter << " " << std::hex << chipId << " " << version << std::dec << " " << profile->speed
+       << " " << profile->ispReady.count() << " " << profile->erasePerPage.count() << " " << static_cast<long long>(std::time(nullptr));
+    lines.push_back(os.str());
+  }
+  StateLock::replace(path, lines);
+}
+
+std::string DeviceProfiles::defaultPath(){
+  auto data = std::getenv("XDG_DATA_HOME");
+  if(data != nullptr && data[0] != '\0'){
+    return std::string(data) + "/nxp-isp/profiles";
+  }
+  auto home = std::getenv("HOME");
+  if(home != nullptr && home[0] != '\0'){
+    return std::string(home) + "/.local/share/nxp-isp/profiles";
+  }
+  return "";
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _DEVICE_PROFILES_H_
+#define _DEVICE_PROFILES_H_
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+/* What earlier sessions measured about a chip on an adapter, so new
+ * sessions start from it instead of probing and tuning again. One line per
+ * chip and adapter:
+ *
+ *   <adapter> <chip id> <version> <baudrate> <ISP ready ms> <erase us per page> <unix time>
+ *
+ * adapter is the USB serial number of the adapter (its bus path if it has
+ * none) or the remote port, see Job::adapterId. Measurements that were not
+ * taken are 0. Unlike PortState the file is kept across reboots and
+ * locked the same way, several processes can share it. */
+class DeviceProfiles
+{
+public:
+  struct Profile{
+    uint32_t chipId = 0;
+    uint32_t version = 0;
+    /* fastest baudrate that answered reliably, see Application::negotiateBaudrate */
+    uint32_t speed = 0;
+    /* time from releasing reset until the bootloader answered */
+    std::chrono::milliseconds ispReady{0};
+    std::chrono::microseconds erasePerPage{0};
+    std::time_t updated = 0;
+  };
+
+  explicit DeviceProfiles(const std::string& path);
+
+  bool lookup(const std::string& adapter, uint32_t chipId, uint32_t version, Profile& profile) const;
+  /* the latest profile of any chip on adapter, for what is needed before
+   * the chip answered, like the ISP entry time */
+  bool lookup(const std::string& adapter, Profile& profile) const;
+  void store(const std::string& adapter, const Profile& profile);
+  void forget(const std::string& adapter, uint32_t chipId, uint32_t version);
+
+  /* $XDG_DATA_HOME/nxp-isp/profiles or ~/.local/share/nxp-isp/profiles,
+   * empty when neither is known */
+  static std::string defaultPath();
+
+private:
+  template<typename Match>
+  bool find(const std::string& adapter, Match match, Profile& profile) const;
+  void update(const std::string& adapter, uint32_t chipId, uint32_t version, const Profile* profile);
+
+  std::string path;
+};
+
+#endif /* _DEVICE_PROFILES_H_ */
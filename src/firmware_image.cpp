@@ -0,0 +1,114 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "firmware_image.h"
+#include "image_parser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+
+FirmwareImage::FirmwareImage(const std::string& path, std::size_t capacity) : file(path)
+{
+  fmt = detectFormat(path, file.data(), file.size());
+  load(path, capacity);
+}
+
+FirmwareImage::FirmwareImage(const std::string& path, std::size_t capacity, Format format) : file(path), fmt(format)
+{
+  load(path, capacity);
+}
+
+FirmwareImage::~FirmwareImage()
+{
+}
+
+void FirmwareImage::load(const std::string& path, std::size_t capacity){
+  switch(fmt){
+    case Format::binary:{
+      if(file.size() != 0){
+        segs.push_back(Segment{0, file.data(), file.size()});
+      }
+      break;
+    }
+    case Format::intelHex:
+    case Format::sRecord:{
+      auto map = (fmt == Format::intelHex) ? ImageParser::parseIntelHex(file.data(), file.size())
+                                           : ImageParser::parseSRecord(file.data(), file.size());
+      for(auto& range : map){
+        decoded.push_back(std::move(range.second));
+        segs.push_back(Segment{range.first, decoded.back().data(), decoded.back().size()});
+      }
+      break;
+    }
+    case Format::elf:{
+      for(const auto& seg : ImageParser::parseElf(file.data(), file.size())){
+        segs.push_back(Segment{seg.address, file.data() + seg.offset, seg.size});
+      }
+      std::sort(segs.begin(), segs.end(), [](const Segment& a, const Segment& b){ return a.address < b.address; });
+      for(std::size_t i=1;i<segs.size();i++){
+        if(static_cast<uint64_t>(segs[i-1].address) + segs[i-1].size > segs[i].address){
+          throw std::runtime_error(path + std::string(": overlapping ELF load segments"));
+        }
+      }
+      break;
+    }
+  }
+
+  for(const auto& seg : segs){
+    if(static_cast<uint64_t>(seg.address) + seg.size > capacity){
+      throw std::runtime_error(std::string("Firmware ") + path + std::string(" places ") + std::to_string(seg.size) + std::string(" bytes at address ") + std::to_string(seg.address) + std::string(" but target memory only holds ") + std::to_string(capacity) + std::string(" bytes"));
+    }
+  }
+}
+
+FirmwareImage::Format FirmwareImage::format() const{
+  return fmt;
+}
+
+const std::vector<FirmwareImage::Segment>& FirmwareImage::segments() const{
+  return segs;
+}
+
+std::size_t FirmwareImage::size() const{
+  std::size_t total = 0;
+  for(const auto& seg : segs){
+    total += seg.size;
+  }
+  return total;
+}
+
+FirmwareImage::Format FirmwareImage::detectFormat(const std::string& path, const uint8_t* data, std::size_t size){
+  if(size >= 4 && memcmp(data, "\x7f" "ELF", 4) == 0){
+    return Format::elf;
+  }
+
+  auto dot = path.rfind('.');
+  std::string ext = (dot == std::string::npos) ? std::string() : boost::algorithm::to_lower_copy(path.substr(dot + 1));
+  if(ext == "hex" || ext == "ihex"){
+    return Format::intelHex;
+  }
+  if(ext == "srec" || ext == "s19" || ext == "s28" || ext == "s37" || ext == "mot"){
+    return Format::sRecord;
+  }
+  return Format::binary;
+}
+
+FirmwareImage::Format FirmwareImage::stringToFormat(const std::string& str){
+  if(str == "bin"){
+    return Format::binary;
+  }else if(str == "hex"){
+    return Format::intelHex;
+  }else if(str == "srec"){
+    return Format::sRecord;
+  }else if(str == "elf"){
+    return Format::elf;
+  }
+  throw std::runtime_error(std::string("Unknown Firmware Format \"") + str + std::string("\""));
+}
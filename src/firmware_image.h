@@ -0,0 +1,57 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _FIRMWARE_IMAGE_H_
+#define _FIRMWARE_IMAGE_H_
+
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Firmware image as a sparse list of address ranges. Raw binaries and ELF
+ * segments point straight into the read-only file mapping, text formats
+ * (Intel HEX, S-record) are decoded once into owned buffers. */
+class FirmwareImage
+{
+public:
+  enum class Format{
+    binary,
+    intelHex,
+    sRecord,
+    elf
+  };
+
+  struct Segment{
+    uint32_t address;
+    const uint8_t* data;
+    std::size_t size;
+  };
+
+  FirmwareImage(const std::string& path, std::size_t capacity);
+  FirmwareImage(const std::string& path, std::size_t capacity, Format format);
+  ~FirmwareImage();
+
+  Format format() const;
+  const std::vector<Segment>& segments() const;
+  std::size_t size() const;
+
+  static Format detectFormat(const std::string& path, const uint8_t* data, std::size_t size);
+  static Format stringToFormat(const std::string& str);
+
+private:
+  void load(const std::string& path, std::size_t capacity);
+
+  MappedFile file;
+  Format fmt;
+  std::vector<std::vector<uint8_t>> decoded;
+  std::vector<Segment> segs;
+};
+
+#endif /* _FIRMWARE_IMAGE_H_ */
@@ -8,7 +8,6 @@
  /* SPDX-License-Identifier: BSD-2-Clause-Patent */
 #include "firmware_reader.h"
 
-#include <iterator>
 
 FirmwareReader::FirmwareReader(std::istream& _is) : is(_is)
 {
@@ -19,14 +18,9 @@ FirmwareReader::~FirmwareReader()
 }
 
 std::vector<uint8_t> FirmwareReader::data() const{
-  is.unsetf(std::ios::skipws);
-
-    std::vector<uint8_t> vec{};
-  vec.reserve(size());
-
-  vec.insert(vec.begin(),
-             std::istream_iterator<uint8_t>(is),
-             std::istream_iterator<uint8_t>());
+  std::vector<uint8_t> vec(size());
+  is.read(reinterpret_cast<char*>(vec.data()), vec.size());
+  vec.resize(is.gcount());
 
   return vec;
 }
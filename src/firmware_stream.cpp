@@ -0,0 +1,289 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "firmware_stream.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/log/trivial.hpp>
+
+#define INPUT_BUFFER_SIZE (64 * 1024)
+
+FirmwareStream::FirmwareStream(const std::string& path, std::size_t capacity, std::size_t chunk_size, std::size_t depth) :
+  capacity(capacity), chunkSize(chunk_size), depth(depth)
+{
+  if(path == "-"){
+    fd = STDIN_FILENO;
+  }else{
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+      throw std::runtime_error(std::string("Could not open ") + path + std::string(": ") + strerror(errno));
+    }
+    ownsFd = true;
+  }
+  if(pipe2(wake, O_CLOEXEC | O_NONBLOCK) < 0){
+    if(ownsFd){
+      ::close(fd);
+    }
+    throw std::runtime_error(std::string("Could not create pipe: ") + strerror(errno));
+  }
+  current.reserve(chunkSize);
+  reader = std::thread(&FirmwareStream::run, this);
+}
+
+FirmwareStream::~FirmwareStream(){
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  notFull.notify_all();
+  char c = 0;
+  if(::write(wake[1], &c, 1) < 0){
+    /* pipe full, the reader is woken up anyway */
+  }
+  reader.join();
+  ::close(wake[0]);
+  ::close(wake[1]);
+  if(ownsFd){
+    ::close(fd);
+  }
+}
+
+bool FirmwareStream::isStreamInput(const std::string& path){
+  if(path == "-" || boost::algorithm::iends_with(path, ".gz") || boost::algorithm::iends_with(path, ".zst")){
+    return true;
+  }
+  struct stat st;
+  if(stat(path.c_str(), &st) == 0 && !S_ISREG(st.st_mode)){
+    return true;
+  }
+  return false;
+}
+
+FirmwareStream::Compression FirmwareStream::detectCompression(const uint8_t* data, std::size_t size){
+  if(size >= 2 && data[0] == 0x1F && data[1] == 0x8B){
+    return Compression::gzip;
+  }
+  if(size >= 4 && data[0] == 0x28 && data[1] == 0xB5 && data[2] == 0x2F && data[3] == 0xFD){
+    return Compression::zstd;
+  }
+  return Compression::none;
+}
+
+bool FirmwareStream::next(std::vector<uint8_t>& chunk){
+  std::unique_lock<std::mutex> lock(mutex);
+  notEmpty.wait(lock, [this]{ return !queue.empty() || finished; });
+  if(!queue.empty()){
+    chunk = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+  }
+  if(error){
+    std::rethrow_exception(error);
+  }
+  return false;
+}
+
+std::size_t FirmwareStream::bytesRead() const{
+  return total;
+}
+
+void FirmwareStream::run(){
+  std::exception_ptr err;
+  try{
+    std::vector<uint8_t> in(INPUT_BUFFER_SIZE);
+    /* collect enough bytes to recognize the compression magic */
+    std::size_t n = 0;
+    while(n < 4){
+      auto ret = readInput(in, n);
+      if(ret == 0){
+        break;
+      }
+      n += ret;
+    }
+
+    switch(detectCompression(in.data(), n)){
+      case Compression::gzip:{
+        BOOST_LOG_TRIVIAL(info) << "Decompress gzip firmware stream";
+        inflateGzip(in, n);
+        break;
+      }
+      case Compression::zstd:{
+        BOOST_LOG_TRIVIAL(info) << "Decompress zstd firmware stream";
+        decompressZstd(in, n);
+        break;
+      }
+      case Compression::none:{
+        while(n > 0){
+          feed(in.data(), n);
+          n = readInput(in);
+        }
+        break;
+      }
+    }
+    if(!current.empty()){
+      push(std::move(current));
+    }
+  }catch(const Stopped&){
+  }catch(...){
+    err = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = err;
+    finished = true;
+  }
+  notEmpty.notify_all();
+}
+
+std::size_t FirmwareStream::readInput(std::vector<uint8_t>& buf, std::size_t offset){
+  struct pollfd fds[2] = {{fd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+  while(true){
+    auto ret = poll(fds, 2, -1);
+    if(ret < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      throw std::runtime_error(std::string("Could not poll firmware input: ") + strerror(errno));
+    }
+    if(fds[1].revents){
+      throw Stopped();
+    }
+    auto n = ::read(fd, buf.data() + offset, buf.size() - offset);
+    if(n < 0){
+      if(errno == EINTR || errno == EAGAIN){
+        continue;
+      }
+      throw std::runtime_error(std::string("Could not read firmware input: ") + strerror(errno));
+    }
+    return n;
+  }
+}
+
+void FirmwareStream::feed(const uint8_t* data, std::size_t size){
+  if(total + size > capacity){
+    throw std::runtime_error(std::string("Firmware stream exceeds target memory size of ") + std::to_string(capacity) + std::string(" bytes"));
+  }
+  total += size;
+  while(size > 0){
+    auto n = std::min(size, chunkSize - current.size());
+    current.insert(current.end(), data, data + n);
+    data += n;
+    size -= n;
+    if(current.size() == chunkSize){
+      push(std::move(current));
+      current = std::vector<uint8_t>();
+      current.reserve(chunkSize);
+    }
+  }
+}
+
+void FirmwareStream::push(std::vector<uint8_t>&& chunk){
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this]{ return queue.size() < depth || stopped; });
+    if(stopped){
+      throw Stopped();
+    }
+    queue.push_back(std::move(chunk));
+  }
+  notEmpty.notify_one();
+}
+
+void FirmwareStream::inflateGzip(std::vector<uint8_t>& in, std::size_t n){
+  z_stream zs{};
+  /* 15 window bits + 32 lets zlib detect gzip and zlib headers */
+  if(inflateInit2(&zs, 15 + 32) != Z_OK){
+    throw std::runtime_error("Could not initialize gzip decompression");
+  }
+  std::vector<uint8_t> out(INPUT_BUFFER_SIZE);
+  bool ended = false;
+  try{
+    while(n > 0){
+      zs.next_in = in.data();
+      zs.avail_in = n;
+      do{
+        zs.next_out = out.data();
+        zs.avail_out = out.size();
+        auto ret = inflate(&zs, Z_NO_FLUSH);
+        if(ret == Z_BUF_ERROR){
+          break;
+        }
+        if(ret != Z_OK && ret != Z_STREAM_END){
+          throw std::runtime_error(std::string("Corrupt gzip firmware stream: ") + (zs.msg ? zs.msg : "unknown error"));
+        }
+        feed(out.data(), out.size() - zs.avail_out);
+        ended = (ret == Z_STREAM_END);
+        if(ended && zs.avail_in > 0){
+          /* concatenated gzip members */
+          inflateReset(&zs);
+        }
+      }while(zs.avail_in > 0 || zs.avail_out == 0);
+      n = readInput(in);
+    }
+  }catch(...){
+    inflateEnd(&zs);
+    throw;
+  }
+  inflateEnd(&zs);
+  if(!ended){
+    throw std::runtime_error("Truncated gzip firmware stream");
+  }
+}
+
+void FirmwareStream::decompressZstd(std::vector<uint8_t>& in, std::size_t n){
+#ifdef HAVE_ZSTD
+  ZSTD_DStream* ds = ZSTD_createDStream();
+  if(ds == nullptr){
+    throw std::runtime_error("Could not initialize zstd decompression");
+  }
+  ZSTD_initDStream(ds);
+  std::vector<uint8_t> out(ZSTD_DStreamOutSize());
+  std::size_t pending = 0;
+  try{
+    while(n > 0){
+      ZSTD_inBuffer input{in.data(), n, 0};
+      bool full = false;
+      while(input.pos < input.size || full){
+        ZSTD_outBuffer output{out.data(), out.size(), 0};
+        pending = ZSTD_decompressStream(ds, &output, &input);
+        if(ZSTD_isError(pending)){
+          throw std::runtime_error(std::string("Corrupt zstd firmware stream: ") + ZSTD_getErrorName(pending));
+        }
+        feed(out.data(), output.pos);
+        full = (output.pos == output.size);
+      }
+      n = readInput(in);
+    }
+  }catch(...){
+    ZSTD_freeDStream(ds);
+    throw;
+  }
+  ZSTD_freeDStream(ds);
+  if(pending != 0){
+    throw std::runtime_error("Truncated zstd firmware stream");
+  }
+#else
+  (void)in;
+  (void)n;
+  throw std::runtime_error("nxp-isp was built without zstd support");
+#endif
+}
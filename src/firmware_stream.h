@@ -0,0 +1,78 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _FIRMWARE_STREAM_H_
+#define _FIRMWARE_STREAM_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Raw firmware binary read from a pipe, stdin ("-") or a compressed file.
+ * A reader thread decompresses (gzip, zstd) and cuts the input into
+ * chunks which are queued until the flashing loop picks them up, so the
+ * first frame can be sent before the input has been read completely. */
+class FirmwareStream
+{
+public:
+  enum class Compression{
+    none,
+    gzip,
+    zstd
+  };
+
+  FirmwareStream(const std::string& path, std::size_t capacity, std::size_t chunk_size=512, std::size_t depth=64);
+  FirmwareStream(const FirmwareStream&) = delete;
+  FirmwareStream& operator=(const FirmwareStream&) = delete;
+  ~FirmwareStream();
+
+  /* blocks until the next chunk is available, returns false at the end of
+   * the input and rethrows errors of the reader thread */
+  bool next(std::vector<uint8_t>& chunk);
+  std::size_t bytesRead() const;
+
+  static bool isStreamInput(const std::string& path);
+  static Compression detectCompression(const uint8_t* data, std::size_t size);
+
+private:
+  struct Stopped{};
+
+  void run();
+  std::size_t readInput(std::vector<uint8_t>& buf, std::size_t offset=0);
+  void feed(const uint8_t* data, std::size_t size);
+  void push(std::vector<uint8_t>&& chunk);
+  void inflateGzip(std::vector<uint8_t>& in, std::size_t n);
+  void decompressZstd(std::vector<uint8_t>& in, std::size_t n);
+
+  int fd = -1;
+  int wake[2] = {-1, -1};
+  bool ownsFd = false;
+  const std::size_t capacity;
+  const std::size_t chunkSize;
+  const std::size_t depth;
+
+  std::vector<uint8_t> current;
+  std::atomic<std::size_t> total{0};
+
+  mutable std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  std::deque<std::vector<uint8_t>> queue;
+  bool finished = false;
+  bool stopped = false;
+  std::exception_ptr error;
+  std::thread reader;
+};
+
+#endif /* _FIRMWARE_STREAM_H_ */
@@ -0,0 +1,190 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "frame_stream.h"
+#include "k32w061.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+static const char MAGIC[4] = {'I', 'S', 'P', 'F'};
+
+FrameStream::FrameStream(const std::string& path) : file(new MappedFile(path))
+{
+  load(path, file->data(), file->size());
+}
+
+FrameStream::FrameStream(std::string&& encoded) : buffer(std::move(encoded))
+{
+  load("Encoded frame stream", reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
+}
+
+void FrameStream::load(const std::string& name, const uint8_t* data, std::size_t size)
+{
+  if(size < sizeof(FileHeader)){
+    throw std::runtime_error(name + std::string(" is too short for an ISP frame stream"));
+  }
+  memcpy(&header, data, sizeof(header));
+  if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0){
+    throw std::runtime_error(name + std::string(" is not an ISP frame stream"));
+  }
+  if(header.version != FORMAT_VERSION){
+    throw std::runtime_error(name + std::string(" has unsupported frame stream version ") + std::to_string(header.version));
+  }
+  if(static_cast<uint64_t>(header.indexOffset) + static_cast<uint64_t>(header.frameCount) * sizeof(IndexEntry) > size){
+    throw std::runtime_error(name + std::string(": frame index out of bounds"));
+  }
+
+  frameList.reserve(header.frameCount);
+  for(uint32_t i=0;i<header.frameCount;i++){
+    IndexEntry entry;
+    memcpy(&entry, data + header.indexOffset + i * sizeof(IndexEntry), sizeof(entry));
+    if(entry.offset < sizeof(FileHeader) || static_cast<uint64_t>(entry.offset) + entry.size > header.indexOffset){
+      throw std::runtime_error(name + std::string(": frame ") + std::to_string(i) + std::string(" out of bounds"));
+    }
+    if(!K32W061::isWriteMemoryFrame(data + entry.offset, entry.size, entry.address)){
+      throw std::runtime_error(name + std::string(": frame ") + std::to_string(i) + std::string(" is not a WriteMemory request matching the index"));
+    }
+    frameList.push_back(Frame{entry.address, data + entry.offset, entry.size});
+  }
+
+  if(static_cast<uint64_t>(header.fieldOffset) + static_cast<uint64_t>(header.fieldCount) * sizeof(FieldEntry) > size){
+    throw std::runtime_error(name + std::string(": field table out of bounds"));
+  }
+  for(uint32_t i=0;i<header.fieldCount;i++){
+    FieldEntry entry;
+    memcpy(&entry, data + header.fieldOffset + i * sizeof(FieldEntry), sizeof(entry));
+    fieldList.push_back(PatchSet::Field{std::string(entry.name, strnlen(entry.name, sizeof(entry.name))), entry.address, entry.size});
+  }
+}
+
+FrameStream::~FrameStream()
+{
+}
+
+MCU::MemoryID FrameStream::memory() const{
+  return static_cast<MCU::MemoryID>(header.memory);
+}
+
+uint8_t FrameStream::handle() const{
+  return header.handle;
+}
+
+const std::vector<FrameStream::Frame>& FrameStream::frames() const{
+  return frameList;
+}
+
+std::size_t FrameStream::payloadSize() const{
+  return header.payloadSize;
+}
+
+const std::vector<PatchSet::Field>& FrameStream::fields() const{
+  return fieldList;
+}
+
+bool FrameStream::covers(MCU::MemoryID id, uint32_t address, std::size_t size) const{
+  if(id != memory()){
+    return false;
+  }
+  std::vector<const Frame*> sorted;
+  for(const auto& frame : frameList){
+    sorted.push_back(&frame);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const Frame* a, const Frame* b){ return a->address < b->address; });
+  uint64_t end = uint64_t(address) + size;
+  uint64_t covered = address;
+  for(auto frame : sorted){
+    if(covered >= end){
+      break;
+    }
+    uint64_t frameEnd = uint64_t(frame->address) + frame->size - K32W061::WRITE_FRAME_OVERHEAD;
+    if(frame->address <= covered && frameEnd > covered){
+      covered = frameEnd;
+    }
+  }
+  return covered >= end;
+}
+
+bool FrameStream::isFrameStream(const std::string& path){
+  std::ifstream ifs(path, std::ios::binary);
+  char magic[sizeof(MAGIC)] = {};
+  ifs.read(magic, sizeof(magic));
+  return ifs.gcount() == sizeof(magic) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::string FrameStream::serialize(const FirmwareImage& image, const std::vector<PatchSet::Field>& fields, MCU::MemoryID memory, uint8_t handle){
+  FileHeader hdr{};
+  memcpy(hdr.magic, MAGIC, sizeof(MAGIC));
+  hdr.version = FORMAT_VERSION;
+  hdr.memory = memory;
+  hdr.handle = handle;
+
+  for(const auto& field : fields){
+    if(field.name.size() >= sizeof(FieldEntry::name)){
+      throw std::runtime_error(std::string("Patch field name ") + field.name + std::string(" is too long"));
+    }
+  }
+
+  /* the header is filled in once the sizes are known */
+  std::string out(sizeof(hdr), '\0');
+  std::vector<IndexEntry> index;
+  for(const auto& seg : image.segments()){
+    std::size_t done = 0;
+    while(done < seg.size){
+      auto chunk = K32W061::frameChunkSize(seg.address + done, seg.size - done);
+      auto frame = K32W061::writeMemoryFrame(handle, seg.address + done, seg.data + done, chunk);
+      index.push_back(IndexEntry{static_cast<uint32_t>(out.size()), static_cast<uint32_t>(seg.address + done), static_cast<uint16_t>(frame.size()), 0});
+      out.append(reinterpret_cast<const char*>(frame.data()), frame.size());
+      done += chunk;
+    }
+    hdr.payloadSize += seg.size;
+  }
+
+  hdr.frameCount = index.size();
+  hdr.indexOffset = out.size();
+  out.append(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+
+  hdr.fieldCount = fields.size();
+  hdr.fieldOffset = out.size();
+  for(const auto& field : fields){
+    FieldEntry entry{};
+    memcpy(entry.name, field.name.data(), field.name.size());
+    entry.address = field.address;
+    entry.size = field.size;
+    out.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+  }
+  memcpy(&out[0], &hdr, sizeof(hdr));
+  return out;
+}
+
+void FrameStream::compile(const FirmwareImage& image, const std::string& path, const std::vector<PatchSet::Field>& fields, MCU::MemoryID memory, uint8_t handle){
+  auto content = serialize(image, fields, memory, handle);
+  std::string tmp = path + std::string(".tmp");
+  std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+  if(!ofs.is_open()){
+    throw std::runtime_error(std::string("Could not create ") + tmp);
+  }
+  ofs.write(content.data(), content.size());
+  ofs.close();
+  if(!ofs){
+    std::remove(tmp.c_str());
+    throw std::runtime_error(std::string("Could not write ") + tmp);
+  }
+  if(std::rename(tmp.c_str(), path.c_str()) != 0){
+    std::remove(tmp.c_str());
+    throw std::runtime_error(std::string("Could not rename ") + tmp + std::string(" to ") + path);
+  }
+}
+
+std::shared_ptr<const FrameStream> FrameStream::encode(const FirmwareImage& image){
+  return std::shared_ptr<const FrameStream>(new FrameStream(serialize(image, {}, MCU::MemoryID::flash, 0)));
+}
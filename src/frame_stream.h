@@ -0,0 +1,103 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _FRAME_STREAM_H_
+#define _FRAME_STREAM_H_
+
+#include "firmware_image.h"
+#include "mapped_file.h"
+#include "mcu.h"
+#include "patch_set.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Precompiled ISP image (.ispf): fully encoded WriteMemory frames with
+ * their CRCs, followed by an index. Flashing maps the file and sends the
+ * frames verbatim. encode builds the same layout in memory.
+ *
+ * Layout (little endian):
+ *   FileHeader
+ *   frame data, one encoded frame after the other
+ *   IndexEntry[frameCount] at indexOffset
+ *   FieldEntry[fieldCount] at fieldOffset, the patch fields of the image
+ */
+class FrameStream
+{
+public:
+  struct Frame{
+    uint32_t address;
+    const uint8_t* data;
+    std::size_t size;
+  };
+
+  FrameStream(const std::string& path);
+  /* frames point into the mapping or buffer of the object */
+  FrameStream(const FrameStream&) = delete;
+  FrameStream& operator=(const FrameStream&) = delete;
+  ~FrameStream();
+
+  MCU::MemoryID memory() const;
+  uint8_t handle() const;
+  const std::vector<Frame>& frames() const;
+  std::size_t payloadSize() const;
+  const std::vector<PatchSet::Field>& fields() const;
+  /* true if [address, address+size) of id is written by the frames, possibly by several */
+  bool covers(MCU::MemoryID id, uint32_t address, std::size_t size) const;
+
+  static bool isFrameStream(const std::string& path);
+  static void compile(const FirmwareImage& image, const std::string& path, const std::vector<PatchSet::Field>& fields={}, MCU::MemoryID memory=MCU::MemoryID::flash, uint8_t handle=0);
+  /* encodes the image once into a frame stream held in memory, no file is written */
+  static std::shared_ptr<const FrameStream> encode(const FirmwareImage& image);
+
+  static const uint16_t FORMAT_VERSION=2;
+
+private:
+  struct __attribute__((__packed__)) FileHeader{
+    char magic[4];
+    uint16_t version;
+    uint8_t memory;
+    uint8_t handle;
+    uint32_t frameCount;
+    uint32_t indexOffset;
+    uint32_t payloadSize;
+    uint32_t fieldCount;
+    uint32_t fieldOffset;
+  };
+
+  struct __attribute__((__packed__)) IndexEntry{
+    uint32_t offset;
+    uint32_t address;
+    uint16_t size;
+    uint16_t reserved;
+  };
+
+  struct __attribute__((__packed__)) FieldEntry{
+    char name[24];
+    uint32_t address;
+    uint32_t size;
+  };
+
+  /* takes the bytes of a stream built by serialize */
+  explicit FrameStream(std::string&& encoded);
+  /* reads header, index and field table of the size bytes at data */
+  void load(const std::string& name, const uint8_t* data, std::size_t size);
+  /* the complete .ispf layout */
+  static std::string serialize(const FirmwareImage& image, const std::vector<PatchSet::Field>& fields, MCU::MemoryID memory, uint8_t handle);
+
+  /* one of them holds the bytes */
+  std::unique_ptr<MappedFile> file;
+  std::string buffer;
+  FileHeader header;
+  std::vector<Frame> frameList;
+  std::vector<PatchSet::Field> fieldList;
+};
+
+#endif /* _FRAME_STREAM_H_ */
@@ -9,6 +9,7 @@
 #ifndef _FTDI_INTERFACE_H_
 #define _FTDI_INTERFACE_H_
 
+#include <chrono>
 #include <string>
 #include <vector>
 #include <cstdint>
@@ -28,6 +29,7 @@ namespace FTDI{
 
   class Interface{
     public:
+    virtual ~Interface(){}
     virtual void open(const int vid, const int pid) = 0;
     virtual void open(std::string dev) = 0;
     virtual bool is_open() = 0;
@@ -37,7 +39,16 @@ namespace FTDI{
 
     virtual int writeData(std::vector<uint8_t> data) = 0;
     virtual std::vector<uint8_t> readData() = 0;
+    /* readData returns an empty vector if nothing arrived within this time, 0 waits forever */
+    virtual int setReadTimeout(unsigned int milliseconds) = 0;
     virtual int setBaudrate(uint32_t speed) = 0;
+    /* discards everything received but not read yet */
+    virtual void flushInput() = 0;
+    /* round trip time of the link to the adapter plus the time the adapter
+     * holds back short responses (FTDI latency timer) */
+    virtual std::chrono::microseconds latency() const { return std::chrono::microseconds(0); }
+    /* false for baudrates the adapter or link can not be set to */
+    virtual bool supportsBaudrate(uint32_t speed) const { (void)speed; return true; }
 };
 }
 
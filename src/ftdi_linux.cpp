@@ -7,13 +7,19 @@
 
  /* SPDX-License-Identifier: BSD-2-Clause-Patent */
 #include "ftdi_linux.h"
+#include "usb_enumerator.h"
 
 #include <ftdi.h>
 #include <stdexcept>
 #include <memory.h>
 #include <array>
+#include <chrono>
 #include <iostream>
+#include <sys/ioctl.h>
+#include <boost/log/trivial.hpp>
 #define UNUSED(x) (void)(x)
+const unsigned char FTDILinux::LATENCY_TIMER_MS;
+
 FTDILinux::FTDILinux(){
 
 }
@@ -28,8 +34,34 @@ FTDILinux::~FTDILinux(){
     ftdi_free(ftdi);
   }
 }
+/* dev selects one adapter, so identical adapters can be used at once: a
+ * tty of the adapter, usb:<bus path> or serial:<serial number> */
 void FTDILinux::open(std::string dev){
-  UNUSED(dev);
+  auto usb = UsbEnumerator::system().findUsbDevice(dev);
+  ftdi = ftdi_new();
+  if(ftdi == nullptr){
+    throw std::runtime_error("Could not create new FTDI instance");
+  }
+
+  /* every channel of a multi-channel part is a separate USB interface and
+   * gets its own context, so the channels can be driven concurrently */
+  if(usb.channel != 0){
+    BOOST_LOG_TRIVIAL(info) << "Use channel " << char('A' + usb.channel - 1) << " of " << usb.busPath;
+    if(ftdi_set_interface(ftdi, static_cast<ftdi_interface>(INTERFACE_A + usb.channel - 1)) < 0){
+      std::string error = ftdi_get_error_string(ftdi);
+      ftdi_free(ftdi);
+      ftdi=nullptr;
+      throw std::runtime_error(std::string("Could not select channel of ") + dev + std::string(": ") + error);
+    }
+  }
+
+  if(ftdi_usb_open_bus_addr(ftdi, usb.bus, usb.address) < 0) {
+    std::string error = ftdi_get_error_string(ftdi);
+    ftdi_free(ftdi);
+    ftdi=nullptr;
+    throw std::runtime_error(std::string("Could not open USB Device ") + usb.busPath + std::string(": ") + error);
+  }
+  configure();
 }
 
 void FTDILinux::open(const int vid, const int pid){
@@ -44,7 +76,10 @@ void FTDILinux::open(const int vid, const int pid){
     ftdi=nullptr;
     throw std::runtime_error("Could not open USB Device");
   }
-  
+  configure();
+}
+
+void FTDILinux::configure(){
   if(ftdi_set_baudrate(ftdi, 115200) < 0){
     ftdi_usb_close(ftdi);
     ftdi_free(ftdi);
@@ -58,6 +93,12 @@ void FTDILinux::open(const int vid, const int pid){
     ftdi=nullptr;
     throw std::runtime_error("Could not set FTDI Line Properties to 8 Bit, 1 Stop bit and no parity");
   }
+
+  /* every ISP response is shorter than a USB packet and would otherwise
+   * wait for the latency timer */
+  if(ftdi_set_latency_timer(ftdi, LATENCY_TIMER_MS) < 0){
+    BOOST_LOG_TRIVIAL(warning) << "Could not set latency timer: " << ftdi_get_error_string(ftdi);
+  }
 }
 
 bool FTDILinux::is_open(){
@@ -65,13 +106,29 @@ bool FTDILinux::is_open(){
   return false;
 }
 
+void FTDILinux::setLineMapping(const UARTLinux::LineMapping& lines){
+  this->lines = lines;
+  if(lines.reset != UARTLinux::LineMapping::none || lines.isp != UARTLinux::LineMapping::none){
+    disableCBUSMode();
+  }
+}
+
 int FTDILinux::setCBUSPins(const FTDI::CBUSPins& pins){
+  if(lines.reset != UARTLinux::LineMapping::none || lines.isp != UARTLinux::LineMapping::none){
+    modem = UARTLinux::modemBits(lines, pins, modem);
+    return ftdi_setdtr_rts(ftdi, (modem & TIOCM_DTR) != 0, (modem & TIOCM_RTS) != 0);
+  }
   uint8_t bitmask = pins.outputCBUS0 | (pins.outputCBUS1 << 1) | (pins.outputCBUS2 << 2) | (pins.outputCBUS3 << 3) | (pins.modeCBUS0 << 4) | (pins.modeCBUS1 << 5) | (pins.modeCBUS2 << 6) | (pins.modeCBUS3 << 7);
   int ret = ftdi_set_bitmode(ftdi, bitmask, BITMODE_CBUS);
   return ret;
 }
 
 int FTDILinux::disableCBUSMode(){
+  if(lines.reset != UARTLinux::LineMapping::none || lines.isp != UARTLinux::LineMapping::none){
+    /* all pins inputs: reset and ISP select released */
+    FTDI::CBUSPins pins = {};
+    return setCBUSPins(pins);
+  }
   return ftdi_disable_bitbang(ftdi); 
 }
 
@@ -88,9 +145,12 @@ std::vector<uint8_t> FTDILinux::readData(){
   std::array<uint8_t, 100> buf{0};
   std::vector<uint8_t> data;
   int ret = 0;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(readTimeout);
   do{
     ret = ftdi_read_data(ftdi, buf.data(), buf.size());
-
+    if(ret == 0 && readTimeout != 0 && std::chrono::steady_clock::now() >= deadline){
+      return data;
+    }
   }while(ret == 0);
   if(ret > 0){
     data.resize(ret);
@@ -100,8 +160,27 @@ std::vector<uint8_t> FTDILinux::readData(){
   return data;
 }
 
+int FTDILinux::setReadTimeout(unsigned int milliseconds){
+  readTimeout = milliseconds;
+  return 0;
+}
+
+void FTDILinux::flushInput(){
+  ftdi_tciflush(ftdi);
+}
+
+std::chrono::microseconds FTDILinux::latency() const{
+  return std::chrono::milliseconds(LATENCY_TIMER_MS);
+}
+
 int FTDILinux::setBaudrate(uint32_t speed)
 {
-  //TODO
-  return -1;
+  /* fails for rates the divisors of the chip miss by more than 3 % */
+  if(ftdi_set_baudrate(ftdi, speed) < 0){
+    BOOST_LOG_TRIVIAL(error) << "Could not set baudrate " << speed << ": " << ftdi_get_error_string(ftdi);
+    return -1;
+  }
+  /* like tcflush on a UART, bytes received at the old speed are garbage */
+  ftdi_tciflush(ftdi);
+  return 0;
 }
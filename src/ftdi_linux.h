@@ -10,6 +10,7 @@
 #define _FTDI_HPP_
 
 #include "ftdi.hpp"
+#include "uart_linux.h"
 
 #include <libftdi1/ftdi.h> // libftdi header
 #include <memory>
@@ -30,9 +31,25 @@ public:
 
   int writeData(std::vector<uint8_t> data);
   std::vector<uint8_t> readData();
+  int setReadTimeout(unsigned int milliseconds);
   int setBaudrate(uint32_t speed);
+  void flushInput();
+  std::chrono::microseconds latency() const;
+  /* drive reset and ISP select from the DTR/RTS outputs of the channel
+   * instead of the CBUS pins. FT2232H/FT4232H have no CBUS bit-bang, and
+   * bit-bang on the data pins would take the UART away */
+  void setLineMapping(const UARTLinux::LineMapping& lines);
+
+  /* the chip sends short reads after this time instead of the default 16 ms */
+  static const unsigned char LATENCY_TIMER_MS=1;
 
 private:
+  void configure();
+
   struct ftdi_context * ftdi = nullptr;
+  unsigned int readTimeout = 0;
+  UARTLinux::LineMapping lines;
+  /* TIOCM_DTR/TIOCM_RTS while lines are mapped */
+  int modem = 0;
 };
 #endif /* _FTDI_HPP_ */
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "image_cache.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <boost/log/trivial.hpp>
+
+bool ImageCache::Stamp::operator==(const Stamp& other) const{
+  return device == other.device && inode == other.inode && size == other.size && mtime == other.mtime;
+}
+
+ImageCache::Stamp ImageCache::stamp(const std::string& path){
+  struct stat st;
+  if(stat(path.c_str(), &st) < 0){
+    throw std::runtime_error(std::string("Could not open ") + path + std::string(": ") + strerror(errno));
+  }
+  return Stamp{st.st_dev, st.st_ino, st.st_size, st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec};
+}
+
+ImageCache::Entry& ImageCache::entry(const std::string& path, std::size_t capacity, const std::string& format){
+  auto current = stamp(path);
+  auto& e = entries[std::make_tuple(path, capacity, format)];
+  if(!e.image || !(e.stamp == current)){
+    BOOST_LOG_TRIVIAL(info) << "Load " << path;
+    if(format.empty()){
+      e.image = std::make_shared<FirmwareImage>(path, capacity);
+    }else{
+      e.image = std::make_shared<FirmwareImage>(path, capacity, FirmwareImage::stringToFormat(format));
+    }
+    e.frames.reset();
+    e.stamp = current;
+  }else{
+    BOOST_LOG_TRIVIAL(info) << "Use cached " << path;
+  }
+  return e;
+}
+
+std::shared_ptr<const FirmwareImage> ImageCache::image(const std::string& path, std::size_t capacity, const std::string& format){
+  std::lock_guard<std::mutex> lock(mutex);
+  return entry(path, capacity, format).image;
+}
+
+std::shared_ptr<const FrameStream> ImageCache::frames(const std::string& path, std::size_t capacity, const std::string& format){
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& e = entry(path, capacity, format);
+  if(!e.frames){
+    e.frames = FrameStream::encode(*e.image);
+  }
+  return e.frames;
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _IMAGE_CACHE_H_
+#define _IMAGE_CACHE_H_
+
+#include "firmware_image.h"
+#include "frame_stream.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <sys/types.h>
+
+/* Keeps loaded and encoded firmware images between jobs. An entry is
+ * reloaded when the file on disk was replaced or modified. */
+class ImageCache
+{
+public:
+  /* format is a --format string, empty to detect it from the file */
+  std::shared_ptr<const FirmwareImage> image(const std::string& path, std::size_t capacity, const std::string& format="");
+  /* the image encoded into write frames, see FrameStream::encode */
+  std::shared_ptr<const FrameStream> frames(const std::string& path, std::size_t capacity, const std::string& format="");
+
+private:
+  struct Stamp{
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    long long mtime;
+    bool operator==(const Stamp& other) const;
+  };
+  struct Entry{
+    Stamp stamp;
+    std::shared_ptr<const FirmwareImage> image;
+    std::shared_ptr<const FrameStream> frames;
+  };
+
+  static Stamp stamp(const std::string& path);
+  Entry& entry(const std::string& path, std::size_t capacity, const std::string& format);
+
+  std::mutex mutex;
+  std::map<std::tuple<std::string, std::size_t, std::string>, Entry> entries;
+};
+
+#endif /* _IMAGE_CACHE_H_ */
@@ -0,0 +1,253 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "image_parser.h"
+
+#include <elf.h>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+static int hexNibble(uint8_t c){
+  if(c >= '0' && c <= '9') return c - '0';
+  if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+/* decode a line of hex digit pairs, returns false on odd length or bad digits */
+static bool decodeHexBytes(const uint8_t* begin, const uint8_t* end, std::vector<uint8_t>& out){
+  if((end - begin) % 2 != 0){
+    return false;
+  }
+  out.clear();
+  out.reserve((end - begin) / 2);
+  for(auto p = begin; p != end; p += 2){
+    int hi = hexNibble(p[0]);
+    int lo = hexNibble(p[1]);
+    if(hi < 0 || lo < 0){
+      return false;
+    }
+    out.push_back((hi << 4) | lo);
+  }
+  return true;
+}
+
+/* calls fn(line_begin, line_end, line_number) for every non-empty line */
+template <typename Fn>
+static void forEachLine(const uint8_t* data, std::size_t size, Fn fn){
+  const uint8_t* end = data + size;
+  const uint8_t* line = data;
+  unsigned int number = 1;
+  while(line < end){
+    const uint8_t* eol = static_cast<const uint8_t*>(memchr(line, '\n', end - line));
+    if(eol == nullptr){
+      eol = end;
+    }
+    const uint8_t* last = eol;
+    while(last > line && (last[-1] == '\r' || last[-1] == ' ' || last[-1] == '\t')){
+      last--;
+    }
+    if(last > line){
+      if(!fn(line, last, number)){
+        return;
+      }
+    }
+    line = eol + 1;
+    number++;
+  }
+}
+
+static std::runtime_error parseError(const char* format, unsigned int line, const char* what){
+  return std::runtime_error(std::string(format) + std::string(" line ") + std::to_string(line) + std::string(": ") + what);
+}
+
+void ImageParser::insert(SegmentMap& map, uint32_t address, const uint8_t* data, std::size_t size){
+  if(size == 0){
+    return;
+  }
+  if(static_cast<uint64_t>(address) + size > 0x100000000ull){
+    throw std::runtime_error("Data exceeds 32 bit address space");
+  }
+  auto next = map.upper_bound(address);
+  if(next != map.end() && next->first < address + size){
+    throw std::runtime_error(std::string("Overlapping data at address ") + std::to_string(next->first));
+  }
+
+  SegmentMap::iterator seg = map.end();
+  if(next != map.begin()){
+    auto prev = std::prev(next);
+    uint64_t prev_end = static_cast<uint64_t>(prev->first) + prev->second.size();
+    if(prev_end > address){
+      throw std::runtime_error(std::string("Overlapping data at address ") + std::to_string(address));
+    }
+    if(prev_end == address){
+      seg = prev;
+    }
+  }
+  if(seg == map.end()){
+    seg = map.emplace(address, std::vector<uint8_t>()).first;
+  }
+  seg->second.insert(seg->second.end(), data, data + size);
+
+  /* the new data may close the gap to the following segment */
+  if(next != map.end() && next->first == address + size){
+    seg->second.insert(seg->second.end(), next->second.begin(), next->second.end());
+    map.erase(next);
+  }
+}
+
+ImageParser::SegmentMap ImageParser::parseIntelHex(const uint8_t* data, std::size_t size){
+  enum RecordType : uint8_t{
+    Data = 0x00,
+    EndOfFile = 0x01,
+    ExtendedSegmentAddress = 0x02,
+    StartSegmentAddress = 0x03,
+    ExtendedLinearAddress = 0x04,
+    StartLinearAddress = 0x05
+  };
+
+  SegmentMap map;
+  uint32_t base = 0;
+  bool eof = false;
+  std::vector<uint8_t> record;
+  forEachLine(data, size, [&](const uint8_t* begin, const uint8_t* end, unsigned int line){
+    if(*begin != ':' || !decodeHexBytes(begin + 1, end, record) || record.size() < 5){
+      throw parseError("Intel HEX", line, "malformed record");
+    }
+    if(record.size() != static_cast<std::size_t>(record[0]) + 5){
+      throw parseError("Intel HEX", line, "record length mismatch");
+    }
+    uint8_t sum = 0;
+    for(auto b : record){
+      sum += b;
+    }
+    if(sum != 0){
+      throw parseError("Intel HEX", line, "checksum mismatch");
+    }
+
+    uint16_t offset = (record[1] << 8) | record[2];
+    const uint8_t* payload = record.data() + 4;
+    if((record[3] == RecordType::ExtendedSegmentAddress || record[3] == RecordType::ExtendedLinearAddress) && record[0] != 2){
+      throw parseError("Intel HEX", line, "bad address record length");
+    }
+    switch(record[3]){
+      case RecordType::Data:{
+        insert(map, base + offset, payload, record[0]);
+        break;
+      }
+      case RecordType::EndOfFile:{
+        eof = true;
+        return false;
+      }
+      case RecordType::ExtendedSegmentAddress:{
+        base = ((payload[0] << 8) | payload[1]) << 4;
+        break;
+      }
+      case RecordType::ExtendedLinearAddress:{
+        base = ((payload[0] << 8) | payload[1]) << 16;
+        break;
+      }
+      case RecordType::StartSegmentAddress:
+      case RecordType::StartLinearAddress:{
+        break;
+      }
+      default:{
+        throw parseError("Intel HEX", line, "unknown record type");
+      }
+    }
+    return true;
+  });
+
+  if(!eof){
+    throw std::runtime_error("Intel HEX file has no end of file record");
+  }
+  return map;
+}
+
+ImageParser::SegmentMap ImageParser::parseSRecord(const uint8_t* data, std::size_t size){
+  SegmentMap map;
+  std::vector<uint8_t> record;
+  forEachLine(data, size, [&](const uint8_t* begin, const uint8_t* end, unsigned int line){
+    if(end - begin < 4 || begin[0] != 'S' || !decodeHexBytes(begin + 2, end, record) || record.empty()){
+      throw parseError("S-record", line, "malformed record");
+    }
+    if(record.size() != static_cast<std::size_t>(record[0]) + 1){
+      throw parseError("S-record", line, "record length mismatch");
+    }
+    uint8_t sum = 0;
+    for(auto b : record){
+      sum += b;
+    }
+    if(sum != 0xFF){
+      throw parseError("S-record", line, "checksum mismatch");
+    }
+
+    std::size_t address_size = 0;
+    switch(begin[1]){
+      case '1': address_size = 2; break;
+      case '2': address_size = 3; break;
+      case '3': address_size = 4; break;
+      case '0': /* header */
+      case '5': /* record counts */
+      case '6':
+        return true;
+      case '7': /* termination with start address */
+      case '8':
+      case '9':
+        return false;
+      default:
+        throw parseError("S-record", line, "unknown record type");
+    }
+    if(record.size() < address_size + 2){
+      throw parseError("S-record", line, "record too short");
+    }
+
+    uint32_t address = 0;
+    for(std::size_t i=0;i<address_size;i++){
+      address = (address << 8) | record[1 + i];
+    }
+    insert(map, address, record.data() + 1 + address_size, record.size() - address_size - 2);
+    return true;
+  });
+
+  return map;
+}
+
+std::vector<ImageParser::ElfSegment> ImageParser::parseElf(const uint8_t* data, std::size_t size){
+  Elf32_Ehdr ehdr;
+  if(size < sizeof(ehdr)){
+    throw std::runtime_error("ELF file too short");
+  }
+  memcpy(&ehdr, data, sizeof(ehdr));
+  if(memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0){
+    throw std::runtime_error("Not an ELF file");
+  }
+  if(ehdr.e_ident[EI_CLASS] != ELFCLASS32 || ehdr.e_ident[EI_DATA] != ELFDATA2LSB){
+    throw std::runtime_error("Only 32 bit little endian ELF files are supported");
+  }
+  if(ehdr.e_phentsize != sizeof(Elf32_Phdr) ||
+     static_cast<uint64_t>(ehdr.e_phoff) + static_cast<uint64_t>(ehdr.e_phnum) * sizeof(Elf32_Phdr) > size){
+    throw std::runtime_error("ELF program header table out of bounds");
+  }
+
+  std::vector<ElfSegment> segments;
+  for(unsigned int i=0;i<ehdr.e_phnum;i++){
+    Elf32_Phdr phdr;
+    memcpy(&phdr, data + ehdr.e_phoff + i * sizeof(Elf32_Phdr), sizeof(phdr));
+    if(phdr.p_type != PT_LOAD || phdr.p_filesz == 0){
+      continue;
+    }
+    if(static_cast<uint64_t>(phdr.p_offset) + phdr.p_filesz > size){
+      throw std::runtime_error(std::string("ELF segment ") + std::to_string(i) + std::string(" out of bounds"));
+    }
+    /* program the load address, .data initializers live at p_paddr */
+    segments.push_back(ElfSegment{phdr.p_paddr, phdr.p_offset, phdr.p_filesz});
+  }
+  return segments;
+}
@@ -0,0 +1,34 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _IMAGE_PARSER_H_
+#define _IMAGE_PARSER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace ImageParser{
+  /* contiguous address ranges keyed by their start address */
+  using SegmentMap = std::map<uint32_t, std::vector<uint8_t>>;
+
+  struct ElfSegment{
+    uint32_t address;
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  void insert(SegmentMap& map, uint32_t address, const uint8_t* data, std::size_t size);
+
+  SegmentMap parseIntelHex(const uint8_t* data, std::size_t size);
+  SegmentMap parseSRecord(const uint8_t* data, std::size_t size);
+  std::vector<ElfSegment> parseElf(const uint8_t* data, std::size_t size);
+}
+
+#endif /* _IMAGE_PARSER_H_ */
@@ -0,0 +1,477 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "job.h"
+#include "application.h"
+#include "ftdi_linux.h"
+#include "uart_linux.h"
+#include "tcp_serial.h"
+#include "k32w061.h"
+#include "usb_enumerator.h"
+#include "port_state.h"
+#include "device_profiles.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+#include <boost/log/trivial.hpp>
+
+std::unique_ptr<FTDI::Interface> Job::open(const std::string& interface) const{
+  std::unique_ptr<FTDI::Interface> transport;
+  if(TcpSerial::isRemote(interface)){
+    BOOST_LOG_TRIVIAL(info) <<  "Open remote port " << interface;
+    auto remote = new TcpSerial();
+    transport.reset(remote);
+    if(responseTimeout.count() != 0){
+      remote->setTimeout(responseTimeout);
+    }
+    remote->setCancel(cancel);
+    remote->open(interface);
+    remote->setLineMapping(lines);
+  }else if(!useFtdi){
+    BOOST_LOG_TRIVIAL(info) <<  "Open UART " << interface;
+    auto uart = new UARTLinux();
+    transport.reset(uart);
+    uart->open(UsbEnumerator::system().ttyOf(interface));
+    uart->setLineMapping(lines);
+    if(ioThread){
+      auto settings = scheduling;
+      uart->startIoThread([interface, settings]{
+        if(!settings.empty()){
+          Scheduling::apply(settings, interface);
+        }
+      });
+    }
+  }else{
+    BOOST_LOG_TRIVIAL(info) <<  "Open FTDI Device " << interface;
+    /* a reopen finds the tty detached by the first open */
+    auto usb = UsbEnumerator::system().selectorOf(interface);
+    bool mapped = lines.reset != UARTLinux::LineMapping::none || lines.isp != UARTLinux::LineMapping::none;
+    if(!mapped && UsbEnumerator::system().findUsbDevice(usb).interfaces > 1){
+      throw std::runtime_error(interface + std::string(" is a multi-channel FTDI part without CBUS pins, map reset and ISP select with --lines"));
+    }
+    auto ftdi = new FTDILinux();
+    transport.reset(ftdi);
+    ftdi->open(usb);
+    ftdi->setLineMapping(lines);
+  }
+  return transport;
+}
+
+/* ISP entry times measured by this process per adapter, used without a profile file */
+static std::mutex readyTimesMutex;
+static std::map<std::string, std::chrono::milliseconds> readyTimes;
+
+/* one early answer, e.g. of a board that was still in ISP mode, only moves
+ * the estimate by a quarter of the difference */
+static std::chrono::milliseconds smoothReady(std::chrono::milliseconds estimate, std::chrono::milliseconds measured){
+  return estimate.count() == 0 ? measured : (estimate * 3 + measured) / 4;
+}
+
+std::string Job::adapterId(const std::string& interface){
+  if(TcpSerial::isRemote(interface)){
+    return interface;
+  }
+  UsbEnumerator::UsbDevice usb;
+  try{
+    usb = UsbEnumerator::system().findUsbDevice(UsbEnumerator::system().selectorOf(interface));
+  }catch(const std::exception&){
+    return "";
+  }
+  /* channels of one FT2232H/FT4232H share the serial number */
+  auto id = usb.serial.empty() ? usb.busPath : usb.serial;
+  if(!id.empty() && usb.channel != 0){
+    id += std::string(":") + char('A' + usb.channel - 1);
+  }
+  return id;
+}
+
+void Job::enterISPMode(Application& app, const std::string& adapter, std::chrono::milliseconds learnedReady) const{
+  auto entry = timing;
+  auto ready = learnedReady;
+  bool measured = profilePath.empty() && !adapter.empty();
+  if(measured){
+    std::lock_guard<std::mutex> lock(readyTimesMutex);
+    auto known = readyTimes.find(adapter);
+    if(known != readyTimes.end()){
+      ready = known->second;
+    }
+  }
+  if(ready.count() != 0){
+    entry.firstProbe = std::max(entry.firstProbe, ready * 3 / 4);
+  }
+  app.setIspTiming(entry);
+
+  BOOST_LOG_TRIVIAL(info) <<  "Enable ISP Mode";
+  app.enableISPMode();
+  BOOST_LOG_TRIVIAL(info) <<  "ISP Mode Enabled";
+  if(measured){
+    std::lock_guard<std::mutex> lock(readyTimesMutex);
+    auto& known = readyTimes[adapter];
+    known = smoothReady(known, app.ispReadyTime());
+  }
+}
+
+void Job::run(const std::string& interface) const{
+  auto transport = open(interface);
+  run(*transport, interface);
+}
+
+uint32_t Job::run(FTDI::Interface& transport, const std::string& interface, uint32_t warmSpeed) const{
+  if(speed != 0 && !autoSpeed && boost::algorithm::starts_with(interface, "tcp://")){
+    throw std::runtime_error(interface + std::string(" can not change the baudrate of the remote port, use rfc2217:// or drop --speed"));
+  }
+  if(!scheduling.empty()){
+    Scheduling::apply(scheduling, interface);
+  }
+  auto adapter = adapterId(interface);
+  if(statePath.empty()){
+    return execute(transport, adapter, warmSpeed);
+  }
+
+  PortState state(statePath);
+  PortState::Entry entry;
+  if(warmSpeed == 0 && state.lookup(interface, entry) && entry.unlocked){
+    warmSpeed = entry.speed;
+  }
+  /* until the job finished the bootloader state is unknown */
+  state.forget(interface);
+  auto left = execute(transport, adapter, warmSpeed);
+  if(left != 0){
+    state.store(interface, left, true);
+  }
+  return left;
+}
+
+uint32_t Job::execute(FTDI::Interface& transport, const std::string& adapter, uint32_t warmSpeed) const{
+  auto start = std::chrono::steady_clock::now();
+  K32W061 mcu(transport);
+  Application app(mcu, transport);
+  app.setProgress(progress);
+  app.setCancel(cancel);
+  app.setResponseTimeout(responseTimeout);
+  mcu.setWriteWindow(writeWindow);
+  app.setIspTiming(timing);
+  uint32_t current = K32W061::ISP_BAUDRATE;
+
+  /* a broken profile file costs the shortcuts, not the job */
+  DeviceProfiles profiles(profilePath);
+  DeviceProfiles::Profile profile;
+  bool learned = false;
+  bool profiled = !profilePath.empty() && !adapter.empty();
+  if(profiled){
+    try{
+      learned = profiles.lookup(adapter, profile);
+    }catch(const std::exception& e){
+      BOOST_LOG_TRIVIAL(warning) << e.what();
+    }
+  }
+
+  bool warm = warmSpeed != 0 && app.probeISPMode(warmSpeed);
+  if(warm){
+    BOOST_LOG_TRIVIAL(info) <<  "Continue ISP session at " << warmSpeed << " baud";
+    current = warmSpeed;
+  }else{
+    enterISPMode(app, adapter, learned ? profile.ispReady : std::chrono::milliseconds(0));
+  }
+
+  /* the baudrate and erase time are only valid for the same chip */
+  DeviceProfiles::Profile chip;
+  if(profiled){
+    auto info = mcu.getDeviceInfo();
+    chip.chipId = info.chipId;
+    chip.version = info.version;
+    try{
+      learned = profiles.lookup(adapter, info.chipId, info.version, profile);
+    }catch(const std::exception& e){
+      BOOST_LOG_TRIVIAL(warning) << e.what();
+      learned = false;
+    }
+    if(learned){
+      BOOST_LOG_TRIVIAL(info) << "Profile of " << adapter << ": " << profile.speed << " baud, ISP ready after " << profile.ispReady.count() << " ms";
+    }
+  }
+  /* set once the session runs at the learned baudrate, a failure from then on discards it */
+  bool learnedSpeed = false;
+  uint32_t negotiated = 0;
+  /* the pending frames are awaited once the first write or verify needs them */
+  bool fieldsChecked = false;
+  auto checkFieldsOnce = [this, &fieldsChecked](){
+    if(!fieldsChecked){
+      checkFields(stream ? nullptr : firmwareFrames().get());
+      fieldsChecked = true;
+    }
+  };
+
+  if(!patches.empty()){
+    BOOST_LOG_TRIVIAL(info) << "Patch " << patches.fields().size() << " field(s) while flashing";
+    app.setPatches(patches);
+  }
+
+  try{
+    for(auto op : order){
+      if(cancel && *cancel){
+        throw Application::Cancelled();
+      }
+      switch(op){
+        case Operation::deviceInfo:
+          if(deviceInfo){
+            BOOST_LOG_TRIVIAL(info) << "Read Device Info";
+            app.deviceInfo();
+          }
+          break;
+        case Operation::speed:
+          if(autoSpeed){
+            BOOST_LOG_TRIVIAL(info) << "Negotiate baudrate";
+            auto learnedRate = learned ? profile.speed : 0;
+            current = app.negotiateBaudrate(current, speed, learnedRate);
+            learnedSpeed = learnedRate != 0 && current == learnedRate;
+            negotiated = current;
+          }else if(speed != 0 && speed != current){
+            BOOST_LOG_TRIVIAL(info) << "Set baudrate to " << speed;
+            app.setBaudrate(speed);
+            current = speed;
+          }
+          break;
+        case Operation::program:
+          if(!session.empty()){
+            /* erasing does not need the frames, a session that writes checks them first */
+            if(std::any_of(session.steps().begin(), session.steps().end(), [](const Session::Step& s){ return !s.writes.empty(); })){
+              checkFieldsOnce();
+            }
+            BOOST_LOG_TRIVIAL(info) << "Program " << session.steps().size() << " memory region(s)";
+            app.program(session);
+            BOOST_LOG_TRIVIAL(info) << "Success";
+          }
+          checkFieldsOnce();
+          if(stream){
+            BOOST_LOG_TRIVIAL(info) << "Flash Firmware";
+            app.flashFirmware(*stream);
+            BOOST_LOG_TRIVIAL(info) << "Success";
+          }else if(auto fw = firmwareFrames()){
+            BOOST_LOG_TRIVIAL(info) << "Flash precompiled Firmware";
+            app.flashFirmware(*fw);
+            BOOST_LOG_TRIVIAL(info) << "Success";
+          }
+          break;
+        case Operation::verify:
+          if(verify){
+            checkFieldsOnce();
+            BOOST_LOG_TRIVIAL(info) << "Verify";
+            app.verify(session);
+            if(auto fw = firmwareFrames()){
+              app.verify(*fw);
+            }
+            BOOST_LOG_TRIVIAL(info) << "Success";
+          }
+          break;
+        case Operation::dump:
+          for(const auto& d : dumps){
+            BOOST_LOG_TRIVIAL(info) << "Dump " << d.range.length << " bytes of " << Session::memoryToString(d.memory) << " to " << d.path;
+            app.dump(d.memory, d.range.address, d.range.length, d.path);
+          }
+          break;
+        case Operation::reset:
+          if(reset){
+            BOOST_LOG_TRIVIAL(info) << "Reset device";
+            app.reset();
+            current = 0;
+            BOOST_LOG_TRIVIAL(info) << "Success";
+          }
+          break;
+      }
+    }
+  }catch(const Application::Cancelled&){
+    throw;
+  }catch(...){
+    if(learnedSpeed){
+      BOOST_LOG_TRIVIAL(warning) << "Job failed at the learned baudrate, forget the profile of " << adapter;
+      try{
+        profiles.forget(adapter, chip.chipId, chip.version);
+      }catch(const std::exception& e){
+        BOOST_LOG_TRIVIAL(warning) << e.what();
+      }
+    }
+    throw;
+  }
+
+  if(profiled){
+    /* keep what this job did not measure */
+    chip.speed = negotiated != 0 ? negotiated : (learned ? profile.speed : 0);
+    if(warm){
+      chip.ispReady = learned ? profile.ispReady : std::chrono::milliseconds(0);
+    }else{
+      chip.ispReady = smoothReady(learned ? profile.ispReady : std::chrono::milliseconds(0), app.ispReadyTime());
+    }
+    chip.erasePerPage = app.erasePerPage().count() != 0 ? app.erasePerPage() : (learned ? profile.erasePerPage : std::chrono::microseconds(0));
+    try{
+      profiles.store(adapter, chip);
+    }catch(const std::exception& e){
+      BOOST_LOG_TRIVIAL(warning) << e.what();
+    }
+  }
+  if(metrics){
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    metrics(Metrics{seconds, warm ? 0.0 : std::chrono::duration<double>(app.ispReadyTime()).count(), warm, app.bytesTransferred(), current});
+  }
+  return current;
+}
+
+void Job::plan(Planner& planner) const{
+  planner.enterISPMode();
+  for(auto op : order){
+    switch(op){
+      case Operation::deviceInfo:
+        if(deviceInfo){
+          planner.deviceInfo();
+        }
+        break;
+      case Operation::speed:
+        /* also without --speed, so other baudrates can be compared */
+        if(autoSpeed){
+          planner.negotiateBaudrate();
+        }else{
+          planner.setBaudrate();
+        }
+        break;
+      case Operation::program:
+        planner.program(session);
+        if(stream){
+          planner.flashFirmware(*stream);
+        }else if(auto fw = firmwareFrames()){
+          planner.flashFirmware(*fw);
+        }
+        break;
+      case Operation::verify:
+        if(verify){
+          planner.verify(session);
+          if(auto fw = firmwareFrames()){
+            planner.verify(*fw);
+          }
+        }
+        break;
+      case Operation::dump:
+        for(const auto& d : dumps){
+          planner.dump(d.range.address, d.range.length);
+        }
+        break;
+      case Operation::reset:
+        if(reset){
+          planner.reset();
+        }
+        break;
+    }
+  }
+}
+
+Planner::Settings Job::planSettings(const std::string& interface) const{
+  Planner::Settings settings;
+  settings.resetPulse = timing.resetPulse;
+  settings.speed = speed != 0 ? speed : K32W061::ISP_BAUDRATE;
+  if(autoSpeed && speed == 0){
+    settings.speed = K32W061::baudrates().back();
+  }
+  settings.writeWindow = writeWindow != 0 ? writeWindow : 1;
+
+  auto adapter = profilePath.empty() ? std::string() : adapterId(interface);
+  DeviceProfiles::Profile profile;
+  try{
+    if(adapter.empty() || !DeviceProfiles(profilePath).lookup(adapter, profile)){
+      return settings;
+    }
+  }catch(const std::exception& e){
+    BOOST_LOG_TRIVIAL(warning) << e.what();
+    return settings;
+  }
+  BOOST_LOG_TRIVIAL(info) << "Plan with the profile of " << adapter;
+  if(profile.ispReady.count() != 0){
+    settings.ispReady = profile.ispReady;
+  }
+  if(profile.erasePerPage.count() != 0){
+    settings.erasePerPage = profile.erasePerPage;
+  }
+  if(autoSpeed && profile.speed != 0 && (speed == 0 || profile.speed <= speed)){
+    settings.speed = profile.speed;
+  }
+  return settings;
+}
+
+std::shared_ptr<const FrameStream> Job::firmwareFrames() const{
+  if(frames || !pendingFrames.valid()){
+    return frames;
+  }
+  /* the job may run on several threads, each waits on a copy of its own */
+  auto pending = pendingFrames;
+  if(pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+    BOOST_LOG_TRIVIAL(info) << "Wait for the firmware to be encoded";
+  }
+  return pending.get();
+}
+
+void Job::checkFields(const FrameStream* fw) const{
+  if(stream){
+    return;
+  }
+  for(const auto& field : patches.fields()){
+    if(!session.covers(MCU::MemoryID::flash, field.address, field.size) && !(fw && fw->covers(MCU::MemoryID::flash, field.address, field.size))){
+      throw std::runtime_error(std::string("Field ") + field.name + std::string(" is not inside the written flash images"));
+    }
+  }
+}
+
+std::vector<Job::Operation> Job::parseOrder(const std::string& str){
+  std::vector<std::string> names;
+  boost::split(names, str, [](char c){ return c == ','; });
+  std::vector<Operation> ops;
+  for(auto name : names){
+    boost::algorithm::trim(name);
+    bool found = false;
+    for(auto op : {Operation::deviceInfo, Operation::speed, Operation::program, Operation::verify, Operation::dump, Operation::reset}){
+      if(name == operationToString(op)){
+        if(std::find(ops.begin(), ops.end(), op) != ops.end()){
+          throw std::runtime_error(std::string("Operation ") + name + std::string(" listed twice"));
+        }
+        ops.push_back(op);
+        found = true;
+      }
+    }
+    if(!found){
+      throw std::runtime_error(std::string("Unknown operation \"") + name + std::string("\""));
+    }
+  }
+  return ops;
+}
+
+std::string Job::operationToString(Operation op){
+  switch(op){
+    case Operation::deviceInfo: return "device-info";
+    case Operation::speed: return "speed";
+    case Operation::program: return "program";
+    case Operation::verify: return "verify";
+    case Operation::dump: return "dump";
+    case Operation::reset: return "reset";
+  }
+  return "";
+}
+
+void Job::validate() const{
+  auto require = [this](bool configured, Operation op){
+    if(configured && std::find(order.begin(), order.end(), op) == order.end()){
+      throw std::runtime_error(operationToString(op) + std::string(" is requested but not part of the operation order"));
+    }
+  };
+  require(deviceInfo, Operation::deviceInfo);
+  require(speed != 0 || autoSpeed, Operation::speed);
+  require(!session.empty() || stream || frames || pendingFrames.valid(), Operation::program);
+  require(verify, Operation::verify);
+  require(!dumps.empty(), Operation::dump);
+  require(reset, Operation::reset);
+}
@@ -0,0 +1,137 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _JOB_H_
+#define _JOB_H_
+
+#include "session.h"
+#include "patch_set.h"
+#include "firmware_stream.h"
+#include "frame_stream.h"
+#include "application.h"
+#include "ftdi.hpp"
+#include "uart_linux.h"
+#include "scheduling.h"
+#include "planner.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Everything that is done to one device, from opening the interface to the
+ * final reset. The inputs are read-only, so the same Job can be run on
+ * several interfaces at once, except for a FirmwareStream which can only be
+ * consumed once. */
+struct Job{
+  enum class Operation{
+    deviceInfo,
+    speed,
+    program,
+    verify,
+    dump,
+    reset
+  };
+
+  /* reported by run once the job succeeded */
+  struct Metrics{
+    double seconds;
+    /* 0 if an open ISP session was continued */
+    double ispEntrySeconds;
+    bool warm;
+    /* bytes written, verified and dumped */
+    uint64_t bytes;
+    uint32_t speed;
+  };
+
+  struct Dump{
+    MCU::MemoryID memory;
+    Session::Range range;
+    std::string path;
+  };
+
+  bool useFtdi = true;
+  /* reset and ISP select wiring of UART adapters without CBUS pins */
+  UARTLinux::LineMapping lines;
+  Application::IspTiming timing;
+  /* deadline of every bootloader response, 0 derives it per request */
+  std::chrono::milliseconds responseTimeout{0};
+  /* write frames in flight before the first response is awaited, 0 derives it from the latency of the transport */
+  unsigned int writeWindow = 0;
+  /* applied to the thread that runs the job and to its I/O thread */
+  Scheduling::Settings scheduling;
+  /* UART only: exchange frames through a dedicated I/O thread, see UARTLinux::startIoThread */
+  bool ioThread = false;
+  /* state file to continue ISP sessions of earlier runs, see PortState */
+  std::string statePath;
+  /* file of the profiles learned by earlier runs, see DeviceProfiles. Empty disables them */
+  std::string profilePath;
+  bool deviceInfo = false;
+  uint32_t speed = 0;
+  /* negotiate the fastest stable baudrate, speed is its upper limit if not 0 */
+  bool autoSpeed = false;
+  bool verify = false;
+  bool reset = false;
+  Session session;
+  PatchSet patches;
+  std::shared_ptr<const FrameStream> frames;
+  /* frames still being encoded on a worker thread while the device enters
+   * ISP mode and erases, used if frames is not set */
+  std::shared_future<std::shared_ptr<const FrameStream>> pendingFrames;
+  std::shared_ptr<FirmwareStream> stream;
+  std::vector<Dump> dumps;
+  Application::Progress progress;
+  std::function<void(const Metrics&)> metrics;
+  /* the job stops with Application::Cancelled once *cancel is set */
+  const std::atomic<bool>* cancel = nullptr;
+  /* operations run in this order, each only if it has something to do */
+  std::vector<Operation> order{Operation::deviceInfo, Operation::speed, Operation::program, Operation::verify, Operation::dump, Operation::reset};
+
+  /* comma separated list: device-info, speed, program, verify, dump, reset */
+  static std::vector<Operation> parseOrder(const std::string& str);
+  static std::string operationToString(Operation op);
+  /* throws if a configured operation is missing from the order */
+  void validate() const;
+  /* frames, or the pending frames once they are encoded. Rethrows if encoding failed */
+  std::shared_ptr<const FrameStream> firmwareFrames() const;
+  /* throws if a patch field is outside the flash written by the session or
+   * fw. Streams are not checked, their length is known once they are sent */
+  void checkFields(const FrameStream* fw) const;
+
+  /* opens interface with the transport settings of the job. A remote port
+   * connects within responseTimeout and gives up once *cancel is set */
+  std::unique_ptr<FTDI::Interface> open(const std::string& interface) const;
+  void run(const std::string& interface) const;
+  /* runs the job on an already opened transport of interface. With
+   * warmSpeed, or an entry in statePath, the device may still be in ISP
+   * mode at that baudrate and entry is skipped if it answers. Returns the
+   * baudrate the ISP session is left at, 0 if the device was reset */
+  uint32_t run(FTDI::Interface& transport, const std::string& interface, uint32_t warmSpeed=0) const;
+  /* records what run would send, in the same order, see Planner */
+  void plan(Planner& planner) const;
+  /* settings the job would run with. With profilePath the learned ISP
+   * entry and erase times and baudrate of the adapter are used */
+  Planner::Settings planSettings(const std::string& interface) const;
+  /* USB serial number of the adapter behind interface, its bus path if it
+   * has none or the remote port itself. Empty if unknown */
+  static std::string adapterId(const std::string& interface);
+
+private:
+  /* the ISP entry time is learned per adapter, so later boards on it are
+   * probed only shortly before they are expected to be ready */
+  uint32_t execute(FTDI::Interface& transport, const std::string& adapter, uint32_t warmSpeed) const;
+  /* learnedReady is the entry time of the profile of the adapter. Without
+   * a profile file the times this process measured on the adapter are used */
+  void enterISPMode(Application& app, const std::string& adapter, std::chrono::milliseconds learnedReady) const;
+};
+
+#endif /* _JOB_H_ */
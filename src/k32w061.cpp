@@ -11,10 +11,17 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <boost/crc.hpp>
+#include <zlib.h>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/trivial.hpp>
 #include <math.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
 #include "ftdi.hpp"
 
 #define CRC_SIZE 4
@@ -31,6 +38,8 @@ enum FrameType : uint8_t{
   EraseMemoryResp = 0x43,
   CheckBlankMemoryReq = 0x44,
   CheckBlankMemoryResp = 0x45,
+  ReadMemoryReq = 0x46,
+  ReadMemoryResp = 0x47,
   WriteMemoryReq = 0x48,
   WriteMemoryResp = 0x49,
   CloseMemoryReq = 0x4A,
@@ -64,6 +73,16 @@ struct __attribute__((__packed__)) ResponseHeader{
   uint8_t status;
 };
 
+struct __attribute__((__packed__)) FlashMemoryHeader{
+  uint8_t handle;
+  uint8_t mode;
+  uint32_t address;
+  uint32_t length;
+};
+
+static_assert(sizeof(FrameHeader) + sizeof(FlashMemoryHeader) + CRC_SIZE == K32W061::WRITE_FRAME_OVERHEAD, "write frame layout changed");
+static_assert(sizeof(FrameHeader) + sizeof(FlashMemoryHeader) == K32W061::WRITE_FRAME_PAYLOAD_OFFSET, "write frame layout changed");
+
 static bool frameHasType(std::vector<uint8_t> frame, FrameType type){
   FrameHeader * header = reinterpret_cast<FrameHeader*>(frame.data());
   if(header->type != type){
@@ -85,6 +104,19 @@ static uint8_t responseType(std::vector<uint8_t> frame){
   return header->type;
 }
 
+const unsigned int K32W061::CHIP_ID_K32W061;
+const unsigned int K32W061::FLASH_SIZE;
+const unsigned int K32W061::FLASH_PAGE_SIZE;
+const unsigned int K32W061::ISP_BAUDRATE;
+const unsigned int K32W061::WRITE_FRAME_OVERHEAD;
+const unsigned int K32W061::WRITE_FRAME_PAYLOAD_OFFSET;
+const unsigned int K32W061::RESPONSE_MARGIN_MS;
+const unsigned int K32W061::ERASE_MS_PER_PAGE;
+const unsigned int K32W061::BLANK_CHECK_MS_PER_PAGE;
+const unsigned int K32W061::WRITE_FRAME_MS;
+const unsigned int K32W061::MAX_WRITE_WINDOW;
+const unsigned int K32W061::CANCEL_POLL_MS;
+
 K32W061::K32W061(FTDI::Interface &dev) : dev(dev){
 
 }
@@ -114,7 +146,7 @@ int K32W061::enableISPMode(const std::vector<uint8_t> key){
     return -1;
   }
 
-  auto data = dev.readData();
+  auto data = readResponse("EnableISPMode", timeoutFor(req.size() + 9));
   if(data.size() == 0){
     return -1;
   }
@@ -138,7 +170,7 @@ K32W061::DeviceInfo K32W061::getDeviceInfo(){
   }
 
   K32W061::DeviceInfo dev_info;
-  auto data = dev.readData();
+  auto data = readResponse("GetDeviceInfo", timeoutFor(req.size() + 17));
   if( data.size() == 0 ||
       !frameHasType(data, FrameType::GetDeviceInfoResp) ||
       extractCrc(data) != calculateCrc(data) ||
@@ -157,7 +189,7 @@ K32W061::DeviceInfo K32W061::getDeviceInfo(){
   return dev_info;
 }
 
-int K32W061::eraseMemory(uint8_t handle){
+int K32W061::eraseMemory(uint8_t handle, uint32_t address, uint32_t length){
   struct __attribute__((__packed__)) EraseMemoryHeader{
     uint8_t handle;
     uint8_t eraseMode;
@@ -169,9 +201,9 @@ int K32W061::eraseMemory(uint8_t handle){
   header->size = htons(sizeof(FrameHeader) + sizeof(EraseMemoryHeader) + CRC_SIZE);
   header->type = FrameType::EraseMemoryReq;
   auto erase_memory_header = reinterpret_cast<EraseMemoryHeader*>(req.data() + sizeof(FrameHeader));
-  erase_memory_header->address = 0x00;
+  erase_memory_header->address = address;
   erase_memory_header->handle = handle;
-  erase_memory_header->length = 0x9DE00;
+  erase_memory_header->length = length;
   erase_memory_header->eraseMode = 0x00;
 
   auto crc = calculateCrc(req);
@@ -182,7 +214,8 @@ int K32W061::eraseMemory(uint8_t handle){
     return -1;
   }
 
-  auto resp = dev.readData();
+  auto pages = (length + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+  auto resp = readResponse("EraseMemory", timeoutFor(req.size() + 9, std::chrono::milliseconds(pages * ERASE_MS_PER_PAGE)));
   if( resp.size() != (sizeof(FrameHeader) + CRC_SIZE + 1) ||
       !responseHasSuccessStatus(resp) || 
       !frameHasType(resp, FrameType::EraseMemoryResp) ||
@@ -224,17 +257,27 @@ int K32W061::setBaudrate(uint32_t speed){
     return -1;
   }
   
-  auto resp = dev.readData();
+  auto resp = readResponse("SetBaudRate", timeoutFor(req.size() + 9));
   if( resp.size() != (sizeof(FrameHeader) + CRC_SIZE + 1) ||
       !responseHasSuccessStatus(resp) || 
       !frameHasType(resp, FrameType::SetBaudRateResp) ||
       calculateCrc(resp) != extractCrc(resp)){
     return -1;
   }
-  dev.setBaudrate(speed);
+  /* the device switched, a transport left behind can not talk to it */
+  if(dev.setBaudrate(speed) != 0){
+    return -1;
+  }
+  this->speed = speed;
   return 0;
 }
 
+std::vector<uint32_t> K32W061::baudrates(){
+  /* the divisor of SetBaudRate is 1 MHz / speed, rates that round to the
+   * divisor of a faster one (921600) are left out */
+  return {ISP_BAUDRATE, 230400, 460800, 500000, 1000000};
+}
+
 int K32W061::getMemoryHandle(const K32W061::MemoryID id){
   struct __attribute__((__packed__)) OpenMemoryHeader{
     uint8_t memID;
@@ -253,7 +296,7 @@ int K32W061::getMemoryHandle(const K32W061::MemoryID id){
   insertCrc(req, crc);
   dev.writeData(req);
 
-  auto resp = dev.readData();
+  auto resp = readResponse("OpenMemoryForAccess", timeoutFor(req.size() + 10));
   if( resp.size() == 0 ||
       !responseHasSuccessStatus(resp) ||
       calculateCrc(resp) != extractCrc(resp) ||
@@ -269,7 +312,7 @@ int K32W061::getMemoryHandle(const K32W061::MemoryID id){
   return resp_data->handle;
 }
 
-void K32W061::insertCrc(std::vector<uint8_t>& data, unsigned long crc) const{
+void K32W061::insertCrc(std::vector<uint8_t>& data, unsigned long crc){
   crc = ntohl(crc);
 
   data[data.size()-CRC_SIZE + 0] = crc & 0xFF;
@@ -278,13 +321,13 @@ void K32W061::insertCrc(std::vector<uint8_t>& data, unsigned long crc) const{
   data[data.size()-CRC_SIZE + 3] = (crc & 0xFF000000) >> 24;
 }
 
-unsigned long K32W061::calculateCrc(const std::vector<uint8_t>& data) const{
+unsigned long K32W061::calculateCrc(const std::vector<uint8_t>& data){
   boost::crc_32_type result;
   result.process_bytes(data.data(), data.size() - CRC_SIZE);
   return result.checksum();
 }
 
-unsigned long K32W061::extractCrc(std::vector<uint8_t> data) const{
+unsigned long K32W061::extractCrc(std::vector<uint8_t> data){
   unsigned crc = 0;
   crc = data[data.size() - CRC_SIZE + 3];
   crc |= data[data.size() - CRC_SIZE + 2] << 8;
@@ -294,7 +337,102 @@ unsigned long K32W061::extractCrc(std::vector<uint8_t> data) const{
   return crc;
 }
 
-bool K32W061::memoryIsErased(uint8_t handle){
+std::vector<uint8_t> K32W061::readResponse(const char* request, std::chrono::milliseconds timeout){
+  /* the UART delivers the response in as many pieces as it likes, keep
+   * reading until the length announced in the frame header has arrived.
+   * The wait is split into slices so a cancel is noticed while waiting */
+  std::vector<uint8_t> resp;
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while(true){
+    if(cancel && *cancel){
+      throw Cancelled();
+    }
+    auto now = std::chrono::steady_clock::now();
+    if(now >= deadline){
+      throw TimeoutError(std::string("No ") + (resp.empty() ? "" : "complete ") + std::string("response to ") + request
+                         + std::string(" within ") + std::to_string(timeout.count()) + std::string(" ms"));
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1);
+    auto slice = std::min(left, std::chrono::milliseconds(CANCEL_POLL_MS));
+    dev.setReadTimeout(slice.count());
+    auto more = dev.readData();
+    if(more.empty()){
+      if(std::chrono::steady_clock::now() < now + slice){
+        /* the transport gave up before its timeout, it is not going to deliver */
+        return resp;
+      }
+      continue;
+    }
+    resp.insert(std::end(resp), std::begin(more), std::end(more));
+    if(resp.size() >= sizeof(FrameHeader)){
+      const FrameHeader * header = reinterpret_cast<const FrameHeader*>(resp.data());
+      if(resp.size() >= ntohs(header->size)){
+        return resp;
+      }
+    }
+  }
+}
+
+std::chrono::milliseconds K32W061::responseTimeout(uint32_t speed, std::size_t bytes, std::chrono::milliseconds work){
+  /* 10 bits per byte on the wire: start, 8 data, stop */
+  auto transfer = (uint64_t(bytes) * 10 * 1000 + speed - 1) / speed;
+  return std::chrono::milliseconds(transfer + RESPONSE_MARGIN_MS) + work;
+}
+
+std::chrono::milliseconds K32W061::timeoutFor(std::size_t bytes, std::chrono::milliseconds work) const{
+  if(fixedTimeout.count() != 0){
+    return fixedTimeout;
+  }
+  /* remote adapters answer a round trip later */
+  return responseTimeout(speed, bytes, work) + std::chrono::duration_cast<std::chrono::milliseconds>(dev.latency() + std::chrono::microseconds(999));
+}
+
+void K32W061::setWriteWindow(unsigned int frames){
+  fixedWindow = std::min(frames, MAX_WRITE_WINDOW);
+}
+
+unsigned int K32W061::writeWindow(uint32_t speed, std::size_t frameBytes, std::chrono::microseconds latency){
+  auto frameUs = std::max<uint64_t>(1, uint64_t(frameBytes) * 10 * 1000000 / speed);
+  auto frames = (uint64_t(latency.count()) + frameUs - 1) / frameUs + 1;
+  return std::min<uint64_t>(frames, MAX_WRITE_WINDOW);
+}
+
+void K32W061::setResponseTimeout(std::chrono::milliseconds timeout){
+  fixedTimeout = timeout;
+}
+
+void K32W061::setCancel(const std::atomic<bool>* cancel){
+  this->cancel = cancel;
+}
+
+MCU::MemoryInfo K32W061::memoryInfo(const MemoryID id) const{
+  return memoryGeometry(id);
+}
+
+MCU::MemoryInfo K32W061::memoryGeometry(const MemoryID id){
+  /* as reported by the ROM bootloader in its memory table */
+  switch(id){
+    case MemoryID::flash:
+      return MemoryInfo{0x00000000, FLASH_SIZE, FLASH_PAGE_SIZE, true};
+    case MemoryID::psect:
+      return MemoryInfo{0x00000000, 0x1E0, 0x10, true};
+    case MemoryID::pflash:
+      return MemoryInfo{0x00000000, 0x1E0, 0x10, true};
+    case MemoryID::config:
+      return MemoryInfo{0x0009FC00, 0x200, 0x200, true};
+    case MemoryID::efuse:
+      return MemoryInfo{0x00000000, 0x80, 0x02, true};
+    case MemoryID::rom:
+      return MemoryInfo{0x03000000, 0x20000, 0x01, false};
+    case MemoryID::ram0:
+      return MemoryInfo{0x04000000, 0x16000, 0x01, true};
+    case MemoryID::ram1:
+      return MemoryInfo{0x04020000, 0x10000, 0x01, true};
+  }
+  throw std::runtime_error(std::string("Unknown memory ") + std::to_string(id));
+}
+
+bool K32W061::memoryIsErased(uint8_t handle, uint32_t address, uint32_t length){
   struct __attribute__((__packed__)) checkBlankMemoryHeader{
     uint8_t handle;
     uint8_t mode;
@@ -306,8 +444,8 @@ bool K32W061::memoryIsErased(uint8_t handle){
   checkBlankMemoryHeader * blank_memory_header = reinterpret_cast<checkBlankMemoryHeader*>(req.data() + sizeof(FrameHeader));
   frame_header->type = FrameType::CheckBlankMemoryReq;
   frame_header->size = htons(req.size());
-  blank_memory_header->address = 0x00;
-  blank_memory_header->length = 0x9DE00;
+  blank_memory_header->address = address;
+  blank_memory_header->length = length;
   blank_memory_header->handle = handle;
   blank_memory_header->mode = 0x00;
 
@@ -319,7 +457,8 @@ bool K32W061::memoryIsErased(uint8_t handle){
     return false;
   }
 
-  auto resp = dev.readData();
+  auto pages = (length + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+  auto resp = readResponse("CheckBlankMemory", timeoutFor(req.size() + 9, std::chrono::milliseconds(pages * BLANK_CHECK_MS_PER_PAGE)));
   if( resp.size() == 0 ||
       !frameHasType(resp, FrameType::CheckBlankMemoryResp) ||
       extractCrc(resp) != calculateCrc(resp) ||
@@ -329,66 +468,191 @@ bool K32W061::memoryIsErased(uint8_t handle){
   return true;
 }
 
-int K32W061::flashMemory(uint8_t handle, const std::vector<uint8_t>& data){
-  struct __attribute__((__packed__)) FlashMemoryHeader{
-    uint8_t handle;
-    uint8_t mode;
-    uint32_t address;
-    uint32_t length;
-  }; 
-  auto size = data.size();
-  size_t chunk_size = 512;
-  if(data.size() < chunk_size){
-    chunk_size = data.size();
+std::size_t K32W061::frameChunkSize(uint32_t address, std::size_t remaining){
+  /* split at flash page boundaries so no frame spans two pages */
+  return std::min<std::size_t>(remaining, FLASH_PAGE_SIZE - (address % FLASH_PAGE_SIZE));
+}
+
+std::vector<uint8_t> K32W061::writeMemoryFrame(uint8_t handle, uint32_t address, const uint8_t* data, std::size_t size){
+  std::vector<uint8_t> req(sizeof(FrameHeader) + sizeof(FlashMemoryHeader) + size + CRC_SIZE);
+  FrameHeader * header = reinterpret_cast<FrameHeader*>(req.data());
+  FlashMemoryHeader * flash_memory_header = reinterpret_cast<FlashMemoryHeader*>(req.data() + sizeof(FrameHeader));
+  header->size = htons(req.size());
+  header->type = FrameType::WriteMemoryReq;
+  flash_memory_header->handle = handle;
+  flash_memory_header->address = address;
+  flash_memory_header->length = size;
+  flash_memory_header->mode = 0x00;
+  std::copy(data, data+size, req.begin() + sizeof(FrameHeader) + sizeof(FlashMemoryHeader));
+
+  auto crc = calculateCrc(req);
+  insertCrc(req, crc);
+  return req;
+}
+
+bool K32W061::isWriteMemoryFrame(const uint8_t* frame, std::size_t size, uint32_t address){
+  if(size < WRITE_FRAME_OVERHEAD){
+    return false;
   }
-  std::vector<uint8_t> req(sizeof(FrameHeader) + sizeof(FlashMemoryHeader) + chunk_size + CRC_SIZE);
-  
-  uint32_t offset = 0;
-  do{
+  FrameHeader header;
+  FlashMemoryHeader flash_memory_header;
+  memcpy(&header, frame, sizeof(header));
+  memcpy(&flash_memory_header, frame + sizeof(FrameHeader), sizeof(flash_memory_header));
+  return ntohs(header.size) == size && header.type == FrameType::WriteMemoryReq &&
+         flash_memory_header.address == address && flash_memory_header.length == size - WRITE_FRAME_OVERHEAD;
+}
+
+void K32W061::patchWriteFrame(std::vector<uint8_t>& frame, std::size_t offset, const uint8_t* data, std::size_t size){
+  if(sizeof(FrameHeader) + sizeof(FlashMemoryHeader) + offset + size + CRC_SIZE > frame.size()){
+    throw std::out_of_range("Patch exceeds write frame payload");
+  }
+  patchFrame(frame, WRITE_FRAME_PAYLOAD_OFFSET + offset, data, size);
+}
+
+void K32W061::setWriteFrameHandle(std::vector<uint8_t>& frame, uint8_t handle){
+  if(frame.size() < WRITE_FRAME_OVERHEAD){
+    throw std::out_of_range("Write frame is too short");
+  }
+  patchFrame(frame, sizeof(FrameHeader) + offsetof(FlashMemoryHeader, handle), &handle, 1);
+}
+
+void K32W061::patchFrame(std::vector<uint8_t>& frame, std::size_t position, const uint8_t* data, std::size_t size){
+  /* CRC32 is affine, so for a change d at the end of the message
+   * crc(m ^ d) = crc(m) ^ crc(d) ^ crc(0...0). Bytes following the change
+   * only shift the difference, which zlib does in O(log n) without
+   * touching the rest of the frame. */
+  std::vector<uint8_t> diff(size);
+  for(std::size_t i=0;i<size;i++){
+    diff[i] = frame[position + i] ^ data[i];
+  }
+  std::vector<uint8_t> zeros(size, 0);
+  uLong delta = crc32(0, diff.data(), diff.size()) ^ crc32(0, zeros.data(), zeros.size());
+  auto trailing = frame.size() - CRC_SIZE - position - size;
+  delta = crc32_combine(delta, 0, trailing);
+
+  std::copy(data, data + size, frame.begin() + position);
+  insertCrc(frame, extractCrc(frame) ^ delta);
+}
+
+int K32W061::sendFrames(const std::vector<Frame>& frames, const std::function<void(std::size_t index)>& acknowledged){
+  auto window = currentWindow();
+  std::size_t sent = 0;
+  std::size_t answered = 0;
+  while(answered < frames.size()){
+    if(sent < frames.size() && sent - answered < window){
+      if(writeFrame(frames[sent].data, frames[sent].size) != 0){
+        return -1;
+      }
+      sent++;
+      continue;
+    }
+    if(awaitWriteResponse(frames[answered].size) != 0){
+      return -1;
+    }
+    if(acknowledged){
+      acknowledged(answered);
+    }
+    answered++;
+  }
+  return 0;
+}
+
+int K32W061::writeFrame(const uint8_t* frame, std::size_t size){
+  auto ret = dev.writeData(std::vector<uint8_t>(frame, frame + size));
+  return ret == (signed)size ? 0 : -1;
+}
+
+int K32W061::awaitWriteResponse(std::size_t frameSize){
+  auto resp = readResponse("WriteMemory", timeoutFor(frameSize + 9, std::chrono::milliseconds(WRITE_FRAME_MS)));
+  if( resp.size() < 9 ||
+      extractCrc(resp) != calculateCrc(resp) ||
+      !responseHasSuccessStatus(resp) ||
+      responseType(resp) != FrameType::WriteMemoryResp){
+    return -1;
+  }
+  return 0;
+}
+
+unsigned int K32W061::currentWindow() const{
+  return fixedWindow != 0 ? fixedWindow : writeWindow(speed, FLASH_PAGE_SIZE + WRITE_FRAME_OVERHEAD, dev.latency());
+}
+
+int K32W061::flashMemory(uint8_t handle, uint32_t address, const uint8_t* data, std::size_t size){
+  auto window = currentWindow();
+  /* sizes of the frames sent whose responses are outstanding */
+  std::deque<std::size_t> inFlight;
+  std::size_t offset = 0;
+  std::size_t chunk_size = frameChunkSize(address, size);
+  auto req = writeMemoryFrame(handle, address, data, chunk_size);
+  while(true){
+    BOOST_LOG_TRIVIAL(info) << "Write " << chunk_size << " Bytes at address " << address + offset << std::endl;
+    if(writeFrame(req.data(), req.size()) != 0){
+      return -1;
+    }
+    inFlight.push_back(req.size());
+
+    /* encode the next frame while this one is still on the wire, with an
+     * I/O thread or a remote transport writeFrame returns before the
+     * adapter has sent it */
+    auto next_offset = offset + chunk_size;
+    std::size_t next_size = 0;
+    std::vector<uint8_t> next;
+    if(next_offset < size){
+      next_size = frameChunkSize(address + next_offset, size - next_offset);
+      next = writeMemoryFrame(handle, address + next_offset, data + next_offset, next_size);
+    }
+
+    /* the bootloader answers in order, so with a window of more than one
+     * frame the responses of a slow link overlap the following frames */
+    while(!inFlight.empty() && (inFlight.size() >= window || next.empty())){
+      if(awaitWriteResponse(inFlight.front()) != 0){
+        return -1;
+      }
+      inFlight.pop_front();
+    }
+    if(next.empty()){
+      return 0;
+    }
+    offset = next_offset;
+    chunk_size = next_size;
+    req.swap(next);
+  }
+}
+
+int K32W061::readMemory(uint8_t handle, uint32_t address, uint8_t* data, std::size_t size){
+  std::size_t offset = 0;
+  while(offset < size){
+    std::size_t chunk_size = frameChunkSize(address + offset, size - offset);
+    std::vector<uint8_t> req(sizeof(FrameHeader) + sizeof(FlashMemoryHeader) + CRC_SIZE);
     FrameHeader * header = reinterpret_cast<FrameHeader*>(req.data());
-    FlashMemoryHeader * flash_memory_header = reinterpret_cast<FlashMemoryHeader*>(req.data() + sizeof(FrameHeader));
-    header->size = htons(sizeof(FrameHeader) + sizeof(FlashMemoryHeader) + chunk_size + CRC_SIZE);
-    header->type = FrameType::WriteMemoryReq;
-    flash_memory_header->handle = handle;
-    flash_memory_header->address = offset;
-    flash_memory_header->length = chunk_size;
-    flash_memory_header->mode = 0x00;
-    std::copy(std::begin(data)+offset, std::begin(data)+offset+chunk_size, req.begin() + sizeof(FrameHeader) + sizeof(FlashMemoryHeader));
+    FlashMemoryHeader * read_memory_header = reinterpret_cast<FlashMemoryHeader*>(req.data() + sizeof(FrameHeader));
+    header->size = htons(req.size());
+    header->type = FrameType::ReadMemoryReq;
+    read_memory_header->handle = handle;
+    read_memory_header->mode = 0x00;
+    read_memory_header->address = address + offset;
+    read_memory_header->length = chunk_size;
 
     auto crc = calculateCrc(req);
     insertCrc(req, crc);
 
-    BOOST_LOG_TRIVIAL(info) << "Write " << chunk_size << " Bytes at offset " << offset << std::endl;
-    auto ret = dev.writeData(req);
-    if(ret != (signed)req.size()){
+    BOOST_LOG_TRIVIAL(info) << "Read " << chunk_size << " Bytes at address " << address + offset;
+    if(dev.writeData(req) != static_cast<signed>(req.size())){
       return -1;
     }
 
-    /*auto*/ std::vector<uint8_t> resp = dev.readData();
-    if(resp.size()<9)
-    {
-      std::vector<uint8_t> resp2 = dev.readData();
-      resp.insert(std::end(resp), std::begin(resp2), std::end(resp2));
-    }
-      
-      
-   // if( resp.size() == 0 ||
-    if( resp.size() < 9 ||
+    auto resp = readResponse("ReadMemory", timeoutFor(req.size() + sizeof(FrameHeader) + sizeof(ResponseHeader) + chunk_size + CRC_SIZE));
+    if( resp.size() != sizeof(FrameHeader) + sizeof(ResponseHeader) + chunk_size + CRC_SIZE ||
         extractCrc(resp) != calculateCrc(resp) ||
-        !responseHasSuccessStatus(resp) ||
-        responseType(resp) != FrameType::WriteMemoryResp){
+        responseType(resp) != FrameType::ReadMemoryResp ||
+        !responseHasSuccessStatus(resp)){
       return -1;
     }
+    auto payload = resp.begin() + sizeof(FrameHeader) + sizeof(ResponseHeader);
+    std::copy(payload, payload + chunk_size, data + offset);
 
-    size -= chunk_size;
-    offset+= chunk_size;
-    if(size < chunk_size){
-      chunk_size = size;
-      req.resize(sizeof(FrameHeader) + sizeof(FlashMemoryHeader) + chunk_size + CRC_SIZE);
-    }
-  }while(size != 0);
-  
-  
+    offset += chunk_size;
+  }
   return 0;
 }
 
@@ -411,7 +675,7 @@ int K32W061::closeMemory(uint8_t handle){
     return -1;
   };
   
-  auto resp = dev.readData();
+  auto resp = readResponse("CloseMemory", timeoutFor(req.size() + 9));
   if( resp.size() == 0 ||
       calculateCrc(resp) != extractCrc(resp) ||
       responseType(resp) != FrameType::CloseMemoryResp ||
@@ -436,7 +700,7 @@ int K32W061::reset()
     return -1;
   }
 
-  auto resp = dev.readData();
+  auto resp = readResponse("Reset", timeoutFor(req.size() + 9));
   if( resp.size() == 0 ||
       extractCrc(resp) != calculateCrc(resp) ||
       responseType(resp) != FrameType::ResetResp ||
@@ -12,6 +12,8 @@
 #include "ftdi.hpp"
 #include "mcu.h"
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <array>
 
@@ -21,24 +23,86 @@ public:
   ~K32W061();
 
   static const unsigned int CHIP_ID_K32W061=0x88888888;
+  static const unsigned int FLASH_SIZE=0x9DE00;
+  /* baudrate of the bootloader after reset */
+  static const unsigned int ISP_BAUDRATE=115200;
+  static const unsigned int FLASH_PAGE_SIZE=512;
+  static const unsigned int WRITE_FRAME_OVERHEAD=18;
+  static const unsigned int WRITE_FRAME_PAYLOAD_OFFSET=14;
+  /* response deadlines: transfer time at the current baudrate plus the
+   * work of the request plus a margin for USB latency and the bootloader */
+  static const unsigned int RESPONSE_MARGIN_MS=100;
+  static const unsigned int ERASE_MS_PER_PAGE=4;
+  static const unsigned int BLANK_CHECK_MS_PER_PAGE=1;
+  static const unsigned int WRITE_FRAME_MS=10;
+  /* longest a response is waited for without looking at the cancel flag */
+  static const unsigned int CANCEL_POLL_MS=50;
+  /* most write frames sent ahead of their responses, one flash block */
+  static const unsigned int MAX_WRITE_WINDOW=16;
 
   int enableISPMode(const std::vector<uint8_t> key={}) override;
   DeviceInfo getDeviceInfo() override;
-  int eraseMemory(uint8_t handle) override;
+  int eraseMemory(uint8_t handle, uint32_t address, uint32_t length) override;
+  int eraseMemory(uint8_t handle){ return eraseMemory(handle, 0, FLASH_SIZE); }
   int getMemoryHandle(const MemoryID) override;
-  bool memoryIsErased(uint8_t handle) override;
-  int flashMemory(uint8_t handle, const std::vector<uint8_t>& data) override;
+  bool memoryIsErased(uint8_t handle, uint32_t address, uint32_t length) override;
+  bool memoryIsErased(uint8_t handle){ return memoryIsErased(handle, 0, FLASH_SIZE); }
+  int flashMemory(uint8_t handle, uint32_t address, const uint8_t* data, std::size_t size) override;
+  int flashMemory(uint8_t handle, const std::vector<uint8_t>& data){ return flashMemory(handle, 0, data.data(), data.size()); }
+  int sendFrames(const std::vector<Frame>& frames, const std::function<void(std::size_t index)>& acknowledged) override;
+  int readMemory(uint8_t handle, uint32_t address, uint8_t* data, std::size_t size) override;
   int closeMemory(uint8_t handle) override;
   int reset() override;
 
   int setBaudrate(uint32_t speed) override;
+  MemoryInfo memoryInfo(const MemoryID id) const override;
+  void setResponseTimeout(std::chrono::milliseconds timeout) override;
+  void setCancel(const std::atomic<bool>* cancel) override;
+
+  /* deadline for a request and its response of bytes in total at speed baud */
+  static std::chrono::milliseconds responseTimeout(uint32_t speed, std::size_t bytes, std::chrono::milliseconds work);
+  /* write frames flashMemory sends before it waits for the first response,
+   * 0 derives it from the latency of the transport */
+  void setWriteWindow(unsigned int frames);
+  /* frames of frameBytes that fit into the round trip latency at speed baud plus one */
+  static unsigned int writeWindow(uint32_t speed, std::size_t frameBytes, std::chrono::microseconds latency);
+
+  /* baudrates the bootloader accepts in SetBaudRate, ascending */
+  static std::vector<uint32_t> baudrates();
+  static MemoryInfo memoryGeometry(const MemoryID id);
+  static std::size_t frameChunkSize(uint32_t address, std::size_t remaining);
+  static std::vector<uint8_t> writeMemoryFrame(uint8_t handle, uint32_t address, const uint8_t* data, std::size_t size);
+  /* true if the size bytes at frame are a WriteMemory request to address
+   * whose header and payload length agree with size */
+  static bool isWriteMemoryFrame(const uint8_t* frame, std::size_t size, uint32_t address);
+  /* replace payload bytes of an encoded write frame, updating its CRC incrementally */
+  static void patchWriteFrame(std::vector<uint8_t>& frame, std::size_t offset, const uint8_t* data, std::size_t size);
+  /* address an encoded write frame to another memory handle, same CRC update */
+  static void setWriteFrameHandle(std::vector<uint8_t>& frame, uint8_t handle);
 
 protected:
-  void insertCrc(std::vector<uint8_t>& data, unsigned long crc) const;
-  unsigned long calculateCrc(const std::vector<uint8_t>& data) const;
-  unsigned long extractCrc(std::vector<uint8_t> data) const;
+  static void insertCrc(std::vector<uint8_t>& data, unsigned long crc);
+  static unsigned long calculateCrc(const std::vector<uint8_t>& data);
+  static unsigned long extractCrc(std::vector<uint8_t> data);
+  /* reads until the length announced in the frame header has arrived.
+   * Throws TimeoutError once timeout has passed, returns what arrived if
+   * the transport fails */
+  std::vector<uint8_t> readResponse(const char* request, std::chrono::milliseconds timeout);
+  std::chrono::milliseconds timeoutFor(std::size_t bytes, std::chrono::milliseconds work=std::chrono::milliseconds(0)) const;
+  /* the two halves of a write, flashMemory encodes the next frame in between */
+  int writeFrame(const uint8_t* frame, std::size_t size);
+  int awaitWriteResponse(std::size_t frameSize);
+  /* setWriteWindow, or derived from the baudrate and the latency of the transport */
+  unsigned int currentWindow() const;
 private:
+  /* replaces size bytes at position of an encoded frame and its CRC */
+  static void patchFrame(std::vector<uint8_t>& frame, std::size_t position, const uint8_t* data, std::size_t size);
+
   FTDI::Interface &dev;
+  uint32_t speed = ISP_BAUDRATE;
+  std::chrono::milliseconds fixedTimeout{0};
+  const std::atomic<bool>* cancel = nullptr;
+  unsigned int fixedWindow = 0;
 };
 
 #endif /* _K32W061_H_ */
\ No newline at end of file
@@ -6,17 +6,30 @@
  *******************************************************************************/
 
  /* SPDX-License-Identifier: BSD-2-Clause-Patent */
-#include "ftdi_linux.h"
-#include "uart_linux.h"
-#include "k32w061.h"
-#include "application.h"
-#include "firmware_reader.h"
-#include "vid_pid_reader.h"
+#include "frame_stream.h"
+#include "job.h"
+#include "planner.h"
+#include "parallel_runner.h"
+#include "station.h"
+#include "daemon.h"
+#include "image_cache.h"
+#include "manifest.h"
+#include "options.h"
+#include "nxpisp.h"
+#include "usb_enumerator.h"
 
+#include <csignal>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <climits>
+#include <unistd.h>
 #include <boost/program_options.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/support/date_time.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
@@ -24,46 +37,95 @@
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/sources/record_ostream.hpp>
+#include <boost/log/attributes/scoped_attribute.hpp>
+#include <boost/log/attributes/constant.hpp>
 
 #define CHIP_ID_K32W061 0x88888888
 
 namespace po = boost::program_options;
 
-MCU::MemoryID stringToMemID(const std::string str){
-  MCU::MemoryID id;
-  if(str == "FLASH"){
-    id = MCU::MemoryID::flash;
-  }else if(str == "PSECT"){
-    id = MCU::MemoryID::psect;
-  }else if(str == "PFLASH"){
-    id = MCU::MemoryID::pflash;
-  }else if(str == "CONFIG"){
-    id = MCU::MemoryID::config;
-  }else if(str == "EFUSE"){
-    id = MCU::MemoryID::efuse;
-  }else if(str == "ROM"){
-    id = MCU::MemoryID::rom;
-  }else{
-    throw std::runtime_error(std::string("Unknown Memory Type \"") + str + std::string("\""));
+
+/* a port kept open by the daemon, jobs on the same port are serialized */
+struct ResidentPort{
+  std::mutex lock;
+  bool ftdi = false;
+  std::string lines;
+  bool ioThread = false;
+  std::unique_ptr<FTDI::Interface> transport;
+};
+
+/* a single device is flashed through libnxpisp like by any other client of the library */
+int runSession(const std::string& interface, int argc, const char* argv[]){
+  auto session = nxpisp_open(interface.c_str());
+  if(session == nullptr){
+    throw std::runtime_error("Could not create session");
+  }
+  auto ret = nxpisp_run(session, argv + 1, argc - 1);
+  nxpisp_close(session);
+  return ret == NXPISP_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int runClient(const std::string& socket, int argc, const char* argv[]){
+  std::vector<std::string> args;
+  for(int i=1;i<argc;i++){
+    std::string arg = argv[i];
+    if(arg == "--connect"){
+      i++;
+    }else if(arg.compare(0, 10, "--connect=") != 0){
+      args.push_back(arg);
+    }
+  }
+  char cwd[PATH_MAX];
+  if(getcwd(cwd, sizeof(cwd)) == nullptr){
+    throw std::runtime_error("Could not get working directory");
+  }
+
+  bool progress = false;
+  std::string error;
+  auto success = Daemon::request(socket, args, cwd, [&progress](const std::string& type, const std::string& text){
+    if(type == "progress"){
+      std::size_t done = 0;
+      std::size_t total = 0;
+      std::istringstream(text) >> done >> total;
+      if(total != 0){
+        std::cerr << "\r" << (done * 100 / total) << "% (" << done << "/" << total << " bytes)" << std::flush;
+      }else{
+        std::cerr << "\r" << done << " bytes" << std::flush;
+      }
+      progress = true;
+    }else if(type == "log"){
+      if(progress){
+        std::cerr << std::endl;
+        progress = false;
+      }
+      std::clog << text << std::endl;
+    }
+  }, error);
+  if(progress){
+    std::cerr << std::endl;
+  }
+  if(!success){
+    BOOST_LOG_TRIVIAL(error) << error;
+    return EXIT_FAILURE;
   }
+  return EXIT_SUCCESS;
+}
+
+static Station* activeStation = nullptr;
+static Daemon* activeDaemon = nullptr;
 
-  return id;
+static void stopOnSignal(int){
+  if(activeStation != nullptr){
+    activeStation->stop();
+  }
+  if(activeDaemon != nullptr){
+    activeDaemon->stop();
+  }
 }
 
 int main(int argc, const char* argv[]){
 
-  po::options_description desc("Options");
-  desc.add_options()
-    ("help,h", "Print this help Message")
-    ("device-info,d", "Show Device Information from Chip")
-    ("erase,e", po::value<std::string>(), "Erase Memory. Available Types are: FLASH, PSECT, PFLASH, CONFIG, EFUSE, ROM")
-    ("firmware,f", po::value<std::string>(), "Path Firmware Binary")
-    ("reset,r", "Reset device via ISP command")
-    ("interface,i", po::value<std::string>()->default_value("/dev/ttyUSB0"), "Path to Interface /dev/ttyUSBX. If not specified defaults to /dev/ttyUSB0")
-    ("verbose,v", "Enable Verbose Output")
-    ("noftdi,n", "Don'tuse FTDI")
-    ("speed,s",  po::value<std::uint32_t>(), "programming baudrate")
-  ;
+  auto desc = Options::description();
 
   try{
     po::variables_map vm;
@@ -76,70 +138,157 @@ int main(int argc, const char* argv[]){
       return 0;
     }
 
-    boost::log::add_console_log(std::clog,boost::log::keywords::format = "%TimeStamp% [%Severity%]: %Message%");
+    namespace expr = boost::log::expressions;
+    boost::log::add_console_log(std::clog, boost::log::keywords::format = (
+      expr::stream << expr::format_date_time<boost::posix_time::ptime>("TimeStamp", "%Y-%m-%d %H:%M:%S.%f")
+                   << " [" << boost::log::trivial::severity << "]: "
+                   << expr::if_(expr::has_attr<std::string>("Device"))[expr::stream << expr::attr<std::string>("Device") << ": "]
+                   << expr::smessage));
     boost::log::core::get()->set_filter (boost::log::trivial::severity >= boost::log::trivial::warning);
     boost::log::add_common_attributes();
     if(vm.count("verbose")){
       boost::log::core::get()->set_filter (boost::log::trivial::severity >= boost::log::trivial::info);
     }
     
-    Application *app_p;
+    if(vm.count("list")){
+      UsbEnumerator::print(std::cout, UsbEnumerator::system().scan());
+      return EXIT_SUCCESS;
+    }
 
+    if(vm.count("connect")){
+      return runClient(vm["connect"].as<std::string>(), argc, argv);
+    }
+
+    if(vm.count("daemon")){
+      ImageCache cache;
+      std::mutex portsMutex;
+      std::map<std::string, ResidentPort> ports;
+      Daemon daemon(vm["daemon"].as<std::string>(), [&](const std::vector<std::string>& args, const std::string& cwd, const Daemon::Progress& progress){
+        auto jvm = Options::parseJob(args, "by the daemon");
+        auto interface = jvm["interface"].as<std::string>();
+        BOOST_LOG_SCOPED_THREAD_TAG("Device", interface);
+        auto job = Options::buildJob(jvm, cwd, &cache, true);
+        if(job.stream){
+          throw std::runtime_error("Streamed firmware is not supported by the daemon");
+        }
+        job.progress = progress;
 
-    if (vm.count("noftdi") || vm.count("n")) {
-      UARTLinux *ftdi = new UARTLinux();
-      ftdi->open(vm["interface"].as<std::string>());
-      K32W061 *mcu=new K32W061(*ftdi);
-      app_p=new Application(*mcu, *ftdi);
-      BOOST_LOG_TRIVIAL(info) <<  "Enable ISP Mode";
-      app_p->enableISPMode();
-      BOOST_LOG_TRIVIAL(info) <<  "ISP Mode Enabled";
+        ResidentPort* port = nullptr;
+        {
+          std::lock_guard<std::mutex> lock(portsMutex);
+          port = &ports[interface];
+        }
+        std::lock_guard<std::mutex> lock(port->lock);
+        auto lines = jvm.count("lines") ? jvm["lines"].as<std::string>() : std::string();
+        if(!port->transport || port->ftdi != job.useFtdi || port->lines != lines || port->ioThread != job.ioThread){
+          port->transport.reset();
+          port->transport = job.open(interface);
+          port->ftdi = job.useFtdi;
+          port->ioThread = job.ioThread;
+          port->lines = lines;
+        }
+        try{
+          job.run(*port->transport, interface);
+        }catch(...){
+          /* reopen the port for the next job, its state is unknown */
+          port->transport.reset();
+          throw;
+        }
+      });
+      activeDaemon = &daemon;
+      std::signal(SIGINT, stopOnSignal);
+      std::signal(SIGTERM, stopOnSignal);
+      daemon.run();
+      activeDaemon = nullptr;
+      return EXIT_SUCCESS;
     }
-    else {
-      FTDILinux *ftdi = new FTDILinux();
-      BOOST_LOG_TRIVIAL(info) <<  "Open FTDI Device " << vm["interface"].as<std::string>();
-      int vid = 0;
-      int pid = 0;
-      std::tie(vid, pid) = VIDPIDReader::getVidPidForDev(vm["interface"].as<std::string>());
-      ftdi->open(vid, pid);
-      K32W061 *mcu=new K32W061(*ftdi);
-      app_p=new Application(*mcu, *ftdi);
-      BOOST_LOG_TRIVIAL(info) <<  "Enable ISP Mode";
-      app_p->enableISPMode();
-      BOOST_LOG_TRIVIAL(info) <<  "ISP Mode Enabled";
-      
 
+    if(vm.count("manifest")){
+      Manifest manifest(vm["manifest"].as<std::string>());
+      ImageCache cache;
+      std::map<std::string, Job> jobs;
+      std::vector<std::string> interfaces;
+      for(const auto& device : manifest.devices()){
+        BOOST_LOG_SCOPED_THREAD_TAG("Device", device.interface);
+        auto jvm = Options::parseJob(device.args, "in a manifest");
+        jobs[device.interface] = Options::buildJob(jvm, manifest.directory(), &cache, true);
+        if(jobs[device.interface].stream){
+          throw std::runtime_error("Streamed firmware is not supported in a manifest");
+        }
+        interfaces.push_back(device.interface);
+      }
+      BOOST_LOG_TRIVIAL(info) << "Run manifest on " << interfaces.size() << " devices";
+      auto results = ParallelRunner::run(interfaces, [&jobs](const std::string& interface){ jobs.at(interface).run(interface); }, manifest.concurrency(), manifest.retries());
+      ParallelRunner::printSummary(std::cout, results);
+      for(const auto& r : results){
+        if(!r.success){
+          return EXIT_FAILURE;
+        }
+      }
+      return EXIT_SUCCESS;
     }
-    
 
-    if(vm.count("device-info") || vm.count("d")){
-      BOOST_LOG_TRIVIAL(info) << "Read Device Info";
-      app_p->deviceInfo();
+    if(vm.count("compile")){
+      if(!vm.count("output")){
+        throw std::runtime_error("--compile requires an output file (-o)");
+      }
+      auto image = Options::loadImage(vm, vm["compile"].as<std::string>());
+      auto patches = Options::loadPatches(vm, {});
+      BOOST_LOG_TRIVIAL(info) << "Write frame stream " << vm["output"].as<std::string>();
+      FrameStream::compile(*image, vm["output"].as<std::string>(), patches.fields());
+      return EXIT_SUCCESS;
     }
-    if(vm.count("speed") || vm.count("s")){
-      BOOST_LOG_TRIVIAL(info) << "Set baudrate to " << vm["speed"].as<std::uint32_t>();
-      app_p->setBaudrate(vm["speed"].as<std::uint32_t>());
+
+    if(vm.count("plan")){
+      auto job = Options::buildJob(vm, "", nullptr, true);
+      Planner planner;
+      job.plan(planner);
+      auto settings = job.planSettings(vm["interface"].as<std::string>());
+      if(vm.count("turnaround")){
+        settings.turnaround = std::chrono::microseconds(vm["turnaround"].as<unsigned int>());
+      }
+      planner.print(std::cout, settings);
+      if(vm.count("compare")){
+        std::cout << std::endl;
+        planner.compare(std::cout, settings);
+      }
+      return EXIT_SUCCESS;
     }
 
-    if(vm.count("erase")){
-      BOOST_LOG_TRIVIAL(info) << "Erase Memory " << vm["erase"].as<std::string>();
-      app_p->eraseMemory(stringToMemID(vm["erase"].as<std::string>()));
-      BOOST_LOG_TRIVIAL(info) << "Memory " << vm["erase"].as<std::string>() << " erased";
+    if(!vm.count("station") && !vm.count("parallel")){
+      return runSession(vm["interface"].as<std::string>(), argc, argv);
     }
 
-    if(vm.count("firmware")){
-      BOOST_LOG_TRIVIAL(info) <<  "Open file " << vm["firmware"].as<std::string>();
-      std::ifstream ifs(vm["firmware"].as<std::string>(), std::ios::binary);
-      FirmwareReader fw(ifs);
-      BOOST_LOG_TRIVIAL(info) << "Flash Firmware";
-      app_p->flashFirmware(fw.data());
-      BOOST_LOG_TRIVIAL(info) << "Success";
+    Job job = Options::buildJob(vm, "", nullptr, vm.count("station"));
+
+    if(vm.count("station")){
+      if(job.stream){
+        throw std::runtime_error("A streamed firmware can not be used in station mode");
+      }
+      Station station(vm["station"].as<std::string>(), Options::stationMatch(vm), [&job](const std::string& interface){ job.run(interface); });
+      activeStation = &station;
+      std::signal(SIGINT, stopOnSignal);
+      std::signal(SIGTERM, stopOnSignal);
+      station.run();
+      activeStation = nullptr;
+      std::cout << station.passed() << " boards passed, " << station.failed() << " failed" << std::endl;
+      return station.failed() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    if(vm.count("reset")){
-      BOOST_LOG_TRIVIAL(info) << "Reset device";
-      app_p->reset();
-      BOOST_LOG_TRIVIAL(info) << "Success";
+    if(vm.count("parallel")){
+      if(job.stream){
+        throw std::runtime_error("A streamed firmware can not be flashed in parallel");
+      }
+      auto interfaces = ParallelRunner::expand(vm["parallel"].as<std::vector<std::string>>());
+      BOOST_LOG_TRIVIAL(info) << "Flash " << interfaces.size() << " devices in parallel";
+      auto results = ParallelRunner::run(interfaces, [&job](const std::string& interface){ job.run(interface); });
+      ParallelRunner::printSummary(std::cout, results);
+      for(const auto& r : results){
+        if(!r.success){
+          return EXIT_FAILURE;
+        }
+      }
+      return EXIT_SUCCESS;
     }
   }catch(const std::exception& e){
     BOOST_LOG_TRIVIAL(error) << e.what();
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "manifest.h"
+#include "parallel_runner.h"
+
+#include <climits>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+namespace pt = boost::property_tree;
+
+static bool isArray(const pt::ptree& node){
+  return !node.empty() && node.front().first.empty();
+}
+
+static unsigned int toUnsigned(const pt::ptree& node, const std::string& key){
+  std::size_t pos = 0;
+  unsigned long value = 0;
+  auto str = node.get_value<std::string>();
+  try{
+    value = std::stoul(str, &pos, 0);
+  }catch(const std::exception&){
+    pos = 0;
+  }
+  if(str.empty() || pos != str.size() || str[0] == '-' || value > UINT_MAX){
+    throw std::runtime_error(std::string("Invalid value \"") + str + std::string("\" for ") + key);
+  }
+  return value;
+}
+
+/* collects the options of one level, "set" values are kept apart so the
+ * device level can override single fields */
+static void collect(const pt::ptree& node, std::map<std::string, pt::ptree>& options, std::map<std::string, std::string>& values){
+  for(const auto& child : node){
+    if(child.first.empty()){
+      throw std::runtime_error("Manifest options must be named");
+    }
+    if(child.first == "set" && !child.second.empty() && !isArray(child.second)){
+      for(const auto& field : child.second){
+        values[field.first] = field.second.get_value<std::string>();
+      }
+    }else{
+      options[child.first] = child.second;
+    }
+  }
+}
+
+static void appendOption(std::vector<std::string>& args, const std::string& key, const pt::ptree& value){
+  if(isArray(value)){
+    for(const auto& item : value){
+      if(!item.second.empty()){
+        throw std::runtime_error(std::string("Invalid value for ") + key);
+      }
+      args.push_back("--" + key);
+      args.push_back(item.second.get_value<std::string>());
+    }
+  }else if(!value.empty()){
+    throw std::runtime_error(std::string("Invalid value for ") + key);
+  }else if(value.data() == "true"){
+    args.push_back("--" + key);
+  }else if(value.data() != "false"){
+    args.push_back("--" + key);
+    args.push_back(value.data());
+  }
+}
+
+Manifest::Manifest(const std::string& path){
+  std::ifstream ifs(path);
+  if(!ifs){
+    throw std::runtime_error(std::string("Could not open manifest ") + path);
+  }
+  auto slash = path.rfind('/');
+  dir = slash == std::string::npos ? std::string(".") : path.substr(0, slash == 0 ? 1 : slash);
+  parse(ifs);
+}
+
+Manifest::Manifest(std::istream& is, const std::string& dir) : dir(dir){
+  parse(is);
+}
+
+void Manifest::parse(std::istream& is){
+  pt::ptree root;
+  try{
+    pt::read_json(is, root);
+  }catch(const pt::json_parser_error& e){
+    throw std::runtime_error(std::string("Invalid manifest: ") + e.what());
+  }
+
+  pt::ptree devices;
+  pt::ptree common;
+  for(const auto& child : root){
+    if(child.first == "concurrency"){
+      concurrencyLimit = toUnsigned(child.second, child.first);
+    }else if(child.first == "retries"){
+      retryCount = toUnsigned(child.second, child.first);
+    }else if(child.first == "devices"){
+      devices = child.second;
+    }else if(child.first == "interface"){
+      throw std::runtime_error("interface has to be given per device");
+    }else{
+      common.push_back(child);
+    }
+  }
+  if(devices.empty() || !isArray(devices)){
+    throw std::runtime_error("Manifest has no devices");
+  }
+
+  std::map<std::string, pt::ptree> commonOptions;
+  std::map<std::string, std::string> commonValues;
+  collect(common, commonOptions, commonValues);
+
+  std::set<std::string> seen;
+  for(const auto& device : devices){
+    auto pattern = device.second.get<std::string>("interface", "");
+    if(pattern.empty()){
+      throw std::runtime_error("Manifest device without interface");
+    }
+    auto options = commonOptions;
+    auto values = commonValues;
+    pt::ptree own = device.second;
+    own.erase("interface");
+    collect(own, options, values);
+
+    std::vector<std::string> args;
+    for(const auto& option : options){
+      if(option.first == "devices" || option.first == "concurrency" || option.first == "retries"){
+        throw std::runtime_error(option.first + std::string(" can only be given at the top level"));
+      }
+      appendOption(args, option.first, option.second);
+    }
+    for(const auto& value : values){
+      args.push_back("--set");
+      args.push_back(value.first + "=" + value.second);
+    }
+
+    for(const auto& interface : ParallelRunner::expand({pattern})){
+      if(!seen.insert(interface).second){
+        throw std::runtime_error(std::string("Interface ") + interface + std::string(" is listed more than once"));
+      }
+      deviceList.push_back(Device{interface, args});
+    }
+  }
+}
+
+unsigned int Manifest::concurrency() const{
+  return concurrencyLimit;
+}
+
+unsigned int Manifest::retries() const{
+  return retryCount;
+}
+
+const std::string& Manifest::directory() const{
+  return dir;
+}
+
+const std::vector<Manifest::Device>& Manifest::devices() const{
+  return deviceList;
+}
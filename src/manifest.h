@@ -0,0 +1,60 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+
+#include <istream>
+#include <string>
+#include <vector>
+
+/* JSON description of a production run:
+ *
+ *   {
+ *     "concurrency": 4,
+ *     "retries": 1,
+ *     "firmware": "app.hex",
+ *     "verify": true,
+ *     "devices": [
+ *       { "interface": "/dev/ttyUSB0", "set": { "SERIAL": "1001" } },
+ *       { "interface": "/dev/ttyACM*", "speed": 1000000 }
+ *     ]
+ *   }
+ *
+ * Every key besides concurrency, retries and devices is a command line
+ * option: values become "--key value", true enables a flag, false omits it
+ * and arrays repeat the option. "set" may also be an object of field values.
+ * Keys of a device override the top level, "set" objects are merged per field.
+ * Interfaces are glob patterns. */
+class Manifest
+{
+public:
+  struct Device{
+    std::string interface;
+    std::vector<std::string> args;
+  };
+
+  explicit Manifest(const std::string& path);
+  /* relative paths inside the manifest are resolved against dir */
+  Manifest(std::istream& is, const std::string& dir);
+
+  unsigned int concurrency() const;
+  unsigned int retries() const;
+  const std::string& directory() const;
+  const std::vector<Device>& devices() const;
+
+private:
+  void parse(std::istream& is);
+
+  unsigned int concurrencyLimit = 0;
+  unsigned int retryCount = 0;
+  std::string dir;
+  std::vector<Device> deviceList;
+};
+
+#endif /* _MANIFEST_H_ */
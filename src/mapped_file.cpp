@@ -0,0 +1,68 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const std::string& path){
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0){
+    throw std::runtime_error(std::string("Could not open ") + path + std::string(": ") + strerror(errno));
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0){
+    ::close(fd);
+    throw std::runtime_error(std::string("Could not stat ") + path + std::string(": ") + strerror(errno));
+  }
+  if(!S_ISREG(st.st_mode)){
+    ::close(fd);
+    throw std::runtime_error(path + std::string(" is not a regular file"));
+  }
+
+  length = st.st_size;
+  if(length == 0){
+    ::close(fd);
+    return;
+  }
+
+  void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  ::close(fd);
+  if(p == MAP_FAILED){
+    length = 0;
+    throw std::runtime_error(std::string("Could not map ") + path + std::string(": ") + strerror(errno));
+  }
+  madvise(p, length, MADV_SEQUENTIAL);
+  addr = static_cast<const uint8_t*>(p);
+}
+
+MappedFile::MappedFile(MappedFile&& other) : addr(other.addr), length(other.length){
+  other.addr = nullptr;
+  other.length = 0;
+}
+
+MappedFile::~MappedFile(){
+  if(addr != nullptr){
+    munmap(const_cast<uint8_t*>(addr), length);
+  }
+}
+
+const uint8_t* MappedFile::data() const{
+  return addr;
+}
+
+std::size_t MappedFile::size() const{
+  return length;
+}
@@ -0,0 +1,35 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/* Read-only memory mapping of a regular file. The mapping lives as long as
+ * the object, pointers returned by data() must not outlive it. */
+class MappedFile
+{
+public:
+  MappedFile(const std::string& path);
+  MappedFile(MappedFile&& other);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  const uint8_t* data() const;
+  std::size_t size() const;
+
+private:
+  const uint8_t* addr = nullptr;
+  std::size_t length = 0;
+};
+
+#endif /* _MAPPED_FILE_H_ */
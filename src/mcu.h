@@ -9,7 +9,12 @@
 #ifndef _MCU_H_
 #define _MCU_H_
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
 #include <vector>
 
 class MCU
@@ -19,6 +24,13 @@ class MCU
     std::uint32_t chipId;
     std::uint32_t version;
   };
+
+  struct MemoryInfo{
+    std::uint32_t base;
+    std::uint32_t size;
+    std::uint32_t pageSize;
+    bool writable;
+  };
   
   enum MemoryID{
     flash = 0x00,
@@ -31,15 +43,44 @@ class MCU
     ram1 = 0x07
   };
 
+  /* an encoded request, e.g. a precompiled WriteMemory frame */
+  struct Frame{
+    const uint8_t* data;
+    std::size_t size;
+  };
+
+  /* thrown when a request got no complete response within its deadline */
+  class TimeoutError : public std::runtime_error{
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  /* thrown when an operation notices that it was cancelled */
+  class Cancelled : public std::runtime_error{
+  public:
+    Cancelled() : std::runtime_error("Cancelled"){}
+  };
+
   virtual int enableISPMode(const std::vector<uint8_t> key) = 0;
   virtual DeviceInfo getDeviceInfo() = 0;
-  virtual int eraseMemory(uint8_t handle) = 0;
+  virtual int eraseMemory(uint8_t handle, uint32_t address, uint32_t length) = 0;
   virtual int getMemoryHandle(const MemoryID) = 0;
-  virtual bool memoryIsErased(uint8_t handle) = 0;
-  virtual int flashMemory(uint8_t handle, const std::vector<uint8_t>& data) = 0;
+  virtual bool memoryIsErased(uint8_t handle, uint32_t address, uint32_t length) = 0;
+  virtual int flashMemory(uint8_t handle, uint32_t address, const uint8_t* data, std::size_t size) = 0;
+  /* sends WriteMemory frames with the write window of them in flight like
+   * flashMemory, acknowledged is called with the index of every frame once
+   * its response arrived */
+  virtual int sendFrames(const std::vector<Frame>& frames, const std::function<void(std::size_t index)>& acknowledged) = 0;
+  virtual int readMemory(uint8_t handle, uint32_t address, uint8_t* data, std::size_t size) = 0;
   virtual int closeMemory(uint8_t handle) = 0;
   virtual int reset() = 0;
   virtual int setBaudrate(uint32_t speed) = 0;
+  virtual MemoryInfo memoryInfo(const MemoryID) const = 0;
+  /* deadline of every following request, 0 derives it from the baudrate,
+   * the frame sizes and the work the request asks for */
+  virtual void setResponseTimeout(std::chrono::milliseconds timeout) = 0;
+  /* waiting for a response stops with Cancelled once *cancel is set */
+  virtual void setCancel(const std::atomic<bool>* cancel) = 0;
 };
 
 #endif /* _MCU_H_ */
\ No newline at end of file
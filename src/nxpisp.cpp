@@ -0,0 +1,282 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "nxpisp.h"
+#include "options.h"
+#include "image_cache.h"
+#include "job.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/attributes/scoped_attribute.hpp>
+#include <boost/log/attributes/constant.hpp>
+
+struct nxpisp_session{
+  std::string interface;
+  std::string directory;
+  unsigned int id;
+  nxpisp_callbacks callbacks;
+
+  std::mutex lock;
+  std::condition_variable finished;
+  std::thread worker;
+  bool running = false;
+  std::atomic<bool> cancel{false};
+  int status = NXPISP_OK;
+  std::string error;
+
+  /* only touched by the operation running on the session */
+  std::unique_ptr<FTDI::Interface> transport;
+  bool ftdi = false;
+  std::string lines;
+  bool ioThread = false;
+  uint32_t openSpeed = 0;
+};
+
+namespace{
+
+std::atomic<unsigned int> nextId{0};
+
+/* images stay loaded for all sessions of the process */
+ImageCache& imageCache(){
+  static ImageCache cache;
+  return cache;
+}
+
+/* forwards the log records of one session to its log callback */
+class CallbackBackend : public boost::log::sinks::basic_formatted_sink_backend<char, boost::log::sinks::synchronized_feeding>
+{
+public:
+  explicit CallbackBackend(const nxpisp_callbacks& callbacks) : callbacks(callbacks){}
+  void consume(const boost::log::record_view& rec, const string_type& message){
+    auto severity = boost::log::extract<boost::log::trivial::severity_level>("Severity", rec);
+    callbacks.log(callbacks.user, severity ? static_cast<int>(*severity) : NXPISP_LOG_INFO, message.c_str());
+  }
+private:
+  nxpisp_callbacks callbacks;
+};
+
+void execute(nxpisp_session* session, const std::vector<std::string>& args, const nxpisp_callbacks& callbacks){
+  BOOST_LOG_SCOPED_THREAD_TAG("Session", session->id);
+
+  boost::shared_ptr<boost::log::sinks::synchronous_sink<CallbackBackend>> sink;
+  if(callbacks.log){
+    namespace expr = boost::log::expressions;
+    sink = boost::make_shared<boost::log::sinks::synchronous_sink<CallbackBackend>>(boost::make_shared<CallbackBackend>(callbacks));
+    sink->set_filter(expr::attr<unsigned int>("Session") == session->id);
+    sink->set_formatter(expr::stream << expr::smessage);
+    boost::log::core::get()->add_sink(sink);
+  }
+
+  int status = NXPISP_OK;
+  std::string error;
+  bool parsed = false;
+  try{
+    auto vm = Options::parseJob(args, "by libnxpisp");
+    auto job = Options::buildJob(vm, session->directory, &imageCache(), true);
+    parsed = true;
+    job.cancel = &session->cancel;
+    if(callbacks.progress){
+      job.progress = [callbacks](std::size_t done, std::size_t total){
+        callbacks.progress(callbacks.user, done, total);
+      };
+    }
+    if(callbacks.metrics){
+      job.metrics = [callbacks](const Job::Metrics& m){
+        nxpisp_metrics metrics{sizeof(nxpisp_metrics), m.seconds, m.ispEntrySeconds, m.warm, m.bytes, m.speed};
+        callbacks.metrics(callbacks.user, &metrics);
+      };
+    }
+
+    auto lines = vm.count("lines") ? vm["lines"].as<std::string>() : std::string();
+    if(!session->transport || session->ftdi != job.useFtdi || session->lines != lines || session->ioThread != job.ioThread){
+      session->transport.reset();
+      session->transport = job.open(session->interface);
+      session->ftdi = job.useFtdi;
+      session->ioThread = job.ioThread;
+      session->lines = lines;
+      session->openSpeed = 0;
+    }
+    auto warmSpeed = session->openSpeed;
+    session->openSpeed = 0;
+    session->openSpeed = job.run(*session->transport, session->interface, warmSpeed);
+  }catch(const Application::Cancelled& e){
+    status = NXPISP_CANCELLED;
+    error = e.what();
+  }catch(const MCU::TimeoutError& e){
+    BOOST_LOG_TRIVIAL(error) << e.what();
+    status = NXPISP_TIMEOUT;
+    error = e.what();
+  }catch(const std::exception& e){
+    BOOST_LOG_TRIVIAL(error) << e.what();
+    status = parsed ? NXPISP_ERROR : NXPISP_INVALID;
+    error = e.what();
+  }
+  if(status != NXPISP_OK){
+    /* the state of the port is unknown, open it again next time */
+    session->transport.reset();
+  }
+  if(sink){
+    boost::log::core::get()->remove_sink(sink);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(session->lock);
+    session->status = status;
+    session->error = error;
+  }
+  if(callbacks.done){
+    callbacks.done(callbacks.user, status, error.c_str());
+  }
+  {
+    std::lock_guard<std::mutex> guard(session->lock);
+    session->running = false;
+  }
+  session->finished.notify_all();
+}
+
+}
+
+unsigned int nxpisp_api_version(void){
+  return NXPISP_API_VERSION;
+}
+
+const char* nxpisp_version(void){
+  return VERSION;
+}
+
+nxpisp_session* nxpisp_open(const char* interface){
+  if(interface == nullptr){
+    return nullptr;
+  }
+  try{
+    auto session = new nxpisp_session();
+    session->interface = interface;
+    session->id = ++nextId;
+    memset(&session->callbacks, 0, sizeof(session->callbacks));
+    return session;
+  }catch(...){
+    return nullptr;
+  }
+}
+
+void nxpisp_close(nxpisp_session* session){
+  if(session == nullptr){
+    return;
+  }
+  nxpisp_cancel(session);
+  nxpisp_wait(session);
+  delete session;
+}
+
+int nxpisp_set_directory(nxpisp_session* session, const char* directory){
+  if(session == nullptr || directory == nullptr){
+    return NXPISP_INVALID;
+  }
+  std::lock_guard<std::mutex> guard(session->lock);
+  if(session->running){
+    return NXPISP_BUSY;
+  }
+  session->directory = directory;
+  return NXPISP_OK;
+}
+
+int nxpisp_set_callbacks(nxpisp_session* session, const nxpisp_callbacks* callbacks){
+  if(session == nullptr || callbacks == nullptr || callbacks->size < offsetof(nxpisp_callbacks, done) + sizeof(callbacks->done)){
+    return NXPISP_INVALID;
+  }
+  std::lock_guard<std::mutex> guard(session->lock);
+  if(session->running){
+    return NXPISP_BUSY;
+  }
+  /* callers built against an older header pass a smaller struct */
+  memset(&session->callbacks, 0, sizeof(session->callbacks));
+  memcpy(&session->callbacks, callbacks, std::min(callbacks->size, sizeof(session->callbacks)));
+  session->callbacks.size = sizeof(session->callbacks);
+  return NXPISP_OK;
+}
+
+int nxpisp_start(nxpisp_session* session, const char* const* args, size_t count){
+  if(session == nullptr || (args == nullptr && count != 0)){
+    return NXPISP_INVALID;
+  }
+  try{
+    std::vector<std::string> arguments;
+    for(size_t i=0;i<count;i++){
+      if(args[i] == nullptr){
+        return NXPISP_INVALID;
+      }
+      arguments.push_back(args[i]);
+    }
+
+    std::unique_lock<std::mutex> guard(session->lock);
+    if(session->running){
+      return NXPISP_BUSY;
+    }
+    if(session->worker.joinable()){
+      session->worker.join();
+    }
+    session->running = true;
+    session->cancel = false;
+    session->status = NXPISP_OK;
+    session->error.clear();
+    auto callbacks = session->callbacks;
+    session->worker = std::thread(execute, session, arguments, callbacks);
+    return NXPISP_OK;
+  }catch(...){
+    return NXPISP_ERROR;
+  }
+}
+
+int nxpisp_wait(nxpisp_session* session){
+  if(session == nullptr){
+    return NXPISP_INVALID;
+  }
+  std::unique_lock<std::mutex> guard(session->lock);
+  session->finished.wait(guard, [session](){ return !session->running; });
+  if(session->worker.joinable()){
+    session->worker.join();
+  }
+  return session->status;
+}
+
+int nxpisp_run(nxpisp_session* session, const char* const* args, size_t count){
+  auto ret = nxpisp_start(session, args, count);
+  if(ret != NXPISP_OK){
+    return ret;
+  }
+  return nxpisp_wait(session);
+}
+
+int nxpisp_cancel(nxpisp_session* session){
+  if(session == nullptr){
+    return NXPISP_INVALID;
+  }
+  session->cancel = true;
+  return NXPISP_OK;
+}
+
+const char* nxpisp_last_error(nxpisp_session* session){
+  if(session == nullptr){
+    return "Invalid session";
+  }
+  std::lock_guard<std::mutex> guard(session->lock);
+  return session->error.c_str();
+}
@@ -0,0 +1,105 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _NXPISP_H_
+#define _NXPISP_H_
+
+/* C API of libnxpisp.
+ *
+ * A session belongs to one interface and keeps its port open between
+ * operations, an ISP session left open by one operation is continued by
+ * the next one. Operations are described with the command line options of
+ * nxp-isp, e.g. {"-n", "-f", "app.hex", "--verify"}. --interface is
+ * ignored, the interface of the session is used.
+ *
+ * Structs passed to the library start with their size, new fields are only
+ * ever appended. All functions are thread safe, callbacks are called from
+ * the thread running the operation. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NXPISP_API __attribute__((visibility("default")))
+#define NXPISP_API_VERSION 1
+
+enum nxpisp_status{
+  NXPISP_OK = 0,
+  NXPISP_ERROR = -1,
+  NXPISP_CANCELLED = -2,
+  /* an operation is already running on the session */
+  NXPISP_BUSY = -3,
+  /* invalid options or arguments */
+  NXPISP_INVALID = -4,
+  /* the device did not answer a request within its deadline */
+  NXPISP_TIMEOUT = -5
+};
+
+/* same values as boost::log::trivial::severity_level */
+enum nxpisp_severity{
+  NXPISP_LOG_TRACE = 0,
+  NXPISP_LOG_DEBUG,
+  NXPISP_LOG_INFO,
+  NXPISP_LOG_WARNING,
+  NXPISP_LOG_ERROR,
+  NXPISP_LOG_FATAL
+};
+
+typedef struct nxpisp_metrics{
+  size_t size;
+  double seconds;
+  /* 0 if an open ISP session was continued */
+  double isp_entry_seconds;
+  int warm;
+  uint64_t bytes;
+  /* baudrate the ISP session is left at, 0 if the device was reset */
+  uint32_t speed;
+} nxpisp_metrics;
+
+typedef struct nxpisp_callbacks{
+  size_t size;
+  void* user;
+  void (*log)(void* user, int severity, const char* message);
+  void (*progress)(void* user, uint64_t done, uint64_t total);
+  void (*metrics)(void* user, const nxpisp_metrics* metrics);
+  /* end of an operation started with nxpisp_start */
+  void (*done)(void* user, int status, const char* error);
+} nxpisp_callbacks;
+
+typedef struct nxpisp_session nxpisp_session;
+
+NXPISP_API unsigned int nxpisp_api_version(void);
+NXPISP_API const char* nxpisp_version(void);
+
+/* NULL if out of memory. The port is opened by the first operation */
+NXPISP_API nxpisp_session* nxpisp_open(const char* interface);
+/* cancels a running operation and waits for it */
+NXPISP_API void nxpisp_close(nxpisp_session* session);
+
+/* relative paths in the options are resolved against this directory */
+NXPISP_API int nxpisp_set_directory(nxpisp_session* session, const char* directory);
+NXPISP_API int nxpisp_set_callbacks(nxpisp_session* session, const nxpisp_callbacks* callbacks);
+
+/* runs an operation and waits for it */
+NXPISP_API int nxpisp_run(nxpisp_session* session, const char* const* args, size_t count);
+/* starts an operation in the background, its end is reported to the done callback */
+NXPISP_API int nxpisp_start(nxpisp_session* session, const char* const* args, size_t count);
+/* waits for the operation started last and returns its status */
+NXPISP_API int nxpisp_wait(nxpisp_session* session);
+NXPISP_API int nxpisp_cancel(nxpisp_session* session);
+/* error message of the last operation, valid until the next one starts */
+NXPISP_API const char* nxpisp_last_error(nxpisp_session* session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NXPISP_H_ */
@@ -0,0 +1,298 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "options.h"
+#include "k32w061.h"
+#include "port_state.h"
+#include "device_profiles.h"
+#include "vid_pid_reader.h"
+
+#include <future>
+#include <stdexcept>
+#include <unistd.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/log/trivial.hpp>
+
+namespace po = boost::program_options;
+
+po::options_description Options::description(){
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Print this help Message")
+    ("device-info,d", "Show Device Information from Chip")
+    ("erase,e", po::value<std::vector<std::string>>(), "Erase Memory MEMORY[:ADDRESS+LENGTH]. Available Types are: FLASH, PSECT, PFLASH, CONFIG, EFUSE. Can be given multiple times")
+    ("firmware,f", po::value<std::string>(), "Path Firmware Binary. Use - to read from stdin")
+    ("write,w", po::value<std::vector<std::string>>(), "Write a file to memory MEMORY[@OFFSET]:FILE, e.g. PSECT:psect.bin. Can be given multiple times")
+    ("stream", "Stream the firmware while flashing. Default for stdin, pipes and .gz/.zst files")
+    ("format", po::value<std::string>(), "Firmware file format: bin, hex, srec, elf. Detected from the file if not specified")
+    ("compile", po::value<std::string>(), "Compile a firmware image into a precompiled ISP frame stream (.ispf) and exit")
+    ("output,o", po::value<std::string>(), "Output file for --compile")
+    ("plan", "Print the ISP frames the job would send and predict its duration without touching the device, then exit")
+    ("compare", "With --plan: also predict the duration for every baudrate and several write windows")
+    ("turnaround", po::value<unsigned int>(), "With --plan: time in us from a request until its response starts (USB latency, network, bootloader). Default: 1000")
+    ("field", po::value<std::vector<std::string>>(), "Declare a per-device patch field NAME@ADDRESS:LENGTH. Can be given multiple times")
+    ("set", po::value<std::vector<std::string>>(), "Set a patch field NAME=VALUE. VALUE is an integer, aa:bb:.., hex:.. or str:..")
+    ("values-csv", po::value<std::string>(), "CSV file with one column per patch field")
+    ("values-row", po::value<std::string>(), "Row of --values-csv to use, either a 1-based index or COLUMN=VALUE")
+    ("reset,r", "Reset device via ISP command")
+    ("interface,i", po::value<std::string>()->default_value("/dev/ttyUSB0"), "Path to Interface /dev/ttyUSBX, usb:BUSPATH, serial:SERIAL or a remote port tcp://HOST:PORT or rfc2217://HOST:PORT. If not specified defaults to /dev/ttyUSB0")
+    ("parallel,p", po::value<std::vector<std::string>>()->multitoken(), "Flash several interfaces at once, e.g. --parallel /dev/ttyUSB*. Glob patterns are expanded")
+    ("station", po::value<std::string>()->implicit_value("/dev/ttyUSB*"), "Station mode: flash every board that is plugged in on a matching device until interrupted. Defaults to /dev/ttyUSB*")
+    ("match-id", po::value<std::string>(), "Station mode: only flash devices with this USB VID:PID (hex)")
+    ("match-port", po::value<std::string>(), "Station mode: only flash devices on this USB port, e.g. 1-1.2")
+    ("daemon", po::value<std::string>(), "Run as daemon and accept jobs on this Unix socket. Ports and images stay loaded between jobs")
+    ("list", "List the USB serial adapters with their bus path, VID:PID, interface, driver and serial number and exit")
+    ("connect", po::value<std::string>(), "Send the job to the daemon listening on this Unix socket instead of running it")
+    ("verify", "Read back and compare everything that was written")
+    ("dump", po::value<std::vector<std::string>>(), "Read memory into a file MEMORY[:ADDRESS+LENGTH]=FILE. Can be given multiple times")
+    ("manifest", po::value<std::string>(), "Run the production run described in this JSON manifest on all of its devices")
+    ("order", po::value<std::string>(), "Order of operations, default: device-info,speed,program,verify,dump,reset")
+    ("warm", po::value<std::string>()->implicit_value(PortState::defaultPath()), "Continue the ISP session left open by an earlier run on the same port instead of entering ISP mode again. Takes an optional state file")
+    ("profiles", po::value<std::string>()->implicit_value(DeviceProfiles::defaultPath()), "Start from what earlier runs learned about the device on the same adapter (ISP entry time, baudrate) and record what this run measures. Takes an optional profile file")
+    ("verbose,v", "Enable Verbose Output")
+    ("noftdi,n", "Don'tuse FTDI")
+    ("lines", po::value<std::string>(), "Drive reset and ISP select from the modem control lines instead of CBUS pins, e.g. reset=dtr,isp=rts. A ! inverts a line. Required for FT2232H/FT4232H channels")
+    ("io-thread", "UART only: send and receive in a thread of its own, so the next frame is prepared while the last one is on the wire")
+    ("timing", po::value<std::string>(), "ISP entry timing profile: default, fast or slow (RC delayed reset lines)")
+    ("response-timeout", po::value<unsigned int>(), "Give up if the device does not answer a request within this many ms. Default: derived from baudrate, frame size and the requested work")
+    ("write-window", po::value<unsigned int>(), "Send up to this many write frames before waiting for the first response (1-16). Default: 1, more on remote ports to cover the network round trip")
+    ("cpu", po::value<std::string>(), "Pin the I/O thread of each port to one of these CPUs, e.g. 2,3 or 4-7. Ports are assigned round robin")
+    ("sched", po::value<std::string>(), "Scheduling of the I/O threads: fifo[:PRIORITY] for SCHED_FIFO (default priority 50) or nice:VALUE")
+    ("mlock", "Lock the memory of the process so page faults do not delay frames")
+    ("speed,s",  po::value<std::string>(), "programming baudrate, or auto[:MAX] to use the fastest baudrate (up to MAX) that answers reliably")
+  ;
+  return desc;
+}
+
+po::variables_map Options::parseJob(const std::vector<std::string>& args, const std::string& context){
+  po::variables_map vm;
+  po::store(po::command_line_parser(args).options(description()).run(), vm);
+  po::notify(vm);
+  for(auto option : {"daemon", "connect", "parallel", "station", "compile", "manifest", "list", "plan"}){
+    if(vm.count(option)){
+      throw std::runtime_error(std::string("--") + option + std::string(" is not supported ") + context);
+    }
+  }
+  return vm;
+}
+
+std::unique_ptr<FirmwareImage> Options::loadImage(const po::variables_map& vm, const std::string& path){
+  std::unique_ptr<FirmwareImage> image;
+  BOOST_LOG_TRIVIAL(info) <<  "Open file " << path;
+  if(vm.count("format")){
+    image.reset(new FirmwareImage(path, K32W061::FLASH_SIZE, FirmwareImage::stringToFormat(vm["format"].as<std::string>())));
+  }else{
+    image.reset(new FirmwareImage(path, K32W061::FLASH_SIZE));
+  }
+  BOOST_LOG_TRIVIAL(info) << "Firmware has " << image->segments().size() << " segment(s) with " << image->size() << " bytes";
+  return image;
+}
+
+std::string Options::resolvePath(const std::string& cwd, const std::string& path){
+  if(cwd.empty() || path.empty() || path[0] == '/' || path == "-"){
+    return path;
+  }
+  return cwd + "/" + path;
+}
+
+PatchSet Options::loadPatches(const po::variables_map& vm, const std::vector<PatchSet::Field>& declared, const std::string& cwd){
+  PatchSet patches;
+  for(const auto& field : declared){
+    patches.declare(field);
+  }
+  if(vm.count("field")){
+    for(const auto& spec : vm["field"].as<std::vector<std::string>>()){
+      patches.declare(spec);
+    }
+  }
+  if(vm.count("values-csv")){
+    if(!vm.count("values-row")){
+      throw std::runtime_error("--values-csv requires --values-row");
+    }
+    patches.loadCsv(resolvePath(cwd, vm["values-csv"].as<std::string>()), vm["values-row"].as<std::string>());
+  }
+  if(vm.count("set")){
+    for(const auto& assignment : vm["set"].as<std::vector<std::string>>()){
+      patches.set(assignment);
+    }
+  }
+  return patches;
+}
+
+Station::Match Options::stationMatch(const po::variables_map& vm){
+  int vid = -1;
+  int pid = -1;
+  if(vm.count("match-id")){
+    auto id = vm["match-id"].as<std::string>();
+    auto colon = id.find(':');
+    try{
+      vid = std::stoi(id.substr(0, colon), nullptr, 16);
+      pid = std::stoi(id.substr(colon + 1), nullptr, 16);
+    }catch(const std::exception&){
+      colon = std::string::npos;
+    }
+    if(colon == std::string::npos){
+      throw std::runtime_error(std::string("Invalid --match-id \"") + id + std::string("\", expected VID:PID"));
+    }
+  }
+  std::string port = vm.count("match-port") ? vm["match-port"].as<std::string>() : std::string();
+
+  return [vid, pid, port](const std::string& dev){
+    /* ttys that are not USB (ttyS*, ttyAMA*, ...) have no id or port to match */
+    try{
+      if(vid >= 0){
+        int dev_vid = 0;
+        int dev_pid = 0;
+        std::tie(dev_vid, dev_pid) = VIDPIDReader::getVidPidForDev(dev);
+        if(dev_vid != vid || dev_pid != pid){
+          return false;
+        }
+      }
+      return port.empty() || VIDPIDReader::getUsbPortForDev(dev) == port;
+    }catch(const std::exception& e){
+      BOOST_LOG_TRIVIAL(debug) << "No USB id for " << dev << ": " << e.what();
+      return false;
+    }
+  };
+}
+
+Job Options::buildJob(const po::variables_map& vm, const std::string& cwd, ImageCache* cache, bool encode){
+  Job job;
+  std::shared_ptr<const FirmwareImage> image;
+  auto format = vm.count("format") ? vm["format"].as<std::string>() : std::string();
+  if(vm.count("firmware")){
+    auto path = resolvePath(cwd, vm["firmware"].as<std::string>());
+    if(vm.count("stream") || FirmwareStream::isStreamInput(path)){
+      BOOST_LOG_TRIVIAL(info) <<  "Stream file " << path;
+      if(!format.empty() && format != "bin"){
+        throw std::runtime_error("Streaming is only supported for raw binaries");
+      }
+      job.stream = std::make_shared<FirmwareStream>(path, K32W061::FLASH_SIZE, K32W061::FLASH_PAGE_SIZE);
+    }else if(FrameStream::isFrameStream(path)){
+      BOOST_LOG_TRIVIAL(info) <<  "Open frame stream " << path;
+      job.frames = std::make_shared<FrameStream>(path);
+      BOOST_LOG_TRIVIAL(info) << "Frame stream has " << job.frames->frames().size() << " frames with " << job.frames->payloadSize() << " bytes";
+    }else if(encode){
+      /* a missing file fails the job before the device is erased, everything
+       * else of the image is only known once it is parsed */
+      if(access(path.c_str(), R_OK) != 0){
+        throw std::runtime_error(std::string("Could not open firmware ") + path);
+      }
+      BOOST_LOG_TRIVIAL(info) << "Pre-encode firmware " << path << " while the device is prepared";
+      job.pendingFrames = std::async(std::launch::async, [vm, path, cache, format]{
+        return cache ? cache->frames(path, K32W061::FLASH_SIZE, format) : FrameStream::encode(*loadImage(vm, path));
+      }).share();
+    }else{
+      image = cache ? cache->image(path, K32W061::FLASH_SIZE, format) : loadImage(vm, path);
+    }
+  }
+  job.patches = loadPatches(vm, job.frames ? job.frames->fields() : std::vector<PatchSet::Field>{}, cwd);
+  job.patches.validate();
+
+  if(vm.count("erase")){
+    for(const auto& spec : vm["erase"].as<std::vector<std::string>>()){
+      job.session.addErase(spec);
+    }
+  }
+  if(vm.count("write")){
+    auto load = [&cwd, cache](const std::string& path, std::size_t capacity) -> std::shared_ptr<const FirmwareImage>{
+      if(cache){
+        return cache->image(resolvePath(cwd, path), capacity);
+      }
+      return std::make_shared<FirmwareImage>(resolvePath(cwd, path), capacity);
+    };
+    for(const auto& spec : vm["write"].as<std::vector<std::string>>()){
+      BOOST_LOG_TRIVIAL(info) <<  "Open file for " << spec;
+      job.session.addWrite(spec, load);
+    }
+  }
+  if(image){
+    job.session.addWrite(MCU::MemoryID::flash, 0, image);
+  }
+  /* pending frames are checked by the job once they are encoded */
+  if(!job.pendingFrames.valid()){
+    job.checkFields(job.frames.get());
+  }
+
+  if(vm.count("dump")){
+    for(const auto& spec : vm["dump"].as<std::vector<std::string>>()){
+      auto eq = spec.find('=');
+      if(eq == std::string::npos || eq + 1 == spec.size()){
+        throw std::runtime_error(std::string("Invalid dump \"") + spec + std::string("\", expected MEMORY[:ADDRESS+LENGTH]=FILE"));
+      }
+      auto range = Session::parseRange(spec.substr(0, eq));
+      job.dumps.push_back(Job::Dump{range.first, range.second, resolvePath(cwd, spec.substr(eq + 1))});
+    }
+  }
+
+  job.useFtdi = !vm.count("noftdi");
+  if(vm.count("lines")){
+    job.lines = UARTLinux::parseLineMapping(vm["lines"].as<std::string>());
+  }
+  job.ioThread = vm.count("io-thread");
+  if(job.ioThread && job.useFtdi){
+    throw std::runtime_error("--io-thread requires --noftdi");
+  }
+  if(vm.count("warm")){
+    job.statePath = vm["warm"].as<std::string>();
+    if(job.statePath.empty()){
+      throw std::runtime_error("--warm needs a state file when XDG_RUNTIME_DIR is not set");
+    }
+  }
+  if(vm.count("profiles")){
+    job.profilePath = vm["profiles"].as<std::string>();
+    if(job.profilePath.empty()){
+      throw std::runtime_error("--profiles needs a profile file when neither XDG_DATA_HOME nor HOME is set");
+    }
+  }
+  if(vm.count("timing")){
+    job.timing = Application::IspTiming::profile(vm["timing"].as<std::string>());
+  }
+  if(vm.count("response-timeout")){
+    job.responseTimeout = std::chrono::milliseconds(vm["response-timeout"].as<unsigned int>());
+  }
+  if(vm.count("write-window")){
+    job.writeWindow = vm["write-window"].as<unsigned int>();
+    if(job.writeWindow == 0 || job.writeWindow > K32W061::MAX_WRITE_WINDOW){
+      throw std::runtime_error(std::string("--write-window must be between 1 and ") + std::to_string(K32W061::MAX_WRITE_WINDOW));
+    }
+  }
+  if(vm.count("cpu")){
+    job.scheduling.cpus = Scheduling::parseCpus(vm["cpu"].as<std::string>());
+  }
+  if(vm.count("sched")){
+    Scheduling::parsePolicy(vm["sched"].as<std::string>(), job.scheduling);
+  }
+  job.scheduling.lockMemory = vm.count("mlock");
+  job.deviceInfo = vm.count("device-info");
+  if(vm.count("speed")){
+    auto speed = vm["speed"].as<std::string>();
+    job.autoSpeed = boost::algorithm::starts_with(speed, "auto");
+    if(job.autoSpeed){
+      speed = speed.size() > 5 && speed[4] == ':' ? speed.substr(5) : speed.substr(4);
+    }
+    try{
+      std::size_t end = 0;
+      auto value = speed.empty() && job.autoSpeed ? 0 : std::stoul(speed, &end);
+      /* stoul takes "-1" as ULONG_MAX */
+      if(end != speed.size() || (!speed.empty() && speed[0] == '-') || value > UINT32_MAX){
+        throw std::invalid_argument(speed);
+      }
+      job.speed = value;
+    }catch(const std::exception&){
+      throw std::runtime_error(std::string("Invalid speed \"") + vm["speed"].as<std::string>() + std::string("\", expected a baudrate, auto or auto:MAX"));
+    }
+  }
+  job.verify = vm.count("verify");
+  job.reset = vm.count("reset");
+  if(vm.count("order")){
+    job.order = Job::parseOrder(vm["order"].as<std::string>());
+  }
+  job.validate();
+  return job;
+}
@@ -0,0 +1,45 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+#include "firmware_image.h"
+#include "image_cache.h"
+#include "job.h"
+#include "patch_set.h"
+#include "station.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+/* The command line options of a job and how they turn into a Job. Shared
+ * by the command line tool, the daemon, manifests and the C API. */
+namespace Options{
+  namespace po = boost::program_options;
+
+  po::options_description description();
+  /* parses the options of one job, context completes the error message
+   * for options that select a mode of the tool, e.g. "by the daemon" */
+  po::variables_map parseJob(const std::vector<std::string>& args, const std::string& context);
+
+  std::unique_ptr<FirmwareImage> loadImage(const po::variables_map& vm, const std::string& path);
+  /* relative paths are resolved against cwd, unless it is empty */
+  std::string resolvePath(const std::string& cwd, const std::string& path);
+  PatchSet loadPatches(const po::variables_map& vm, const std::vector<PatchSet::Field>& declared, const std::string& cwd="");
+  Station::Match stationMatch(const po::variables_map& vm);
+  /* builds the job described by the options. With a cache the images
+   * stay loaded between jobs, encode turns the flash image into write frames
+   * once so every device only gets its patches applied. Streamed firmware
+   * is never cached, it can only be used by one job */
+  Job buildJob(const po::variables_map& vm, const std::string& cwd, ImageCache* cache, bool encode);
+}
+
+#endif /* _OPTIONS_H_ */
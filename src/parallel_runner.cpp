@@ -0,0 +1,130 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "parallel_runner.h"
+#include "usb_enumerator.h"
+#include "tcp_serial.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <glob.h>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes/scoped_attribute.hpp>
+#include <boost/log/attributes/constant.hpp>
+
+std::vector<std::string> ParallelRunner::expand(const std::vector<std::string>& patterns){
+  std::vector<std::string> interfaces;
+  for(const auto& pattern : patterns){
+    if(UsbEnumerator::isUsbSelector(pattern) || TcpSerial::isRemote(pattern)){
+      interfaces.push_back(pattern);
+      continue;
+    }
+    glob_t matches;
+    auto ret = glob(pattern.c_str(), 0, nullptr, &matches);
+    if(ret == GLOB_NOMATCH){
+      globfree(&matches);
+      throw std::runtime_error(std::string("No interface matches ") + pattern);
+    }
+    if(ret != 0){
+      globfree(&matches);
+      throw std::runtime_error(std::string("Could not expand ") + pattern);
+    }
+    for(std::size_t i=0;i<matches.gl_pathc;i++){
+      interfaces.push_back(matches.gl_pathv[i]);
+    }
+    globfree(&matches);
+  }
+  std::sort(interfaces.begin(), interfaces.end());
+  interfaces.erase(std::unique(interfaces.begin(), interfaces.end()), interfaces.end());
+  return interfaces;
+}
+
+std::vector<ParallelRunner::Result> ParallelRunner::run(const std::vector<std::string>& interfaces, const std::function<void(const std::string&)>& task, unsigned int concurrency, unsigned int retries){
+  std::vector<Result> results(interfaces.size());
+  std::deque<std::size_t> queue;
+  for(std::size_t i=0;i<interfaces.size();i++){
+    results[i] = Result{interfaces[i], false, 0.0, "", 0};
+    queue.push_back(i);
+  }
+
+  std::mutex lock;
+  auto worker = [&](){
+    for(;;){
+      std::size_t i;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if(queue.empty()){
+          return;
+        }
+        i = queue.front();
+        queue.pop_front();
+      }
+      const auto& interface = interfaces[i];
+      BOOST_LOG_SCOPED_THREAD_TAG("Device", interface);
+      auto start = std::chrono::steady_clock::now();
+      bool success = false;
+      std::string error;
+      try{
+        task(interface);
+        success = true;
+      }catch(const std::exception& e){
+        BOOST_LOG_TRIVIAL(error) << e.what();
+        error = e.what();
+      }
+      auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      std::lock_guard<std::mutex> guard(lock);
+      auto& r = results[i];
+      r.success = success;
+      r.error = error;
+      r.seconds += seconds;
+      r.attempts++;
+      if(!success && r.attempts <= retries){
+        BOOST_LOG_TRIVIAL(info) << "Retry " << r.attempts << " of " << retries;
+        queue.push_back(i);
+      }
+    }
+  };
+
+  std::size_t count = concurrency == 0 ? interfaces.size() : std::min<std::size_t>(concurrency, interfaces.size());
+  std::vector<std::thread> threads;
+  for(std::size_t i=0;i<count;i++){
+    threads.emplace_back(worker);
+  }
+  for(auto& t : threads){
+    t.join();
+  }
+  return results;
+}
+
+void ParallelRunner::printSummary(std::ostream& os, const std::vector<Result>& results){
+  auto flags = os.flags();
+  std::size_t width = 6;
+  std::size_t passed = 0;
+  for(const auto& r : results){
+    width = std::max(width, r.interface.size());
+    passed += r.success;
+  }
+  os << std::left << std::setw(width + 2) << "Device" << std::setw(8) << "Result" << std::setw(7) << "Tries" << "Time" << std::endl;
+  for(const auto& r : results){
+    os << std::left << std::setw(width + 2) << r.interface << std::setw(8) << (r.success ? "PASS" : "FAIL")
+       << std::setw(7) << r.attempts
+       << std::fixed << std::setprecision(1) << r.seconds << " s";
+    if(!r.success){
+      os << "  " << r.error;
+    }
+    os << std::endl;
+  }
+  os << passed << "/" << results.size() << " devices passed" << std::endl;
+  os.flags(flags);
+}
@@ -0,0 +1,38 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _PARALLEL_RUNNER_H_
+#define _PARALLEL_RUNNER_H_
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* Runs the same task on several interfaces, at most concurrency at a time
+ * (0 means one thread per interface). A failed interface is queued again
+ * behind the others until it used up its retries.
+ * Log records of a thread carry the interface in the "Device" attribute. */
+class ParallelRunner
+{
+public:
+  struct Result{
+    std::string interface;
+    bool success;
+    double seconds;
+    std::string error;
+    unsigned int attempts;
+  };
+
+  /* expands glob patterns like /dev/ttyUSB*, sorted and without duplicates */
+  static std::vector<std::string> expand(const std::vector<std::string>& patterns);
+  static std::vector<Result> run(const std::vector<std::string>& interfaces, const std::function<void(const std::string&)>& task, unsigned int concurrency=0, unsigned int retries=0);
+  static void printSummary(std::ostream& os, const std::vector<Result>& results);
+};
+
+#endif /* _PARALLEL_RUNNER_H_ */
@@ -0,0 +1,250 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "patch_set.h"
+#include "k32w061.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+
+static uint64_t parseNumber(const std::string& str, const std::string& what){
+  std::size_t pos = 0;
+  uint64_t value = 0;
+  /* stoull accepts "-1" as the largest value */
+  if(!str.empty() && str[0] == '-'){
+    throw std::runtime_error(std::string("Invalid ") + what + std::string(" \"") + str + std::string("\""));
+  }
+  try{
+    bool hex = boost::algorithm::istarts_with(str, "0x");
+    value = std::stoull(hex ? str.substr(2) : str, &pos, hex ? 16 : 10);
+    if(hex){
+      pos += 2;
+    }
+  }catch(const std::exception&){
+    pos = 0;
+  }
+  if(pos == 0 || pos != str.size()){
+    throw std::runtime_error(std::string("Invalid ") + what + std::string(" \"") + str + std::string("\""));
+  }
+  return value;
+}
+
+static std::vector<uint8_t> parseHexBytes(const std::string& str){
+  std::vector<uint8_t> bytes;
+  if(str.size() % 2 != 0){
+    throw std::runtime_error(std::string("Odd number of hex digits in \"") + str + std::string("\""));
+  }
+  for(std::size_t i=0;i<str.size();i+=2){
+    bytes.push_back(parseNumber(std::string("0x") + str.substr(i, 2), "hex byte"));
+  }
+  return bytes;
+}
+
+static std::vector<uint8_t> parseValue(const std::string& str, std::size_t size){
+  std::vector<uint8_t> bytes;
+  if(boost::algorithm::starts_with(str, "str:")){
+    auto text = str.substr(4);
+    if(text.size() > size){
+      throw std::runtime_error(std::string("String \"") + text + std::string("\" does not fit into ") + std::to_string(size) + std::string(" bytes"));
+    }
+    bytes.assign(text.begin(), text.end());
+    bytes.resize(size, 0);
+    return bytes;
+  }
+  if(boost::algorithm::starts_with(str, "hex:")){
+    bytes = parseHexBytes(str.substr(4));
+  }else if(str.find_first_of(":-") != std::string::npos){
+    std::vector<std::string> parts;
+    boost::split(parts, str, [](char c){ return c == ':' || c == '-'; });
+    for(const auto& part : parts){
+      if(part.size() != 2){
+        throw std::runtime_error(std::string("Invalid byte sequence \"") + str + std::string("\""));
+      }
+      auto b = parseHexBytes(part);
+      bytes.insert(bytes.end(), b.begin(), b.end());
+    }
+  }else{
+    uint64_t value = parseNumber(str, "value");
+    if(size < 8 && (value >> (8 * size)) != 0){
+      throw std::runtime_error(std::string("Value ") + str + std::string(" does not fit into ") + std::to_string(size) + std::string(" bytes"));
+    }
+    for(std::size_t i=0;i<size;i++){
+      bytes.push_back(i < 8 ? (value >> (8 * i)) & 0xFF : 0);
+    }
+  }
+  if(bytes.size() != size){
+    throw std::runtime_error(std::string("Value \"") + str + std::string("\" has ") + std::to_string(bytes.size()) + std::string(" bytes, field needs ") + std::to_string(size));
+  }
+  return bytes;
+}
+
+void PatchSet::declare(const std::string& spec){
+  auto at = spec.find('@');
+  auto colon = spec.find(':', at);
+  if(at == std::string::npos || at == 0 || colon == std::string::npos){
+    throw std::runtime_error(std::string("Invalid patch field \"") + spec + std::string("\", expected NAME@ADDRESS:LENGTH"));
+  }
+  auto address = parseNumber(spec.substr(at + 1, colon - at - 1), "field address");
+  auto size = parseNumber(spec.substr(colon + 1), "field length");
+  if(address > K32W061::FLASH_SIZE || size > K32W061::FLASH_SIZE){
+    throw std::runtime_error(std::string("Patch field \"") + spec + std::string("\" is outside the flash"));
+  }
+  declare(Field{spec.substr(0, at), static_cast<uint32_t>(address), static_cast<uint32_t>(size)});
+}
+
+void PatchSet::declare(const Field& f){
+  if(f.size == 0){
+    throw std::runtime_error(std::string("Patch field ") + f.name + std::string(" has no length"));
+  }
+  uint64_t end = uint64_t(f.address) + f.size;
+  if(end > K32W061::FLASH_SIZE){
+    throw std::runtime_error(std::string("Patch field ") + f.name + std::string(" is outside the flash"));
+  }
+  for(const auto& other : fieldList){
+    if(other.name == f.name){
+      throw std::runtime_error(std::string("Patch field ") + f.name + std::string(" declared twice"));
+    }
+    if(f.address < uint64_t(other.address) + other.size && other.address < end){
+      throw std::runtime_error(std::string("Patch fields ") + f.name + std::string(" and ") + other.name + std::string(" overlap"));
+    }
+  }
+  fieldList.push_back(f);
+  values.emplace_back();
+}
+
+void PatchSet::set(const std::string& assignment){
+  auto eq = assignment.find('=');
+  if(eq == std::string::npos){
+    throw std::runtime_error(std::string("Invalid patch value \"") + assignment + std::string("\", expected NAME=VALUE"));
+  }
+  set(assignment.substr(0, eq), assignment.substr(eq + 1));
+}
+
+void PatchSet::set(const std::string& name, const std::string& value){
+  const auto& f = field(name);
+  values[&f - fieldList.data()] = parseValue(value, f.size);
+}
+
+void PatchSet::loadCsv(const std::string& path, const std::string& row){
+  std::ifstream ifs(path);
+  if(!ifs.is_open()){
+    throw std::runtime_error(std::string("Could not open ") + path);
+  }
+  auto splitLine = [](std::string line){
+    boost::algorithm::trim_right_if(line, boost::is_any_of("\r"));
+    std::vector<std::string> cells;
+    boost::split(cells, line, [](char c){ return c == ',' || c == ';'; });
+    for(auto& cell : cells){
+      boost::algorithm::trim(cell);
+    }
+    return cells;
+  };
+
+  std::string line;
+  if(!std::getline(ifs, line)){
+    throw std::runtime_error(path + std::string(" is empty"));
+  }
+  auto header = splitLine(line);
+
+  std::string key_column, key_value;
+  unsigned long index = 0;
+  auto eq = row.find('=');
+  if(eq != std::string::npos){
+    key_column = row.substr(0, eq);
+    key_value = row.substr(eq + 1);
+    if(std::find(header.begin(), header.end(), key_column) == header.end()){
+      throw std::runtime_error(path + std::string(" has no column ") + key_column);
+    }
+  }else{
+    index = parseNumber(row, "CSV row");
+  }
+
+  unsigned long number = 0;
+  while(std::getline(ifs, line)){
+    if(boost::algorithm::trim_copy(line).empty()){
+      continue;
+    }
+    number++;
+    auto cells = splitLine(line);
+    cells.resize(header.size());
+    bool selected = false;
+    if(key_column.empty()){
+      selected = (number == index);
+    }else{
+      auto col = std::find(header.begin(), header.end(), key_column) - header.begin();
+      selected = (cells[col] == key_value);
+    }
+    if(!selected){
+      continue;
+    }
+    for(std::size_t i=0;i<header.size();i++){
+      auto it = std::find_if(fieldList.begin(), fieldList.end(), [&](const Field& f){ return f.name == header[i]; });
+      if(it != fieldList.end() && !cells[i].empty()){
+        set(header[i], cells[i]);
+      }
+    }
+    return;
+  }
+  throw std::runtime_error(std::string("No row ") + row + std::string(" in ") + path);
+}
+
+bool PatchSet::empty() const{
+  return fieldList.empty();
+}
+
+const std::vector<PatchSet::Field>& PatchSet::fields() const{
+  return fieldList;
+}
+
+void PatchSet::validate() const{
+  for(std::size_t i=0;i<fieldList.size();i++){
+    if(values[i].empty()){
+      throw std::runtime_error(std::string("No value given for patch field ") + fieldList[i].name);
+    }
+  }
+}
+
+bool PatchSet::overlaps(uint32_t address, std::size_t size) const{
+  for(const auto& f : fieldList){
+    if(static_cast<uint64_t>(f.address) < static_cast<uint64_t>(address) + size && address < static_cast<uint64_t>(f.address) + f.size){
+      return true;
+    }
+  }
+  return false;
+}
+
+void PatchSet::forEach(uint32_t address, std::size_t size, const std::function<void(std::size_t, const uint8_t*, std::size_t)>& fn) const{
+  uint64_t end = static_cast<uint64_t>(address) + size;
+  for(std::size_t i=0;i<fieldList.size();i++){
+    const auto& f = fieldList[i];
+    uint64_t begin = std::max<uint64_t>(f.address, address);
+    uint64_t stop = std::min<uint64_t>(static_cast<uint64_t>(f.address) + f.size, end);
+    if(begin >= stop || values[i].empty()){
+      continue;
+    }
+    fn(begin - address, values[i].data() + (begin - f.address), stop - begin);
+  }
+}
+
+void PatchSet::apply(uint32_t address, uint8_t* data, std::size_t size) const{
+  forEach(address, size, [data](std::size_t offset, const uint8_t* bytes, std::size_t n){
+    memcpy(data + offset, bytes, n);
+  });
+}
+
+const PatchSet::Field& PatchSet::field(const std::string& name) const{
+  for(const auto& f : fieldList){
+    if(f.name == name){
+      return f;
+    }
+  }
+  throw std::runtime_error(std::string("Unknown patch field ") + name);
+}
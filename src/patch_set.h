@@ -0,0 +1,61 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _PATCH_SET_H_
+#define _PATCH_SET_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Per-device values (serial number, MAC, calibration, ...) substituted
+ * into the firmware at fixed addresses while it is being flashed.
+ *
+ * Fields are declared as NAME@ADDRESS:LENGTH and must lie inside the
+ * flash, writes to other memories are never patched. Values are given as
+ * NAME=VALUE where VALUE is one of
+ *   12345 or 0x3039     integer, stored little endian in LENGTH bytes
+ *   00:11:22:33:44:55   bytes in the given order (':' or '-' separated)
+ *   hex:00112233        bytes in the given order
+ *   str:text            ASCII, zero padded to LENGTH
+ */
+class PatchSet
+{
+public:
+  struct Field{
+    std::string name;
+    uint32_t address;
+    uint32_t size;
+  };
+
+  void declare(const std::string& spec);
+  void declare(const Field& field);
+  void set(const std::string& assignment);
+  void set(const std::string& name, const std::string& value);
+  /* select the row either by 1-based index ("3") or by "COLUMN=VALUE" */
+  void loadCsv(const std::string& path, const std::string& row);
+
+  bool empty() const;
+  const std::vector<Field>& fields() const;
+  /* throws if a declared field has no value */
+  void validate() const;
+
+  bool overlaps(uint32_t address, std::size_t size) const;
+  /* calls fn(offset, bytes, size) for every patched part of [address, address+size) */
+  void forEach(uint32_t address, std::size_t size, const std::function<void(std::size_t, const uint8_t*, std::size_t)>& fn) const;
+  void apply(uint32_t address, uint8_t* data, std::size_t size) const;
+
+private:
+  const Field& field(const std::string& name) const;
+
+  std::vector<Field> fieldList;
+  std::vector<std::vector<uint8_t>> values;
+};
+
+#endif /* _PATCH_SET_H_ */
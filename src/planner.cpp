@@ -0,0 +1,361 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "planner.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace{
+  /* frame sizes of K32W061: header, request fields and CRC */
+  const std::size_t RESPONSE_SIZE = 9;
+  const std::size_t ENABLE_ISP_SIZE = 9;
+  const std::size_t DEVICE_INFO_SIZE = 8;
+  const std::size_t DEVICE_INFO_RESPONSE_SIZE = 17;
+  const std::size_t BAUDRATE_SIZE = 13;
+  const std::size_t OPEN_MEMORY_SIZE = 10;
+  const std::size_t OPEN_MEMORY_RESPONSE_SIZE = 10;
+  const std::size_t MEMORY_REQUEST_SIZE = 18;
+  const std::size_t CLOSE_MEMORY_SIZE = 9;
+  const std::size_t RESET_SIZE = 8;
+  /* GetDeviceInfo round trips per rate, see Application::negotiateBaudrate */
+  const unsigned int BAUDRATE_CHECKS = 3;
+  const unsigned int COMPARED_WINDOWS[] = {1, 2, 4, 8, 16};
+
+  /* 8N1: ten bits per byte */
+  std::chrono::microseconds wire(std::size_t bytes, uint32_t speed){
+    return std::chrono::microseconds(bytes * 10 * 1000000ULL / speed);
+  }
+
+  /* rates negotiateBaudrate steps through from ISP_BAUDRATE up to speed */
+  std::vector<uint32_t> negotiationSteps(uint32_t speed){
+    std::vector<uint32_t> steps;
+    for(auto rate : K32W061::baudrates()){
+      if(rate > K32W061::ISP_BAUDRATE && rate <= speed){
+        steps.push_back(rate);
+      }
+    }
+    return steps;
+  }
+
+  std::size_t pages(std::size_t length){
+    return (length + K32W061::FLASH_PAGE_SIZE - 1) / K32W061::FLASH_PAGE_SIZE;
+  }
+
+  std::string hex(uint32_t value){
+    std::ostringstream os;
+    os << "0x" << std::hex << std::setw(8) << std::setfill('0') << value;
+    return os.str();
+  }
+}
+
+const unsigned int Planner::DEFAULT_TURNAROUND_US;
+const unsigned int Planner::NOMINAL_ISP_READY_MS;
+
+void Planner::add(Kind kind, uint32_t address, std::size_t length){
+  plan.push_back(Request{kind, address, length});
+}
+
+void Planner::frames(Kind kind, uint32_t address, std::size_t length){
+  std::size_t offset = 0;
+  while(offset < length){
+    auto chunk = K32W061::frameChunkSize(address + offset, length - offset);
+    add(kind, address + offset, chunk);
+    offset += chunk;
+  }
+}
+
+void Planner::enterISPMode(){
+  add(Kind::ispEntry);
+}
+
+void Planner::deviceInfo(){
+  add(Kind::deviceInfo);
+}
+
+void Planner::setBaudrate(){
+  add(Kind::baudrate);
+}
+
+void Planner::negotiateBaudrate(){
+  add(Kind::negotiate);
+}
+
+void Planner::program(const Session& session){
+  for(const auto& step : session.steps()){
+    add(Kind::openMemory);
+    for(const auto& erase : step.erases){
+      add(Kind::erase, erase.address, erase.length);
+      add(Kind::blankCheck, erase.address, erase.length);
+    }
+    for(const auto& write : step.writes){
+      for(const auto& seg : write.image->segments()){
+        frames(Kind::write, seg.address + write.offset, seg.size);
+      }
+    }
+    add(Kind::closeMemory);
+  }
+}
+
+void Planner::flashFirmware(FirmwareStream& fw){
+  add(Kind::openMemory);
+  uint32_t address = 0;
+  std::vector<uint8_t> chunk;
+  while(fw.next(chunk)){
+    frames(Kind::write, address, chunk.size());
+    address += chunk.size();
+  }
+  add(Kind::closeMemory);
+}
+
+void Planner::flashFirmware(const FrameStream& fw){
+  add(Kind::openMemory);
+  for(const auto& frame : fw.frames()){
+    add(Kind::frame, frame.address, frame.size - K32W061::WRITE_FRAME_OVERHEAD);
+  }
+  add(Kind::closeMemory);
+}
+
+void Planner::verify(const Session& session){
+  for(const auto& step : session.steps()){
+    if(step.writes.empty()){
+      continue;
+    }
+    add(Kind::openMemory);
+    for(const auto& write : step.writes){
+      for(const auto& seg : write.image->segments()){
+        frames(Kind::read, seg.address + write.offset, seg.size);
+      }
+    }
+    add(Kind::closeMemory);
+  }
+}
+
+void Planner::verify(const FrameStream& fw){
+  add(Kind::openMemory);
+  for(const auto& frame : fw.frames()){
+    add(Kind::read, frame.address, frame.size - K32W061::WRITE_FRAME_OVERHEAD);
+  }
+  add(Kind::closeMemory);
+}
+
+void Planner::dump(uint32_t address, uint32_t length){
+  add(Kind::openMemory);
+  frames(Kind::read, address, length);
+  add(Kind::closeMemory);
+}
+
+void Planner::reset(){
+  add(Kind::reset);
+}
+
+const std::vector<Planner::Request>& Planner::requests() const{
+  return plan;
+}
+
+std::size_t Planner::sent(const Request& r, const Settings& settings){
+  switch(r.kind){
+    case Kind::ispEntry:
+      return ENABLE_ISP_SIZE;
+    case Kind::deviceInfo:
+      return DEVICE_INFO_SIZE;
+    case Kind::baudrate:
+      return settings.speed == K32W061::ISP_BAUDRATE ? 0 : BAUDRATE_SIZE;
+    case Kind::negotiate:
+      return negotiationSteps(settings.speed).size() * (BAUDRATE_SIZE + BAUDRATE_CHECKS * DEVICE_INFO_SIZE);
+    case Kind::openMemory:
+      return OPEN_MEMORY_SIZE;
+    case Kind::erase:
+    case Kind::blankCheck:
+    case Kind::read:
+      return MEMORY_REQUEST_SIZE;
+    case Kind::write:
+    case Kind::frame:
+      return r.length + K32W061::WRITE_FRAME_OVERHEAD;
+    case Kind::closeMemory:
+      return CLOSE_MEMORY_SIZE;
+    case Kind::reset:
+      return RESET_SIZE;
+  }
+  return 0;
+}
+
+std::size_t Planner::received(const Request& r, const Settings& settings){
+  switch(r.kind){
+    case Kind::deviceInfo:
+      return DEVICE_INFO_RESPONSE_SIZE;
+    case Kind::baudrate:
+      return settings.speed == K32W061::ISP_BAUDRATE ? 0 : RESPONSE_SIZE;
+    case Kind::negotiate:
+      return negotiationSteps(settings.speed).size() * (RESPONSE_SIZE + BAUDRATE_CHECKS * DEVICE_INFO_RESPONSE_SIZE);
+    case Kind::openMemory:
+      return OPEN_MEMORY_RESPONSE_SIZE;
+    case Kind::read:
+      return RESPONSE_SIZE + r.length;
+    default:
+      return RESPONSE_SIZE;
+  }
+}
+
+std::chrono::microseconds Planner::time(const Request& r, const Settings& settings){
+  /* requests up to the baudrate switch run at the rate of the bootloader after reset */
+  switch(r.kind){
+    case Kind::ispEntry:
+      return settings.resetPulse + settings.ispReady + wire(sent(r, settings) + received(r, settings), K32W061::ISP_BAUDRATE) + settings.turnaround;
+    case Kind::baudrate:
+      if(settings.speed == K32W061::ISP_BAUDRATE){
+        return std::chrono::microseconds(0);
+      }
+      return wire(sent(r, settings) + received(r, settings), K32W061::ISP_BAUDRATE) + settings.turnaround;
+    case Kind::negotiate:{
+      std::chrono::microseconds total(0);
+      uint32_t current = K32W061::ISP_BAUDRATE;
+      for(auto rate : negotiationSteps(settings.speed)){
+        total += wire(BAUDRATE_SIZE + RESPONSE_SIZE, current) + settings.turnaround;
+        total += BAUDRATE_CHECKS * (wire(DEVICE_INFO_SIZE + DEVICE_INFO_RESPONSE_SIZE, rate) + settings.turnaround);
+        current = rate;
+      }
+      return total;
+    }
+    case Kind::erase:
+      return wire(sent(r, settings) + received(r, settings), settings.speed) + settings.turnaround + settings.erasePerPage * pages(r.length);
+    case Kind::blankCheck:
+      return wire(sent(r, settings) + received(r, settings), settings.speed) + settings.turnaround +
+             std::chrono::milliseconds(K32W061::BLANK_CHECK_MS_PER_PAGE) * pages(r.length);
+    case Kind::write:
+    case Kind::frame:{
+      /* the next frame goes out while earlier ones are answered, the window
+       * hides the turnaround until the line itself is the limit */
+      auto out = wire(sent(r, settings), settings.speed);
+      auto roundTrip = out + wire(received(r, settings), settings.speed) + settings.turnaround;
+      return std::max(out, roundTrip / std::max(1u, settings.writeWindow));
+    }
+    default:
+      return wire(sent(r, settings) + received(r, settings), settings.speed) + settings.turnaround;
+  }
+}
+
+std::chrono::microseconds Planner::duration(const Settings& settings) const{
+  std::chrono::microseconds total(0);
+  bool isp = true;
+  for(const auto& r : plan){
+    auto at = settings;
+    if(isp){
+      at.speed = K32W061::ISP_BAUDRATE;
+    }
+    if(r.kind == Kind::baudrate || r.kind == Kind::negotiate){
+      total += time(r, settings);
+      isp = false;
+      continue;
+    }
+    total += time(r, at);
+    if(r.kind == Kind::reset){
+      isp = true;
+    }
+  }
+  return total;
+}
+
+std::string Planner::kindToString(Kind kind){
+  switch(kind){
+    case Kind::ispEntry: return "EnableISPMode";
+    case Kind::deviceInfo: return "GetDeviceInfo";
+    case Kind::baudrate: return "SetBaudRate";
+    case Kind::negotiate: return "NegotiateBaudRate";
+    case Kind::openMemory: return "OpenMemoryForAccess";
+    case Kind::erase: return "EraseMemory";
+    case Kind::blankCheck: return "CheckBlankMemory";
+    case Kind::write: return "WriteMemory";
+    case Kind::frame: return "WriteFrame";
+    case Kind::read: return "ReadMemory";
+    case Kind::closeMemory: return "CloseMemory";
+    case Kind::reset: return "Reset";
+  }
+  return "";
+}
+
+void Planner::print(std::ostream& os, const Settings& settings) const{
+  os << "Plan at " << settings.speed << " baud, write window " << settings.writeWindow
+     << ", turnaround " << settings.turnaround.count() << " us" << std::endl;
+  os << std::left << std::setw(20) << "request" << std::setw(24) << "address" << std::right
+     << std::setw(8) << "frames" << std::setw(10) << "sent" << std::setw(10) << "received" << std::setw(12) << "ms" << std::endl;
+
+  std::size_t totalFrames = 0;
+  std::size_t totalSent = 0;
+  std::size_t totalReceived = 0;
+  Settings at = settings;
+  at.speed = K32W061::ISP_BAUDRATE;
+  for(std::size_t i = 0; i < plan.size(); ){
+    const auto& first = plan[i];
+    std::size_t end = i + 1;
+    std::size_t count = first.kind == Kind::negotiate ? negotiationSteps(settings.speed).size() * (1 + BAUDRATE_CHECKS) : 1;
+    std::size_t sentBytes = sent(first, settings);
+    std::size_t receivedBytes = received(first, settings);
+    auto elapsed = (first.kind == Kind::baudrate || first.kind == Kind::negotiate) ? Planner::time(first, settings) : Planner::time(first, at);
+    /* frames of a write or read at consecutive addresses */
+    while(end < plan.size() && (first.kind == Kind::write || first.kind == Kind::frame || first.kind == Kind::read) && plan[end].kind == first.kind &&
+          plan[end].address == plan[end - 1].address + plan[end - 1].length){
+      sentBytes += sent(plan[end], settings);
+      receivedBytes += received(plan[end], settings);
+      elapsed += Planner::time(plan[end], at);
+      count++;
+      end++;
+    }
+    if(first.kind == Kind::baudrate && settings.speed == K32W061::ISP_BAUDRATE){
+      count = 0;
+    }
+
+    /* a baudrate switch to the rate the bootloader already runs at is not sent */
+    if(count == 0){
+      i = end;
+      continue;
+    }
+    std::string address = "-";
+    if(first.kind == Kind::write || first.kind == Kind::frame || first.kind == Kind::read || first.kind == Kind::erase || first.kind == Kind::blankCheck){
+      const auto& last = plan[end - 1];
+      address = hex(first.address) + "-" + hex(last.address + last.length - 1);
+    }
+    os << std::left << std::setw(20) << kindToString(first.kind) << std::setw(24) << address << std::right
+       << std::setw(8) << count << std::setw(10) << sentBytes << std::setw(10) << receivedBytes
+       << std::setw(12) << std::fixed << std::setprecision(1) << elapsed.count() / 1000.0 << std::endl;
+    totalFrames += count;
+    totalSent += sentBytes;
+    totalReceived += receivedBytes;
+
+    if(first.kind == Kind::baudrate || first.kind == Kind::negotiate){
+      at.speed = settings.speed;
+    }else if(first.kind == Kind::reset){
+      at.speed = K32W061::ISP_BAUDRATE;
+    }
+    i = end;
+  }
+  os << std::left << std::setw(44) << "total" << std::right << std::setw(8) << totalFrames << std::setw(10) << totalSent
+     << std::setw(10) << totalReceived << std::setw(12) << std::fixed << std::setprecision(1) << duration(settings).count() / 1000.0 << std::endl;
+  os << "Predicted duration: " << std::setprecision(2) << duration(settings).count() / 1000000.0 << " s" << std::endl;
+}
+
+void Planner::compare(std::ostream& os, const Settings& settings) const{
+  os << "Predicted duration in s, * marks the planned settings" << std::endl;
+  os << std::setw(10) << "baudrate";
+  for(auto window : COMPARED_WINDOWS){
+    os << std::setw(11) << (std::string("window ") + std::to_string(window));
+  }
+  os << std::endl;
+  for(auto speed : K32W061::baudrates()){
+    os << std::setw(10) << speed;
+    for(auto window : COMPARED_WINDOWS){
+      auto at = settings;
+      at.speed = speed;
+      at.writeWindow = window;
+      bool planned = speed == settings.speed && window == settings.writeWindow;
+      os << std::setw(10) << std::fixed << std::setprecision(2) << duration(at).count() / 1000000.0 << (planned ? "*" : " ");
+    }
+    os << std::endl;
+  }
+}
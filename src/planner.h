@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _PLANNER_H_
+#define _PLANNER_H_
+
+#include "session.h"
+#include "frame_stream.h"
+#include "firmware_stream.h"
+#include "k32w061.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/* Dry run of a job: records the ISP requests Application would send, split
+ * into frames the same way, and predicts how long they take without
+ * touching a device. The requests do not depend on the settings, so one
+ * plan can be timed for several baudrates and write windows. */
+class Planner
+{
+public:
+  enum class Kind{
+    ispEntry,
+    deviceInfo,
+    /* SetBaudRate to Settings::speed */
+    baudrate,
+    /* the steps of Application::negotiateBaudrate up to Settings::speed */
+    negotiate,
+    openMemory,
+    erase,
+    blankCheck,
+    write,
+    /* precompiled write frame of a FrameStream, sent with the same window as write */
+    frame,
+    read,
+    closeMemory,
+    reset
+  };
+
+  struct Request{
+    Kind kind;
+    uint32_t address;
+    /* bytes written or read, the length of erases and blank checks */
+    std::size_t length;
+  };
+
+  struct Settings{
+    uint32_t speed = K32W061::ISP_BAUDRATE;
+    unsigned int writeWindow = 1;
+    /* from the end of a request on the wire until its response starts:
+     * USB latency, network round trip and the work of the bootloader */
+    std::chrono::microseconds turnaround{DEFAULT_TURNAROUND_US};
+    std::chrono::milliseconds resetPulse{1};
+    std::chrono::milliseconds ispReady{NOMINAL_ISP_READY_MS};
+    std::chrono::microseconds erasePerPage{K32W061::ERASE_MS_PER_PAGE * 1000};
+  };
+
+  static const unsigned int DEFAULT_TURNAROUND_US=1000;
+  /* bootloader start after reset if no profile knows better */
+  static const unsigned int NOMINAL_ISP_READY_MS=50;
+
+  void enterISPMode();
+  void deviceInfo();
+  void setBaudrate();
+  void negotiateBaudrate();
+  void program(const Session& session);
+  /* consumes the stream, like flashing it would */
+  void flashFirmware(FirmwareStream& fw);
+  void flashFirmware(const FrameStream& fw);
+  void verify(const Session& session);
+  void verify(const FrameStream& fw);
+  void dump(uint32_t address, uint32_t length);
+  void reset();
+
+  const std::vector<Request>& requests() const;
+  /* bytes of request and response on the wire */
+  static std::size_t sent(const Request& r, const Settings& settings);
+  static std::size_t received(const Request& r, const Settings& settings);
+  std::chrono::microseconds duration(const Settings& settings) const;
+
+  /* the requests, runs of equal frames at consecutive addresses on one line, and the totals */
+  void print(std::ostream& os, const Settings& settings) const;
+  /* predicted time for every baudrate of the bootloader and a few write windows */
+  void compare(std::ostream& os, const Settings& settings) const;
+
+  static std::string kindToString(Kind kind);
+
+private:
+  void add(Kind kind, uint32_t address=0, std::size_t length=0);
+  void frames(Kind kind, uint32_t address, std::size_t length);
+  /* time of r on its own, write frames share the line with the frames in flight */
+  static std::chrono::microseconds time(const Request& r, const Settings& settings);
+
+  std::vector<Request> plan;
+};
+
+#endif /* _PLANNER_H_ */
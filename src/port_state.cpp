@@ -0,0 +1,90 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "port_state.h"
+#include "state_lock.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+static bool parseLine(const std::string& line, std::string& interface, PortState::Entry& entry){
+  std::istringstream is(line);
+  long long updated = 0;
+  int unlocked = 0;
+  if(!(is >> interface >> entry.speed >> unlocked >> updated)){
+    return false;
+  }
+  entry.unlocked = unlocked != 0;
+  entry.updated = updated;
+  return true;
+}
+
+PortState::PortState(const std::string& path, std::time_t maxAge) : path(path), maxAge(maxAge){
+}
+
+bool PortState::lookup(const std::string& interface, Entry& entry) const{
+  StateLock lock(path, LOCK_SH);
+  std::ifstream ifs(path);
+  std::string line;
+  auto now = std::time(nullptr);
+  while(std::getline(ifs, line)){
+    std::string name;
+    Entry e;
+    if(parseLine(line, name, e) && name == interface){
+      if(now - e.updated > maxAge || e.updated > now){
+        return false;
+      }
+      entry = e;
+      return true;
+    }
+  }
+  return false;
+}
+
+void PortState::store(const std::string& interface, uint32_t speed, bool unlocked){
+  Entry entry{speed, unlocked, std::time(nullptr)};
+  update(interface, &entry);
+}
+
+void PortState::forget(const std::string& interface){
+  update(interface, nullptr);
+}
+
+void PortState::update(const std::string& interface, const Entry* entry){
+  StateLock lock(path, LOCK_EX);
+  std::vector<std::string> lines;
+  {
+    std::ifstream ifs(path);
+    std::string line;
+    while(std::getline(ifs, line)){
+      std::string name;
+      Entry e;
+      if(parseLine(line, name, e) && name != interface){
+        lines.push_back(line);
+      }
+    }
+  }
+  if(entry){
+    std::ostringstream os;
+    os << interface << " " << entry->speed << " " << (entry->unlocked ? 1 : 0) << " " << static_cast<long long>(entry->updated);
+    lines.push_back(os.str());
+  }
+
+  StateLock::replace(path, lines);
+}
+
+std::string PortState::defaultPath(){
+  auto runtime = std::getenv("XDG_RUNTIME_DIR");
+  if(runtime != nullptr && runtime[0] != '\0'){
+    return std::string(runtime) + "/nxp-isp.state";
+  }
+  /* nowhere private to keep it, --warm needs an explicit file then */
+  return "";
+}
@@ -0,0 +1,50 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _PORT_STATE_H_
+#define _PORT_STATE_H_
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+/* Remembers per port in which state the last invocation left the
+ * bootloader, so the next one can continue the ISP session instead of
+ * entering it again. One line per port:
+ *
+ *   <interface> <baudrate> <unlocked> <unix time>
+ *
+ * The file is locked (through <path>.lock) while it is read or rewritten,
+ * several processes can share it. */
+class PortState
+{
+public:
+  struct Entry{
+    uint32_t speed;
+    bool unlocked;
+    std::time_t updated;
+  };
+
+  /* entries older than maxAge seconds are ignored */
+  explicit PortState(const std::string& path, std::time_t maxAge=300);
+
+  bool lookup(const std::string& interface, Entry& entry) const;
+  void store(const std::string& interface, uint32_t speed, bool unlocked);
+  void forget(const std::string& interface);
+
+  /* $XDG_RUNTIME_DIR/nxp-isp.state, empty without a runtime directory */
+  static std::string defaultPath();
+
+private:
+  void update(const std::string& interface, const Entry* entry);
+
+  std::string path;
+  std::time_t maxAge;
+};
+
+#endif /* _PORT_STATE_H_ */
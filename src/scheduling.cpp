@@ -0,0 +1,186 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "scheduling.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+#include <boost/log/trivial.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int parseNumber(const std::string& str, const std::string& what){
+  std::size_t pos = 0;
+  int value = 0;
+  try{
+    value = std::stoi(str, &pos, 10);
+  }catch(const std::exception&){
+    pos = 0;
+  }
+  if(str.empty() || pos != str.size()){
+    throw std::runtime_error(std::string("Invalid ") + what + std::string(" \"") + str + std::string("\""));
+  }
+  return value;
+}
+
+bool Scheduling::Settings::empty() const{
+  return cpus.empty() && policy == Policy::inherit && !lockMemory;
+}
+
+std::vector<int> Scheduling::parseCpus(const std::string& str){
+  std::vector<std::string> items;
+  boost::algorithm::split(items, str, boost::is_any_of(","));
+  std::vector<int> cpus;
+  for(const auto& item : items){
+    auto dash = item.find('-');
+    int first = parseNumber(item.substr(0, dash), "CPU");
+    int last = dash == std::string::npos ? first : parseNumber(item.substr(dash + 1), "CPU");
+    if(first < 0 || last < first || last >= CPU_SETSIZE){
+      throw std::runtime_error(std::string("Invalid CPU range \"") + item + std::string("\""));
+    }
+    for(int cpu = first; cpu <= last; cpu++){
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+void Scheduling::parsePolicy(const std::string& str, Settings& settings){
+  auto colon = str.find(':');
+  auto name = str.substr(0, colon);
+  if(name == "fifo"){
+    settings.policy = Policy::fifo;
+    settings.priority = colon == std::string::npos ? 50 : parseNumber(str.substr(colon + 1), "priority");
+    if(settings.priority < sched_get_priority_min(SCHED_FIFO) || settings.priority > sched_get_priority_max(SCHED_FIFO)){
+      throw std::runtime_error(std::string("SCHED_FIFO priority ") + std::to_string(settings.priority) + std::string(" is out of range"));
+    }
+  }else if(name == "nice" && colon != std::string::npos){
+    settings.policy = Policy::nice;
+    settings.priority = parseNumber(str.substr(colon + 1), "nice value");
+    if(settings.priority < -20 || settings.priority > 19){
+      throw std::runtime_error(std::string("Nice value ") + std::to_string(settings.priority) + std::string(" is out of range"));
+    }
+  }else{
+    throw std::runtime_error(std::string("Unknown scheduling \"") + str + std::string("\", expected fifo[:PRIORITY] or nice:VALUE"));
+  }
+}
+
+/* every port keeps the CPU it got first, so a port's thread does not
+ * wander between CPUs from one job to the next */
+static int cpuOf(const std::vector<int>& cpus, const std::string& interface){
+  static std::mutex mutex;
+  static std::map<std::string, std::size_t> ports;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = ports.find(interface);
+  if(it == ports.end()){
+    it = ports.emplace(interface, ports.size()).first;
+  }
+  return cpus[it->second % cpus.size()];
+}
+
+std::string Scheduling::apply(const Settings& settings, const std::string& interface){
+  if(!settings.cpus.empty()){
+    int cpu = cpuOf(settings.cpus, interface);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(err != 0){
+      BOOST_LOG_TRIVIAL(warning) << "Could not pin " << interface << " to CPU " << cpu << ": " << strerror(err);
+    }
+  }
+
+  if(settings.policy == Policy::fifo){
+    sched_param param{};
+    param.sched_priority = settings.priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if(err != 0){
+      BOOST_LOG_TRIVIAL(warning) << "Could not switch " << interface << " to SCHED_FIFO: " << strerror(err);
+    }
+  }else if(settings.policy == Policy::nice){
+    /* on Linux the nice value is per thread */
+    if(setpriority(PRIO_PROCESS, syscall(SYS_gettid), settings.priority) < 0){
+      BOOST_LOG_TRIVIAL(warning) << "Could not set nice value " << settings.priority << " for " << interface << ": " << strerror(errno);
+    }
+  }
+
+  if(settings.lockMemory){
+    static std::once_flag locked;
+    std::call_once(locked, [](){
+      if(mlockall(MCL_CURRENT | MCL_FUTURE) < 0){
+        BOOST_LOG_TRIVIAL(warning) << "Could not lock memory: " << strerror(errno);
+      }
+    });
+  }
+
+  auto achieved = describe();
+  BOOST_LOG_TRIVIAL(info) << "Scheduling of " << interface << ": " << achieved;
+  return achieved;
+}
+
+static bool memoryLocked(){
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while(std::getline(status, line)){
+    if(boost::algorithm::starts_with(line, "VmLck:")){
+      std::istringstream iss(line.substr(6));
+      unsigned long kb = 0;
+      iss >> kb;
+      return kb > 0;
+    }
+  }
+  return false;
+}
+
+std::string Scheduling::describe(){
+  std::ostringstream oss;
+  int policy = 0;
+  sched_param param{};
+  pthread_getschedparam(pthread_self(), &policy, &param);
+  switch(policy){
+    case SCHED_FIFO: oss << "SCHED_FIFO priority " << param.sched_priority; break;
+    case SCHED_RR: oss << "SCHED_RR priority " << param.sched_priority; break;
+    default:
+      oss << (policy == SCHED_BATCH ? "SCHED_BATCH" : policy == SCHED_IDLE ? "SCHED_IDLE" : "SCHED_OTHER")
+          << " nice " << getpriority(PRIO_PROCESS, syscall(SYS_gettid));
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0){
+    /* same format as parseCpus */
+    std::vector<std::string> ranges;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+      if(!CPU_ISSET(cpu, &set)){
+        continue;
+      }
+      int last = cpu;
+      while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set)){
+        last++;
+      }
+      ranges.push_back(last == cpu ? std::to_string(cpu) : std::to_string(cpu) + std::string("-") + std::to_string(last));
+      cpu = last;
+    }
+    oss << (CPU_COUNT(&set) == 1 ? ", CPU " : ", CPUs ") << boost::algorithm::join(ranges, ",");
+  }
+
+  if(memoryLocked()){
+    oss << ", memory locked";
+  }
+  return oss.str();
+}
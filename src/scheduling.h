@@ -0,0 +1,54 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _SCHEDULING_H_
+#define _SCHEDULING_H_
+
+#include <string>
+#include <vector>
+
+/* Scheduling of the thread that talks to one port. The ISP protocol is
+ * stop-and-wait, so every wakeup delay of that thread adds directly to the
+ * flash time. */
+class Scheduling
+{
+public:
+  enum class Policy{
+    inherit,
+    fifo,
+    nice
+  };
+
+  struct Settings{
+    /* ports are spread round robin over these CPUs, in the order they are
+     * first used. Empty keeps the inherited affinity */
+    std::vector<int> cpus;
+    Policy policy = Policy::inherit;
+    /* SCHED_FIFO priority or nice value */
+    int priority = 0;
+    /* locks all current and future pages of the process */
+    bool lockMemory = false;
+
+    bool empty() const;
+  };
+
+  /* CPU list like 2,3,6-7 */
+  static std::vector<int> parseCpus(const std::string& str);
+  /* fifo, fifo:PRIORITY or nice:VALUE */
+  static void parsePolicy(const std::string& str, Settings& settings);
+
+  /* applies settings to the calling thread, which serves interface.
+   * Settings that are not permitted are logged and skipped. Returns the
+   * achieved scheduling, see describe() */
+  static std::string apply(const Settings& settings, const std::string& interface);
+  /* policy, priority, CPUs and memory lock of the calling thread, e.g.
+   * "SCHED_FIFO priority 50, CPU 2, memory locked" */
+  static std::string describe();
+};
+
+#endif /* _SCHEDULING_H_ */
@@ -0,0 +1,189 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "session.h"
+#include "k32w061.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+
+static uint32_t parseAddress(const std::string& str, const std::string& spec){
+  std::size_t pos = 0;
+  unsigned long value = 0;
+  try{
+    value = std::stoul(str, &pos, 0);
+  }catch(const std::exception&){
+    pos = 0;
+  }
+  if(str.empty() || pos != str.size() || value > UINT32_MAX){
+    throw std::runtime_error(std::string("Invalid address \"") + str + std::string("\" in \"") + spec + std::string("\""));
+  }
+  return value;
+}
+
+static std::string hex(uint64_t value){
+  char buf[20];
+  snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(value));
+  return buf;
+}
+
+MCU::MemoryID Session::stringToMemory(const std::string& str){
+  auto name = boost::algorithm::to_upper_copy(str);
+  for(auto id : {MCU::MemoryID::flash, MCU::MemoryID::psect, MCU::MemoryID::pflash, MCU::MemoryID::config,
+                 MCU::MemoryID::efuse, MCU::MemoryID::rom, MCU::MemoryID::ram0, MCU::MemoryID::ram1}){
+    if(name == memoryToString(id)){
+      return id;
+    }
+  }
+  throw std::runtime_error(std::string("Unknown Memory Type \"") + str + std::string("\""));
+}
+
+std::string Session::memoryToString(MCU::MemoryID id){
+  switch(id){
+    case MCU::MemoryID::flash: return "FLASH";
+    case MCU::MemoryID::psect: return "PSECT";
+    case MCU::MemoryID::pflash: return "PFLASH";
+    case MCU::MemoryID::config: return "CONFIG";
+    case MCU::MemoryID::efuse: return "EFUSE";
+    case MCU::MemoryID::rom: return "ROM";
+    case MCU::MemoryID::ram0: return "RAM0";
+    case MCU::MemoryID::ram1: return "RAM1";
+  }
+  return std::to_string(id);
+}
+
+std::pair<MCU::MemoryID, Session::Range> Session::parseRange(const std::string& spec){
+  auto colon = spec.find(':');
+  auto memory = stringToMemory(spec.substr(0, colon));
+  if(colon == std::string::npos){
+    auto info = K32W061::memoryGeometry(memory);
+    return std::make_pair(memory, Range{info.base, info.size});
+  }
+  auto range = spec.substr(colon + 1);
+  auto plus = range.find('+');
+  if(plus == std::string::npos){
+    throw std::runtime_error(std::string("Invalid range \"") + spec + std::string("\", expected MEMORY:ADDRESS+LENGTH"));
+  }
+  return std::make_pair(memory, Range{parseAddress(range.substr(0, plus), spec), parseAddress(range.substr(plus + 1), spec)});
+}
+
+void Session::addErase(const std::string& spec){
+  auto range = parseRange(spec);
+  addErase(range.first, range.second.address, range.second.length);
+}
+
+void Session::addErase(MCU::MemoryID memory){
+  auto info = K32W061::memoryGeometry(memory);
+  addErase(memory, info.base, info.size);
+}
+
+void Session::addErase(MCU::MemoryID memory, uint32_t address, uint32_t length){
+  auto info = K32W061::memoryGeometry(memory);
+  if(!info.writable){
+    throw std::runtime_error(memoryToString(memory) + std::string(" can not be erased"));
+  }
+  if(length == 0 || address < info.base || uint64_t(address) + length > uint64_t(info.base) + info.size){
+    throw std::runtime_error(std::string("Erase range ") + hex(address) + std::string("+") + hex(length) + std::string(" is outside of ") + memoryToString(memory));
+  }
+  if((address - info.base) % info.pageSize != 0 || length % info.pageSize != 0){
+    throw std::runtime_error(std::string("Erase range ") + hex(address) + std::string("+") + hex(length) + std::string(" is not aligned to the ") + std::to_string(info.pageSize) + std::string(" byte pages of ") + memoryToString(memory));
+  }
+
+  /* keep the ranges sorted and merge overlapping or adjacent ones, so a
+   * full erase swallows all partial erases of the same memory */
+  auto& erases = step(memory).erases;
+  erases.push_back(Range{address, length});
+  std::sort(erases.begin(), erases.end(), [](const Range& a, const Range& b){ return a.address < b.address; });
+  std::vector<Range> merged;
+  for(const auto& r : erases){
+    if(!merged.empty() && uint64_t(merged.back().address) + merged.back().length >= r.address){
+      auto end = std::max<uint64_t>(uint64_t(merged.back().address) + merged.back().length, uint64_t(r.address) + r.length);
+      merged.back().length = end - merged.back().address;
+    }else{
+      merged.push_back(r);
+    }
+  }
+  erases.swap(merged);
+}
+
+void Session::addWrite(const std::string& spec, const Loader& load){
+  auto colon = spec.find(':');
+  if(colon == std::string::npos || colon + 1 == spec.size()){
+    throw std::runtime_error(std::string("Invalid write \"") + spec + std::string("\", expected MEMORY[@OFFSET]:FILE"));
+  }
+  auto target = spec.substr(0, colon);
+  auto path = spec.substr(colon + 1);
+  uint32_t offset = 0;
+  auto at = target.find('@');
+  if(at != std::string::npos){
+    offset = parseAddress(target.substr(at + 1), spec);
+    target = target.substr(0, at);
+  }
+  auto memory = stringToMemory(target);
+  auto info = K32W061::memoryGeometry(memory);
+  std::shared_ptr<const FirmwareImage> image;
+  if(load){
+    image = load(path, uint64_t(info.base) + info.size);
+  }else{
+    image = std::make_shared<FirmwareImage>(path, uint64_t(info.base) + info.size);
+  }
+  addWrite(memory, offset, image);
+}
+
+void Session::addWrite(MCU::MemoryID memory, uint32_t offset, std::shared_ptr<const FirmwareImage> image){
+  auto info = K32W061::memoryGeometry(memory);
+  if(!info.writable){
+    throw std::runtime_error(memoryToString(memory) + std::string(" can not be written"));
+  }
+  for(const auto& seg : image->segments()){
+    uint64_t address = uint64_t(seg.address) + offset;
+    if(address < info.base || address + seg.size > uint64_t(info.base) + info.size){
+      throw std::runtime_error(std::string("Write of ") + std::to_string(seg.size) + std::string(" bytes at ") + hex(address) + std::string(" is outside of ") + memoryToString(memory));
+    }
+  }
+
+  auto& writes = step(memory).writes;
+  auto start = [](const Write& w){ return w.image->segments().empty() ? uint64_t(w.offset) : uint64_t(w.offset) + w.image->segments().front().address; };
+  Write write{offset, image};
+  writes.insert(std::upper_bound(writes.begin(), writes.end(), write, [&](const Write& a, const Write& b){ return start(a) < start(b); }), write);
+}
+
+bool Session::empty() const{
+  return stepList.empty();
+}
+
+const std::vector<Session::Step>& Session::steps() const{
+  return stepList;
+}
+
+bool Session::covers(MCU::MemoryID memory, uint32_t address, std::size_t size) const{
+  for(const auto& s : stepList){
+    if(s.memory != memory){
+      continue;
+    }
+    for(const auto& w : s.writes){
+      for(const auto& seg : w.image->segments()){
+        uint64_t begin = uint64_t(seg.address) + w.offset;
+        if(address >= begin && address + size <= begin + seg.size){
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+Session::Step& Session::step(MCU::MemoryID memory){
+  auto it = std::lower_bound(stepList.begin(), stepList.end(), memory, [](const Step& s, MCU::MemoryID id){ return s.memory < id; });
+  if(it == stepList.end() || it->memory != memory){
+    it = stepList.insert(it, Step{memory, {}, {}});
+  }
+  return *it;
+}
@@ -0,0 +1,74 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _SESSION_H_
+#define _SESSION_H_
+
+#include "mcu.h"
+#include "firmware_image.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* All erase and write operations of one ISP session, grouped per memory so
+ * every memory is opened exactly once.
+ *
+ * Erases are given as MEMORY or MEMORY:ADDRESS+LENGTH, writes as
+ * MEMORY[@OFFSET]:FILE. OFFSET is added to the addresses of the image,
+ * so raw binaries can be placed anywhere inside the memory.
+ */
+class Session
+{
+public:
+  struct Range{
+    uint32_t address;
+    uint32_t length;
+  };
+
+  struct Write{
+    uint32_t offset;
+    std::shared_ptr<const FirmwareImage> image;
+  };
+
+  /* steps are ordered by memory ID, inside a step all erases run before the
+   * writes, both sorted by address */
+  struct Step{
+    MCU::MemoryID memory;
+    std::vector<Range> erases;
+    std::vector<Write> writes;
+  };
+
+  void addErase(const std::string& spec);
+  void addErase(MCU::MemoryID memory);
+  void addErase(MCU::MemoryID memory, uint32_t address, uint32_t length);
+  using Loader = std::function<std::shared_ptr<const FirmwareImage>(const std::string& path, std::size_t capacity)>;
+
+  void addWrite(const std::string& spec, const Loader& load=nullptr);
+  void addWrite(MCU::MemoryID memory, uint32_t offset, std::shared_ptr<const FirmwareImage> image);
+
+  bool empty() const;
+  const std::vector<Step>& steps() const;
+  /* true if [address, address+size) of memory is written */
+  bool covers(MCU::MemoryID memory, uint32_t address, std::size_t size) const;
+
+  /* MEMORY or MEMORY:ADDRESS+LENGTH, the whole memory if no range is given */
+  static std::pair<MCU::MemoryID, Range> parseRange(const std::string& spec);
+  static MCU::MemoryID stringToMemory(const std::string& str);
+  static std::string memoryToString(MCU::MemoryID id);
+
+private:
+  Step& step(MCU::MemoryID memory);
+
+  std::vector<Step> stepList;
+};
+
+#endif /* _SESSION_H_ */
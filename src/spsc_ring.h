@@ -0,0 +1,76 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/* Lock-free byte ring for exactly one producer and one consumer thread.
+ * head is only written by the producer, tail only by the consumer, so
+ * acquire/release on the two indices is all the synchronization needed.
+ * SIZE must be a power of two, the indices run freely and wrap. */
+template<std::size_t SIZE>
+class SpscRing
+{
+  static_assert(SIZE != 0 && (SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+public:
+  /* producer: copies as much of data as fits, returns the number of bytes */
+  std::size_t write(const uint8_t* data, std::size_t size){
+    auto head = headIndex.load(std::memory_order_relaxed);
+    auto tail = tailIndex.load(std::memory_order_acquire);
+    auto count = std::min(size, SIZE - (head - tail));
+    copy(data, count, head, [this](std::size_t pos, const uint8_t* src, std::size_t n){ std::copy(src, src + n, buffer.begin() + pos); });
+    headIndex.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  /* consumer: moves up to size bytes into data, returns the number of bytes */
+  std::size_t read(uint8_t* data, std::size_t size){
+    auto tail = tailIndex.load(std::memory_order_relaxed);
+    auto head = headIndex.load(std::memory_order_acquire);
+    auto count = std::min(size, head - tail);
+    copy(data, count, tail, [this](std::size_t pos, uint8_t* dst, std::size_t n){ std::copy(buffer.begin() + pos, buffer.begin() + pos + n, dst); });
+    tailIndex.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  /* bytes waiting for the consumer, exact only in the consumer thread */
+  std::size_t size() const{
+    return headIndex.load(std::memory_order_acquire) - tailIndex.load(std::memory_order_acquire);
+  }
+
+  /* free bytes, exact only in the producer thread */
+  std::size_t space() const{
+    return SIZE - size();
+  }
+
+private:
+  /* copies count bytes in at most two pieces, split where the ring wraps */
+  template<typename Pointer, typename Copy>
+  static void copy(Pointer data, std::size_t count, std::size_t index, Copy piece){
+    auto pos = index & (SIZE - 1);
+    auto first = std::min(count, SIZE - pos);
+    piece(pos, data, first);
+    piece(0, data + first, count - first);
+  }
+
+  /* the padding keeps producer and consumer index on separate cache
+   * lines, alignas(64) would need the aligned new of C++17 */
+  std::atomic<std::size_t> headIndex{0};
+  char padding[64];
+  std::atomic<std::size_t> tailIndex{0};
+  std::array<uint8_t, SIZE> buffer;
+};
+
+#endif /* _SPSC_RING_H_ */
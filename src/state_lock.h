@@ -0,0 +1,76 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _STATE_LOCK_H_
+#define _STATE_LOCK_H_
+
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+/* holds a lock on a state file for the lifetime of the object. The state
+ * file itself is replaced on every update, so the lock is taken on a
+ * separate file next to it. Neither follows a symlink planted there */
+class StateLock{
+public:
+  StateLock(const std::string& path, int operation){
+    fd = ::open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if(fd < 0){
+      throw std::runtime_error(std::string("Could not open state file ") + path);
+    }
+    if(flock(fd, operation) < 0){
+      ::close(fd);
+      throw std::runtime_error(std::string("Could not lock state file ") + path);
+    }
+  }
+  ~StateLock(){
+    ::close(fd);
+  }
+
+  /* replaces the file atomically, so it is never seen half written. Call
+   * with the lock held exclusively */
+  static void replace(const std::string& path, const std::vector<std::string>& lines){
+    /* a fresh name in the same directory, created by us with mode 0600 */
+    auto tmp = path + ".XXXXXX";
+    int out = mkstemp(&tmp[0]);
+    if(out < 0){
+      throw std::runtime_error(std::string("Could not write state file ") + path);
+    }
+    std::string content;
+    for(const auto& l : lines){
+      content += l + "\n";
+    }
+    bool written = true;
+    for(std::size_t done = 0; written && done < content.size();){
+      auto n = ::write(out, content.data() + done, content.size() - done);
+      if(n > 0){
+        done += n;
+      }else if(n < 0 && errno != EINTR){
+        written = false;
+      }
+    }
+    if(::close(out) != 0 || !written){
+      std::remove(tmp.c_str());
+      throw std::runtime_error(std::string("Could not write state file ") + path);
+    }
+    if(std::rename(tmp.c_str(), path.c_str()) != 0){
+      std::remove(tmp.c_str());
+      throw std::runtime_error(std::string("Could not replace state file ") + path);
+    }
+  }
+
+private:
+  int fd;
+};
+
+#endif /* _STATE_LOCK_H_ */
@@ -0,0 +1,179 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "station.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes/scoped_attribute.hpp>
+#include <boost/log/attributes/constant.hpp>
+
+Station::Station(const std::string& path, Match match, Task task, std::chrono::milliseconds settle) :
+  match(match), task(task), settle(settle), passCount(0), failCount(0)
+{
+  auto slash = path.rfind('/');
+  if(slash == std::string::npos){
+    directory = "/dev";
+    pattern = path;
+  }else{
+    directory = slash == 0 ? std::string("/") : path.substr(0, slash);
+    pattern = path.substr(slash + 1);
+  }
+
+  notify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if(notify < 0){
+    throw std::runtime_error(std::string("Could not create inotify instance: ") + strerror(errno));
+  }
+  if(inotify_add_watch(notify, directory.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) < 0){
+    close(notify);
+    throw std::runtime_error(std::string("Could not watch ") + directory + std::string(": ") + strerror(errno));
+  }
+  if(pipe2(wake, O_CLOEXEC | O_NONBLOCK) < 0){
+    close(notify);
+    throw std::runtime_error(std::string("Could not create pipe: ") + strerror(errno));
+  }
+
+  /* boards already connected are not flashed until they are re-plugged */
+  DIR* dir = opendir(directory.c_str());
+  if(dir != nullptr){
+    while(auto entry = readdir(dir)){
+      if(fnmatch(pattern.c_str(), entry->d_name, 0) == 0){
+        ports[entry->d_name].present = true;
+        BOOST_LOG_TRIVIAL(info) << directory << "/" << entry->d_name << " already present, re-plug to flash";
+      }
+    }
+    closedir(dir);
+  }
+}
+
+Station::~Station(){
+  reap(true);
+  close(notify);
+  close(wake[0]);
+  close(wake[1]);
+}
+
+void Station::stop(){
+  char c = 0;
+  if(write(wake[1], &c, 1) < 0){
+    /* pipe full, the station is stopping anyway */
+  }
+}
+
+std::size_t Station::passed() const{
+  return passCount;
+}
+
+std::size_t Station::failed() const{
+  return failCount;
+}
+
+void Station::run(){
+  BOOST_LOG_TRIVIAL(info) << "Waiting for devices " << directory << "/" << pattern;
+  alignas(struct inotify_event) char buffer[4096];
+  struct pollfd fds[2] = {{notify, POLLIN, 0}, {wake[0], POLLIN, 0}};
+  while(true){
+    auto ret = poll(fds, 2, -1);
+    if(ret < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      throw std::runtime_error(std::string("Could not poll for devices: ") + strerror(errno));
+    }
+    if(fds[1].revents){
+      break;
+    }
+
+    auto len = read(notify, buffer, sizeof(buffer));
+    if(len <= 0){
+      continue;
+    }
+    reap(false);
+    for(char* p = buffer; p < buffer + len; ){
+      auto event = reinterpret_cast<const struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+      if(event->len == 0 || fnmatch(pattern.c_str(), event->name, 0) != 0){
+        continue;
+      }
+      if(event->mask & (IN_CREATE | IN_MOVED_TO)){
+        added(event->name);
+      }else if(event->mask & (IN_DELETE | IN_MOVED_FROM)){
+        removed(event->name);
+      }
+    }
+  }
+  reap(true);
+}
+
+void Station::added(const std::string& name){
+  auto& port = ports[name];
+  if(port.worker.joinable()){
+    BOOST_LOG_TRIVIAL(warning) << name << " re-appeared while it is still being flashed";
+    return;
+  }
+  if(port.present){
+    return;
+  }
+  port.present = true;
+  port.done = std::make_shared<std::atomic<bool>>(false);
+
+  auto dev = directory + "/" + name;
+  auto done = port.done;
+  port.worker = std::thread([this, dev, done](){
+    BOOST_LOG_SCOPED_THREAD_TAG("Device", dev);
+    /* give udev the time to apply permissions before the node is opened */
+    std::this_thread::sleep_for(settle);
+    auto start = std::chrono::steady_clock::now();
+    try{
+      if(!match(dev)){
+        BOOST_LOG_TRIVIAL(info) << "Ignore device, it does not match";
+      }else{
+        BOOST_LOG_TRIVIAL(info) << "New device";
+        task(dev);
+        passCount++;
+        BOOST_LOG_TRIVIAL(warning) << "PASS in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s, unplug the board";
+      }
+    }catch(const std::exception& e){
+      failCount++;
+      BOOST_LOG_TRIVIAL(error) << "FAIL: " << e.what();
+    }
+    *done = true;
+  });
+}
+
+void Station::removed(const std::string& name){
+  auto it = ports.find(name);
+  if(it == ports.end()){
+    return;
+  }
+  it->second.present = false;
+  BOOST_LOG_TRIVIAL(info) << directory << "/" << name << " removed, ready for the next board";
+  reap(false);
+}
+
+void Station::reap(bool all){
+  for(auto it = ports.begin(); it != ports.end(); ){
+    auto& port = it->second;
+    if(port.worker.joinable() && (all || *port.done)){
+      port.worker.join();
+    }
+    if(!port.present && !port.worker.joinable()){
+      it = ports.erase(it);
+    }else{
+      ++it;
+    }
+  }
+}
@@ -0,0 +1,65 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _STATION_H_
+#define _STATION_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+/* Hot-plug flashing station. Watches a directory (normally /dev) with
+ * inotify and runs the task on every new entry matching the pattern and
+ * the match function. A port is flashed once per plug-in and is armed
+ * again as soon as its device node disappears. Devices present at start
+ * up are left alone until they are re-plugged. */
+class Station
+{
+public:
+  using Match = std::function<bool(const std::string&)>;
+  using Task = std::function<void(const std::string&)>;
+
+  Station(const std::string& pattern, Match match, Task task, std::chrono::milliseconds settle=std::chrono::milliseconds(500));
+  ~Station();
+
+  /* blocks until stop() is called */
+  void run();
+  /* async-signal-safe */
+  void stop();
+
+  std::size_t passed() const;
+  std::size_t failed() const;
+
+private:
+  struct Port{
+    bool present = false;
+    std::thread worker;
+    std::shared_ptr<std::atomic<bool>> done;
+  };
+
+  void added(const std::string& name);
+  void removed(const std::string& name);
+  void reap(bool all);
+
+  std::string directory;
+  std::string pattern;
+  Match match;
+  Task task;
+  std::chrono::milliseconds settle;
+  int notify;
+  int wake[2];
+  std::map<std::string, Port> ports;
+  std::atomic<std::size_t> passCount;
+  std::atomic<std::size_t> failCount;
+};
+
+#endif /* _STATION_H_ */
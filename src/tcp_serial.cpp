@@ -0,0 +1,413 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "tcp_serial.h"
+#include "k32w061.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+#include <boost/log/trivial.hpp>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace{
+  /* Telnet, RFC 854 */
+  enum Telnet : uint8_t{
+    SE = 240,
+    SB = 250,
+    WILL = 251,
+    WONT = 252,
+    DO = 253,
+    DONT = 254,
+    IAC = 255
+  };
+  enum TelnetOption : uint8_t{
+    BINARY = 0,
+    SUPPRESS_GO_AHEAD = 3,
+    COM_PORT_OPTION = 44
+  };
+  /* client to server commands of RFC 2217, the server answers with +100 */
+  enum ComPortCommand : uint8_t{
+    SET_BAUDRATE = 1,
+    SET_DATASIZE = 2,
+    SET_PARITY = 3,
+    SET_STOPSIZE = 4,
+    SET_CONTROL = 5,
+    PURGE_DATA = 12
+  };
+  enum ControlValue : uint8_t{
+    DTR_ON = 8,
+    DTR_OFF = 9,
+    RTS_ON = 11,
+    RTS_OFF = 12
+  };
+  const uint8_t PARITY_NONE = 1;
+  const uint8_t STOPSIZE_1 = 1;
+  const uint8_t PURGE_RECEIVE = 1;
+
+  bool agreed(uint8_t option){
+    return option == BINARY || option == SUPPRESS_GO_AHEAD || option == COM_PORT_OPTION;
+  }
+}
+
+const unsigned int TcpSerial::TIMEOUT_MS;
+
+bool TcpSerial::isRemote(const std::string& interface){
+  return boost::algorithm::starts_with(interface, "tcp://") || boost::algorithm::starts_with(interface, "rfc2217://");
+}
+
+void TcpSerial::parse(const std::string& interface, Protocol& protocol, std::string& host, std::string& port){
+  auto scheme = interface.find("://");
+  if(scheme == std::string::npos || !isRemote(interface)){
+    throw std::runtime_error(std::string("Invalid remote port \"") + interface + std::string("\", expected tcp://HOST:PORT or rfc2217://HOST:PORT"));
+  }
+  protocol = interface.compare(0, scheme, "tcp") == 0 ? Protocol::raw : Protocol::rfc2217;
+  auto address = interface.substr(scheme + 3);
+  auto colon = address.rfind(':');
+  if(colon == std::string::npos || colon == 0 || colon + 1 == address.size()){
+    throw std::runtime_error(std::string("Invalid remote port \"") + interface + std::string("\", expected tcp://HOST:PORT or rfc2217://HOST:PORT"));
+  }
+  host = address.substr(0, colon);
+  port = address.substr(colon + 1);
+  if(host.size() > 2 && host.front() == '[' && host.back() == ']'){
+    host = host.substr(1, host.size() - 2);
+  }
+}
+
+TcpSerial::TcpSerial(){
+}
+
+TcpSerial::~TcpSerial(){
+  if(fd >= 0){
+    ::close(fd);
+  }
+}
+
+void TcpSerial::setTimeout(std::chrono::milliseconds timeout){
+  this->timeout = timeout;
+}
+
+void TcpSerial::setCancel(const std::atomic<bool>* cancel){
+  this->cancel = cancel;
+}
+
+void TcpSerial::open(const int vid, const int pid){
+  (void)vid;
+  (void)pid;
+  throw std::runtime_error("A remote serial port is opened by host and port");
+}
+
+void TcpSerial::open(std::string dev){
+  std::string host;
+  std::string port;
+  parse(dev, protocol, host, port);
+  name = dev;
+
+  struct addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* addresses = nullptr;
+  auto ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+  if(ret != 0){
+    throw std::runtime_error(std::string("Could not resolve ") + host + std::string(": ") + gai_strerror(ret));
+  }
+  /* a server that drops the handshake would block connect for minutes,
+   * all addresses share one deadline instead */
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  int error = 0;
+  for(auto a = addresses; a != nullptr && fd < 0 && error != ECANCELED; a = a->ai_next){
+    fd = ::socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a->ai_protocol);
+    if(fd < 0){
+      error = errno;
+      continue;
+    }
+    /* the handshake takes one round trip */
+    auto start = std::chrono::steady_clock::now();
+    int failed = 0;
+    if(::connect(fd, a->ai_addr, a->ai_addrlen) != 0){
+      failed = errno;
+      if(failed == EINPROGRESS){
+        socklen_t length = sizeof(failed);
+        failed = awaitWritable(deadline);
+        if(failed == 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &failed, &length) != 0){
+          failed = errno;
+        }
+      }
+    }
+    if(failed != 0){
+      error = failed;
+      ::close(fd);
+      fd = -1;
+      continue;
+    }
+    roundTrip = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  }
+  freeaddrinfo(addresses);
+  if(error == ECANCELED){
+    throw MCU::Cancelled();
+  }
+  if(fd < 0){
+    throw std::runtime_error(std::string("Could not connect to ") + dev + std::string(": ") + strerror(error));
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  BOOST_LOG_TRIVIAL(info) << "Connected to " << dev << ", round trip " << roundTrip.count() << " us";
+
+  if(protocol == Protocol::rfc2217){
+    /* the replies are not waited for, they are dropped by decode */
+    send({IAC, WILL, COM_PORT_OPTION, IAC, WILL, BINARY, IAC, DO, BINARY,
+          IAC, WILL, SUPPRESS_GO_AHEAD, IAC, DO, SUPPRESS_GO_AHEAD});
+    setBaudrate(K32W061::ISP_BAUDRATE);
+    comPortCommand(SET_DATASIZE, {8});
+    comPortCommand(SET_PARITY, {PARITY_NONE});
+    comPortCommand(SET_STOPSIZE, {STOPSIZE_1});
+  }
+}
+
+bool TcpSerial::is_open(){
+  return fd >= 0;
+}
+
+int TcpSerial::send(const std::vector<uint8_t>& data){
+  std::size_t sent = 0;
+  /* the socket does not block, a server that stopped reading fails the
+   * send once it took nothing for the whole timeout */
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while(sent < data.size()){
+    auto ret = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if(ret < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      if(errno == EAGAIN || errno == EWOULDBLOCK){
+        auto waited = awaitWritable(deadline);
+        if(waited == ECANCELED){
+          throw MCU::Cancelled();
+        }
+        if(waited == 0){
+          continue;
+        }
+        BOOST_LOG_TRIVIAL(error) << name << " took no data for " << timeout.count() << " ms";
+        return -1;
+      }
+      BOOST_LOG_TRIVIAL(error) << "Sending to " << name << " failed: " << strerror(errno);
+      return -1;
+    }
+    sent += ret;
+    deadline = std::chrono::steady_clock::now() + timeout;
+  }
+  return sent;
+}
+
+int TcpSerial::awaitWritable(std::chrono::steady_clock::time_point deadline) const{
+  while(true){
+    if(cancel && *cancel){
+      return ECANCELED;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    if(left <= 0){
+      return ETIMEDOUT;
+    }
+    /* in slices, so a cancel is noticed while waiting */
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    auto ret = ::poll(&pfd, 1, std::min<long long>(left, K32W061::CANCEL_POLL_MS));
+    if(ret > 0){
+      /* errors are reported by the next call on the socket */
+      return 0;
+    }
+    if(ret < 0 && errno != EINTR){
+      return errno;
+    }
+  }
+}
+
+int TcpSerial::comPortCommand(uint8_t command, const std::vector<uint8_t>& value){
+  std::vector<uint8_t> frame{IAC, SB, COM_PORT_OPTION, command};
+  for(auto byte : value){
+    frame.push_back(byte);
+    if(byte == IAC){
+      frame.push_back(IAC);
+    }
+  }
+  frame.push_back(IAC);
+  frame.push_back(SE);
+  return send(frame) < 0 ? -1 : 0;
+}
+
+void TcpSerial::setLineMapping(const UARTLinux::LineMapping& lines){
+  bool mapped = lines.reset != UARTLinux::LineMapping::none || lines.isp != UARTLinux::LineMapping::none;
+  if(mapped && protocol != Protocol::rfc2217){
+    throw std::runtime_error(name + std::string(" has no modem control lines, use rfc2217:// to map reset and ISP select"));
+  }
+  this->lines = lines;
+  disableCBUSMode();
+}
+
+int TcpSerial::setCBUSPins(const FTDI::CBUSPins& pins){
+  if(lines.reset == UARTLinux::LineMapping::none && lines.isp == UARTLinux::LineMapping::none){
+    return 0;
+  }
+  modem = UARTLinux::modemBits(lines, pins, modem);
+  if(comPortCommand(SET_CONTROL, {uint8_t((modem & TIOCM_DTR) ? DTR_ON : DTR_OFF)}) != 0 ||
+     comPortCommand(SET_CONTROL, {uint8_t((modem & TIOCM_RTS) ? RTS_ON : RTS_OFF)}) != 0){
+    return -1;
+  }
+  return 0;
+}
+
+int TcpSerial::disableCBUSMode(){
+  /* all pins inputs: reset and ISP select released */
+  FTDI::CBUSPins pins = {};
+  return setCBUSPins(pins);
+}
+
+int TcpSerial::writeData(std::vector<uint8_t> data){
+  if(protocol == Protocol::rfc2217 && std::find(data.begin(), data.end(), IAC) != data.end()){
+    std::vector<uint8_t> escaped;
+    escaped.reserve(data.size() + 16);
+    for(auto byte : data){
+      escaped.push_back(byte);
+      if(byte == IAC){
+        escaped.push_back(IAC);
+      }
+    }
+    return send(escaped) < 0 ? -1 : data.size();
+  }
+  return send(data) < 0 ? -1 : data.size();
+}
+
+std::vector<uint8_t> TcpSerial::decode(const uint8_t* data, std::size_t size){
+  std::vector<uint8_t> decoded;
+  decoded.reserve(size);
+  for(std::size_t i=0;i<size;i++){
+    auto byte = data[i];
+    switch(rxState){
+      case RxState::data:
+        if(byte == IAC){
+          rxState = RxState::command;
+        }else{
+          decoded.push_back(byte);
+        }
+        break;
+      case RxState::command:
+        if(byte == IAC){
+          decoded.push_back(IAC);
+          rxState = RxState::data;
+        }else if(byte == SB){
+          rxState = RxState::subnegotiation;
+        }else if(byte >= WILL && byte <= DONT){
+          verb = byte;
+          rxState = RxState::option;
+        }else{
+          rxState = RxState::data;
+        }
+        break;
+      case RxState::option:
+        /* WILL/DO of the options asked for on connect confirm them */
+        if((verb == WILL || verb == DO) && !agreed(byte)){
+          send({IAC, uint8_t(verb == WILL ? DONT : WONT), byte});
+        }
+        rxState = RxState::data;
+        break;
+      case RxState::subnegotiation:
+        /* acknowledgements and line state notifications of the server */
+        if(byte == IAC){
+          rxState = RxState::subnegotiationCommand;
+        }
+        break;
+      case RxState::subnegotiationCommand:
+        rxState = byte == SE ? RxState::data : RxState::subnegotiation;
+        break;
+    }
+  }
+  return decoded;
+}
+
+std::vector<uint8_t> TcpSerial::readData(){
+  std::array<uint8_t, 4096> buf;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(readTimeout);
+  while(!closed){
+    int wait = -1;
+    if(readTimeout != 0){
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      if(left <= 0){
+        break;
+      }
+      wait = left;
+    }
+    struct pollfd pfd = {fd, POLLIN, 0};
+    auto ret = ::poll(&pfd, 1, wait);
+    if(ret < 0 && errno != EINTR){
+      break;
+    }
+    if(ret <= 0){
+      continue;
+    }
+    auto n = ::recv(fd, buf.data(), buf.size(), 0);
+    if(n < 0 && (errno == EINTR || errno == EAGAIN)){
+      continue;
+    }
+    if(n <= 0){
+      BOOST_LOG_TRIVIAL(error) << name << " closed the connection";
+      closed = true;
+      break;
+    }
+    if(protocol == Protocol::raw){
+      return std::vector<uint8_t>(buf.begin(), buf.begin() + n);
+    }
+    auto data = decode(buf.data(), n);
+    if(!data.empty()){
+      return data;
+    }
+  }
+  return {};
+}
+
+int TcpSerial::setReadTimeout(unsigned int milliseconds){
+  readTimeout = milliseconds;
+  return 0;
+}
+
+int TcpSerial::setBaudrate(uint32_t speed){
+  if(protocol != Protocol::rfc2217){
+    BOOST_LOG_TRIVIAL(error) << name << " can not change the baudrate of the remote port, use rfc2217://";
+    return -1;
+  }
+  BOOST_LOG_TRIVIAL(info) << "Set baudrate of " << name << " to " << speed;
+  std::vector<uint8_t> value{uint8_t(speed >> 24), uint8_t(speed >> 16), uint8_t(speed >> 8), uint8_t(speed)};
+  /* like tcflush on a local UART, bytes received at the old speed are garbage */
+  if(comPortCommand(SET_BAUDRATE, value) != 0 || comPortCommand(PURGE_DATA, {PURGE_RECEIVE}) != 0){
+    return -1;
+  }
+  return 0;
+}
+
+bool TcpSerial::supportsBaudrate(uint32_t speed) const{
+  return protocol == Protocol::rfc2217 || speed == K32W061::ISP_BAUDRATE;
+}
+
+void TcpSerial::flushInput(){
+  auto timeout = readTimeout;
+  readTimeout = std::chrono::duration_cast<std::chrono::milliseconds>(roundTrip + std::chrono::microseconds(999)).count() + 1;
+  while(!closed && !readData().empty()){
+  }
+  readTimeout = timeout;
+}
+
+std::chrono::microseconds TcpSerial::latency() const{
+  return roundTrip;
+}
@@ -0,0 +1,107 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _TCP_SERIAL_H_
+#define _TCP_SERIAL_H_
+
+#include "ftdi.hpp"
+#include "uart_linux.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/* Serial port of a serial-over-Ethernet server (ser2net, socat, access
+ * servers). tcp://HOST:PORT passes the bytes through unchanged, the port
+ * settings are fixed by the server. rfc2217://HOST:PORT speaks the Telnet
+ * COM-PORT-OPTION of RFC 2217, so the baudrate and the DTR/RTS lines of the
+ * remote port follow the ISP session.
+ *
+ * Writes only wait until the kernel took the bytes, the round trip of the
+ * link is measured on connect and reported by latency() so that
+ * K32W061::flashMemory keeps enough frames in flight to cover it. */
+class TcpSerial : public FTDI::Interface {
+public:
+  /* default deadline of connect and of a send the server takes nothing of */
+  static const unsigned int TIMEOUT_MS=5000;
+
+  enum class Protocol{
+    raw,
+    rfc2217
+  };
+
+  /* true for tcp:// and rfc2217:// */
+  static bool isRemote(const std::string& interface);
+  /* splits PROTOCOL://HOST:PORT, HOST may be a [bracketed] IPv6 address */
+  static void parse(const std::string& interface, Protocol& protocol, std::string& host, std::string& port);
+
+  TcpSerial();
+  virtual ~TcpSerial();
+
+  /* both apply from the next open on. Connect and send stop with
+   * MCU::Cancelled once *cancel is set */
+  void setTimeout(std::chrono::milliseconds timeout);
+  void setCancel(const std::atomic<bool>* cancel);
+
+  void open(const int vid, const int pid);
+  void open(std::string dev);
+  bool is_open();
+
+  int setCBUSPins(const FTDI::CBUSPins& pins);
+  int disableCBUSMode();
+
+  int writeData(std::vector<uint8_t> data);
+  std::vector<uint8_t> readData();
+  int setReadTimeout(unsigned int milliseconds);
+  int setBaudrate(uint32_t speed);
+  /* reads until the link stayed quiet for a round trip, bytes may still be
+   * on the way from the server */
+  void flushInput();
+  std::chrono::microseconds latency() const;
+  /* raw TCP stays at the speed configured on the server */
+  bool supportsBaudrate(uint32_t speed) const;
+  /* rfc2217 only: reset and ISP select on the DTR/RTS lines of the remote port */
+  void setLineMapping(const UARTLinux::LineMapping& lines);
+
+private:
+  int send(const std::vector<uint8_t>& data);
+  /* 0 once fd takes more bytes, ETIMEDOUT after deadline or ECANCELED */
+  int awaitWritable(std::chrono::steady_clock::time_point deadline) const;
+  /* sends an RFC 2217 COM-PORT-OPTION subnegotiation */
+  int comPortCommand(uint8_t command, const std::vector<uint8_t>& value);
+  /* strips Telnet commands from received bytes and refuses options that
+   * were not asked for. Keeps its state across reads, a command may be
+   * split over two segments */
+  std::vector<uint8_t> decode(const uint8_t* data, std::size_t size);
+
+  enum class RxState{
+    data,
+    command,
+    option,
+    subnegotiation,
+    subnegotiationCommand
+  };
+
+  int fd = -1;
+  std::chrono::milliseconds timeout{TIMEOUT_MS};
+  const std::atomic<bool>* cancel = nullptr;
+  Protocol protocol = Protocol::raw;
+  std::string name;
+  unsigned int readTimeout = 0;
+  std::chrono::microseconds roundTrip{0};
+  UARTLinux::LineMapping lines;
+  /* TIOCM_DTR/TIOCM_RTS while lines are mapped */
+  int modem = 0;
+  RxState rxState = RxState::data;
+  uint8_t verb = 0;
+  /* set once the server closed the connection */
+  bool closed = false;
+};
+
+#endif /* _TCP_SERIAL_H_ */
@@ -8,10 +8,13 @@
  /* SPDX-License-Identifier: BSD-2-Clause-Patent */
 //#include "ftdi_linux.h"
 
-#include <ftdi.h>
+#include <algorithm>
 #include <stdexcept>
+#include <thread>
 #include <memory.h>
 #include <array>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <errno.h>
 #include <fcntl.h> 
@@ -20,6 +23,10 @@
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <boost/algorithm/string.hpp>
 #include <boost/log/trivial.hpp>
 #include "uart_linux.h"
 #define UNUSED(x) (void)(x)
@@ -205,6 +212,10 @@ UARTLinux::~UARTLinux(){
   //  ftdi_usb_close(ftdi);
   //  ftdi_free(ftdi);
   //}
+  stopIoThread();
+  if(this->fd >= 0){
+    ::close(this->fd);
+  }
 }
 
 void UARTLinux::open(std::string dev)
@@ -216,6 +227,19 @@ void UARTLinux::open(std::string dev)
     }
     /*baudrate 115200, 8 bits, no parity, 1 stop bit */
     set_interface_attribs(this->fd, B115200); 
+
+    /* USB serial drivers hold back short reads up to the latency timer of the adapter */
+    adapterLatency = std::chrono::microseconds(0);
+    char* path = realpath(dev.c_str(), nullptr);
+    if(path != nullptr){
+      std::string name(path);
+      free(path);
+      std::ifstream timer(std::string("/sys/class/tty/") + name.substr(name.rfind('/') + 1) + std::string("/device/latency_timer"));
+      unsigned int milliseconds = 0;
+      if(timer >> milliseconds){
+        adapterLatency = std::chrono::milliseconds(milliseconds);
+      }
+    }
 }
 void UARTLinux::open(const int vid, const int pid){
   UNUSED(vid);
@@ -249,24 +273,115 @@ void UARTLinux::open(const int vid, const int pid){
 }
 
 bool UARTLinux::is_open(){
-  if(this->fd != 0) return true;
+  if(this->fd >= 0) return true;
   return false;
 }
 
+UARTLinux::LineMapping UARTLinux::parseLineMapping(const std::string& str){
+  LineMapping mapping;
+  std::vector<std::string> entries;
+  boost::split(entries, str, [](char c){ return c == ','; });
+  for(auto entry : entries){
+    boost::algorithm::trim(entry);
+    auto eq = entry.find('=');
+    if(eq == std::string::npos){
+      throw std::runtime_error(std::string("Invalid line mapping \"") + entry + std::string("\", expected reset=LINE or isp=LINE"));
+    }
+    auto pin = boost::algorithm::to_lower_copy(entry.substr(0, eq));
+    auto name = boost::algorithm::to_lower_copy(entry.substr(eq + 1));
+    bool inverted = !name.empty() && name[0] == '!';
+    if(inverted){
+      name = name.substr(1);
+    }
+    LineMapping::Line line;
+    if(name == "dtr"){
+      line = LineMapping::dtr;
+    }else if(name == "rts"){
+      line = LineMapping::rts;
+    }else if(name == "none"){
+      line = LineMapping::none;
+    }else{
+      throw std::runtime_error(std::string("Unknown modem control line \"") + name + std::string("\", expected dtr or rts"));
+    }
+    if(pin == "reset"){
+      mapping.reset = line;
+      mapping.resetInverted = inverted;
+    }else if(pin == "isp"){
+      mapping.isp = line;
+      mapping.ispInverted = inverted;
+    }else{
+      throw std::runtime_error(std::string("Unknown pin \"") + pin + std::string("\", expected reset or isp"));
+    }
+  }
+  if(mapping.reset != LineMapping::none && mapping.reset == mapping.isp){
+    throw std::runtime_error("reset and isp can not use the same line");
+  }
+  return mapping;
+}
+
+static int lineBit(UARTLinux::LineMapping::Line line){
+  switch(line){
+    case UARTLinux::LineMapping::dtr: return TIOCM_DTR;
+    case UARTLinux::LineMapping::rts: return TIOCM_RTS;
+    default: return 0;
+  }
+}
+
+int UARTLinux::modemBits(const LineMapping& lines, const FTDI::CBUSPins& pins, int current){
+  bool resetLow = pins.modeCBUS2 == FTDI::CBUSMode::OUTPUT && !pins.outputCBUS2;
+  bool ispLow = (pins.modeCBUS0 == FTDI::CBUSMode::OUTPUT && !pins.outputCBUS0)
+             || (pins.modeCBUS1 == FTDI::CBUSMode::OUTPUT && !pins.outputCBUS1)
+             || (pins.modeCBUS3 == FTDI::CBUSMode::OUTPUT && !pins.outputCBUS3);
+  auto apply = [&current](LineMapping::Line line, bool asserted){
+    auto bit = lineBit(line);
+    current = asserted ? (current | bit) : (current & ~bit);
+  };
+  apply(lines.reset, resetLow != lines.resetInverted);
+  apply(lines.isp, ispLow != lines.ispInverted);
+  return current;
+}
+
+void UARTLinux::setLineMapping(const LineMapping& lines){
+  this->lines = lines;
+  /* opening the tty asserts DTR and RTS, release the board right away */
+  disableCBUSMode();
+}
+
 int UARTLinux::setCBUSPins(const FTDI::CBUSPins& pins){
-  UNUSED(pins);
-  // uint8_t bitmask = pins.outputCBUS0 | (pins.outputCBUS1 << 1) | (pins.outputCBUS2 << 2) | (pins.outputCBUS3 << 3) | (pins.modeCBUS0 << 4) | (pins.modeCBUS1 << 5) | (pins.modeCBUS2 << 6) | (pins.modeCBUS3 << 7);
-  // int ret = ftdi_set_bitmode(ftdi, bitmask, BITMODE_CBUS);
-  // return ret;
-  return 0;
+  if(lines.reset == LineMapping::none && lines.isp == LineMapping::none){
+    return 0;
+  }
+  int bits = 0;
+  if(ioctl(this->fd, TIOCMGET, &bits) < 0){
+    return -1;
+  }
+  bits = modemBits(lines, pins, bits);
+  return ioctl(this->fd, TIOCMSET, &bits) < 0 ? -1 : 0;
 }
 
 int UARTLinux::disableCBUSMode(){
-  //return ftdi_disable_bitbang(ftdi); 
-  return 0;
+  /* all pins inputs: reset and ISP select released */
+  FTDI::CBUSPins pins = {};
+  return setCBUSPins(pins);
 }
 
 int UARTLinux::writeData(std::vector<uint8_t> data){
+  if(ioThread.joinable()){
+    /* no tcdrain, the I/O thread sends the frame while the caller goes on */
+    std::size_t written = 0;
+    while(true){
+      written += tx->write(data.data() + written, data.size() - written);
+      eventfd_write(txEvent, 1);
+      if(written == data.size()){
+        return data.size();
+      }
+      if(ioFailed){
+        return -1;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
   int ret = ::write(this->fd, data.data(), data.size()); //ftdi_write_data(ftdi, data.data(), data.size());
   //usleep(10000);
   //BOOST_LOG_TRIVIAL(info) << "wrote " << ret << " bytes out of " << data.size();
@@ -277,13 +392,50 @@ int UARTLinux::writeData(std::vector<uint8_t> data){
   return data.size();
 }
 
+std::vector<uint8_t> UARTLinux::readRing(){
+  std::vector<uint8_t> data(rx->size());
+  data.resize(rx->read(data.data(), data.size()));
+  return data;
+}
+
 std::vector<uint8_t> UARTLinux::readData(){
   std::array<uint8_t, 100> buf{0};
   std::vector<uint8_t> data;
   int ret = 0;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(readTimeout);
   do{
-    ret = ::read(this->fd, buf.data(), buf.size());
-
+    int wait = -1;
+    if(ioThread.joinable()){
+      data = readRing();
+      if(!data.empty() || ioFailed){
+        return data;
+      }
+    }
+    if(readTimeout != 0){
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      if(left <= 0){
+        return data;
+      }
+      wait = left;
+    }
+    if(ioThread.joinable()){
+      struct pollfd pfd = {rxEvent, POLLIN, 0};
+      if(::poll(&pfd, 1, wait) > 0){
+        eventfd_t count;
+        eventfd_read(rxEvent, &count);
+      }
+      continue;
+    }
+    struct pollfd pfd = {this->fd, POLLIN, 0};
+    ret = ::poll(&pfd, 1, wait);
+    if(ret > 0){
+      ret = ::read(this->fd, buf.data(), buf.size());
+      if(ret < 0 && (errno == EAGAIN || errno == EINTR)){
+        ret = 0;
+      }
+    }else if(ret < 0 && errno == EINTR){
+      ret = 0;
+    }
   }while(ret == 0);
   // BOOST_LOG_TRIVIAL(info) << "read " << ret << " bytes";
   if(ret > 0){
@@ -293,11 +445,135 @@ std::vector<uint8_t> UARTLinux::readData(){
       
   return data;
 }
+int UARTLinux::setReadTimeout(unsigned int milliseconds){
+  readTimeout = milliseconds;
+  return 0;
+}
+
 int UARTLinux::setBaudrate(uint32_t speed)
 {
-  if(this->fd!=0)
+  if(this->fd>=0)
   {
-    return set_baudrate(this->fd,speed);
+    auto ret = set_baudrate(this->fd,speed);
+    if(ioThread.joinable()){
+      /* like the kernel buffers flushed by set_baudrate */
+      readRing();
+    }
+    return ret;
   }
   return -1;
 }
+
+void UARTLinux::flushInput(){
+  if(this->fd >= 0){
+    tcflush(this->fd, TCIFLUSH);
+  }
+  if(ioThread.joinable()){
+    readRing();
+  }
+}
+
+std::chrono::microseconds UARTLinux::latency() const{
+  return adapterLatency;
+}
+
+bool UARTLinux::supportsBaudrate(uint32_t speed) const{
+  return get_baud(speed) != -1;
+}
+
+void UARTLinux::startIoThread(std::function<void()> onStart){
+  if(ioThread.joinable()){
+    return;
+  }
+  if(this->fd < 0){
+    throw std::runtime_error("Can not start the I/O thread of a closed UART");
+  }
+  txEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  rxEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(txEvent < 0 || rxEvent < 0){
+    stopIoThread();
+    throw std::runtime_error(std::string("Could not create eventfd: ") + strerror(errno));
+  }
+  tx.reset(new Ring());
+  rx.reset(new Ring());
+  ioStop = false;
+  ioFailed = false;
+  ioThread = std::thread([this, onStart]{
+    if(onStart){
+      onStart();
+    }
+    ioLoop();
+  });
+  BOOST_LOG_TRIVIAL(info) << "Started I/O thread of the UART";
+}
+
+void UARTLinux::stopIoThread(){
+  if(ioThread.joinable()){
+    ioStop = true;
+    eventfd_write(txEvent, 1);
+    ioThread.join();
+  }
+  for(auto event : {&txEvent, &rxEvent}){
+    if(*event >= 0){
+      ::close(*event);
+      *event = -1;
+    }
+  }
+}
+
+void UARTLinux::ioLoop(){
+  std::array<uint8_t, 4096> in;
+  std::array<uint8_t, 4096> out;
+  std::size_t outBegin = 0;
+  std::size_t outEnd = 0;
+  while(!ioStop){
+    if(outBegin == outEnd){
+      outBegin = 0;
+      outEnd = tx->read(out.data(), out.size());
+    }
+    bool rxFull = rx->space() == 0;
+    struct pollfd pfds[2] = {{this->fd, 0, 0}, {txEvent, POLLIN, 0}};
+    if(outBegin != outEnd){
+      pfds[0].events |= POLLOUT;
+    }
+    if(!rxFull){
+      pfds[0].events |= POLLIN;
+    }
+    /* the caller does not signal when it frees space in rx, look again shortly */
+    if(::poll(pfds, 2, rxFull ? 1 : -1) < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      break;
+    }
+    if(pfds[1].revents & POLLIN){
+      eventfd_t count;
+      eventfd_read(txEvent, &count);
+    }
+    if(pfds[0].revents & (POLLERR | POLLHUP | POLLNVAL)){
+      break;
+    }
+    if(pfds[0].revents & POLLOUT){
+      auto ret = ::write(this->fd, out.data() + outBegin, outEnd - outBegin);
+      if(ret > 0){
+        outBegin += ret;
+      }else if(ret < 0 && errno != EAGAIN && errno != EINTR){
+        break;
+      }
+    }
+    if(pfds[0].revents & POLLIN){
+      auto ret = ::read(this->fd, in.data(), std::min(in.size(), rx->space()));
+      if(ret > 0){
+        rx->write(in.data(), ret);
+        eventfd_write(rxEvent, 1);
+      }else if(ret < 0 && errno != EAGAIN && errno != EINTR){
+        break;
+      }
+    }
+  }
+  if(!ioStop){
+    BOOST_LOG_TRIVIAL(error) << "I/O thread of the UART stopped, the tty failed";
+    ioFailed = true;
+    eventfd_write(rxEvent, 1);
+  }
+}
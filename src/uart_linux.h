@@ -10,13 +10,35 @@
 #define _UARTLINUX_HPP_
 
 #include "ftdi.hpp"
+#include "spsc_ring.h"
 
-#include <libftdi1/ftdi.h> // libftdi header
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 class UARTLinux : public FTDI::Interface {
 public:
+  /* Which modem control lines drive the reset and ISP select pins of the
+   * board. Set in a CBUS pattern, CBUS2 is reset and the other pins are ISP
+   * select, both active low. A mapped line is asserted (TIOCM bit set, pin
+   * low on most adapters) while its pin is low, unless it is inverted. */
+  struct LineMapping{
+    enum Line{none, dtr, rts};
+    Line reset = none;
+    bool resetInverted = false;
+    Line isp = none;
+    bool ispInverted = false;
+  };
+
+  /* e.g. "reset=dtr,isp=!rts", a ! inverts the line */
+  static LineMapping parseLineMapping(const std::string& str);
+  /* modem control bits for a CBUS pattern, lines that are not mapped keep their state in current */
+  static int modemBits(const LineMapping& lines, const FTDI::CBUSPins& pins, int current);
+
   UARTLinux();
   UARTLinux(const int vid, const int pid);
   virtual ~UARTLinux();
@@ -30,9 +52,45 @@ public:
 
   int writeData(std::vector<uint8_t> data);
   std::vector<uint8_t> readData();
+  int setReadTimeout(unsigned int milliseconds);
   int setBaudrate(uint32_t speed);
+  void flushInput();
+  /* latency timer of USB adapters as set in sysfs by ftdi_sio, 0 for other ttys */
+  std::chrono::microseconds latency() const;
+  /* baudrates with a termios constant */
+  bool supportsBaudrate(uint32_t speed) const;
+  void setLineMapping(const LineMapping& lines);
+
+  /* Moves all reads and writes of the tty to a thread of its own that
+   * exchanges the bytes with the caller through lock-free rings. writeData
+   * then returns once the frame is queued instead of after the UART has
+   * drained it, and readData takes what the thread already received.
+   * onStart runs in the new thread, e.g. to apply its scheduling */
+  void startIoThread(std::function<void()> onStart=nullptr);
+
 private:
+  using Ring = SpscRing<65536>;
+
+  void ioLoop();
+  void stopIoThread();
+  std::vector<uint8_t> readRing();
+
   struct ftdi_context * ftdi = nullptr;
-  int fd;
+  int fd = -1;
+  unsigned int readTimeout = 0;
+  std::chrono::microseconds adapterLatency{0};
+  LineMapping lines;
+
+  std::thread ioThread;
+  std::atomic<bool> ioStop{false};
+  /* set by the I/O thread when the tty failed, e.g. adapter unplugged */
+  std::atomic<bool> ioFailed{false};
+  /* eventfds: frame queued or stop requested, bytes received */
+  int txEvent = -1;
+  int rxEvent = -1;
+  /* written by the caller, read by the I/O thread */
+  std::unique_ptr<Ring> tx;
+  /* written by the I/O thread, read by the caller */
+  std::unique_ptr<Ring> rx;
 };
 #endif /* _UARTLINUX_HPP_ */
\ No newline at end of file
@@ -0,0 +1,269 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "usb_enumerator.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+#include <boost/log/trivial.hpp>
+#include <dirent.h>
+
+static std::string readAttribute(const std::string& path){
+  std::ifstream ifs(path);
+  std::string value;
+  std::getline(ifs, value);
+  boost::algorithm::trim(value);
+  return value;
+}
+
+static int readNumber(const std::string& path, int base){
+  auto value = readAttribute(path);
+  try{
+    return std::stoi(value, nullptr, base);
+  }catch(const std::exception&){
+    return -1;
+  }
+}
+
+static int readHex(const std::string& path){
+  return readNumber(path, 16);
+}
+
+static std::string basename(const std::string& path){
+  auto slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/* <bus>-<port>[.<port>...]:<config>.<interface> */
+static bool isInterface(const std::string& name){
+  auto colon = name.find(':');
+  return colon != std::string::npos && !name.empty() && std::isdigit(static_cast<unsigned char>(name[0]))
+      && name.find('-') < colon && name.find('.', colon) != std::string::npos;
+}
+
+/* ttyUSB2 before ttyUSB10 */
+static bool naturalLess(const std::string& a, const std::string& b){
+  auto split = [](const std::string& s){
+    auto digits = s.find_last_not_of("0123456789") + 1;
+    return std::make_pair(s.substr(0, digits), digits < s.size() ? std::stoul(s.substr(digits)) : 0ul);
+  };
+  return split(a) < split(b);
+}
+
+UsbEnumerator::UsbEnumerator(const std::string& sysfs) : sysfs(sysfs){
+}
+
+UsbEnumerator& UsbEnumerator::system(){
+  static UsbEnumerator enumerator;
+  return enumerator;
+}
+
+std::string UsbEnumerator::resolve(const std::string& name) const{
+  char resolved[PATH_MAX];
+  if(realpath((sysfs + "/class/tty/" + name + "/device").c_str(), resolved) == nullptr){
+    return "";
+  }
+  return resolved;
+}
+
+bool UsbEnumerator::read(const std::string& name, Entry& entry) const{
+  entry.link = resolve(name);
+  if(entry.link.empty()){
+    return false;
+  }
+
+  std::vector<std::string> components;
+  boost::split(components, entry.link, [](char c){return c == '/';});
+  auto it = std::find_if(components.begin(), components.end(), isInterface);
+  if(it == components.begin() || it == components.end()){
+    return false;
+  }
+  auto interfaceDir = boost::algorithm::join(std::vector<std::string>(components.begin(), it + 1), "/");
+  auto deviceDir = boost::algorithm::join(std::vector<std::string>(components.begin(), it), "/");
+
+  auto& device = entry.device;
+  device.tty = std::string("/dev/") + name;
+  device.busPath = it->substr(0, it->find(':'));
+  device.vid = readHex(deviceDir + "/idVendor");
+  device.pid = readHex(deviceDir + "/idProduct");
+  if(device.vid < 0 || device.pid < 0){
+    return false;
+  }
+  device.serial = readAttribute(deviceDir + "/serial");
+  device.product = readAttribute(deviceDir + "/product");
+  device.interfaceNumber = readHex(interfaceDir + "/bInterfaceNumber");
+  char driver[PATH_MAX];
+  device.driver = realpath((interfaceDir + "/driver").c_str(), driver) ? basename(driver) : std::string();
+  return true;
+}
+
+std::vector<UsbEnumerator::Device> UsbEnumerator::scan(){
+  std::lock_guard<std::mutex> lock(mutex);
+  cache.clear();
+  DIR* dir = opendir((sysfs + "/class/tty").c_str());
+  if(dir == nullptr){
+    throw std::runtime_error(std::string("Could not read ") + sysfs + std::string("/class/tty"));
+  }
+  while(auto dirent = readdir(dir)){
+    Entry entry;
+    if(dirent->d_name[0] != '.' && read(dirent->d_name, entry)){
+      cache[dirent->d_name] = entry;
+    }
+  }
+  closedir(dir);
+  BOOST_LOG_TRIVIAL(info) << "Found " << cache.size() << " USB serial devices";
+
+  std::vector<Device> devices;
+  for(const auto& e : cache){
+    devices.push_back(e.second.device);
+  }
+  std::sort(devices.begin(), devices.end(), [](const Device& a, const Device& b){ return naturalLess(a.tty, b.tty); });
+  return devices;
+}
+
+UsbEnumerator::Device UsbEnumerator::lookup(const std::string& dev){
+  char resolved[PATH_MAX];
+  auto name = basename(realpath(dev.c_str(), resolved) ? std::string(resolved) : dev);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(name);
+    if(it != cache.end() && it->second.link == resolve(name)){
+      return it->second.device;
+    }
+  }
+
+  scan();
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = cache.find(name);
+  if(it == cache.end()){
+    throw std::runtime_error(dev + std::string(" is not a USB serial device"));
+  }
+  return it->second.device;
+}
+
+bool UsbEnumerator::isUsbSelector(const std::string& interface){
+  return boost::algorithm::starts_with(interface, "usb:") || boost::algorithm::starts_with(interface, "serial:");
+}
+
+UsbEnumerator::UsbDevice UsbEnumerator::findUsbDevice(const std::string& interface){
+  auto devices = sysfs + "/bus/usb/devices/";
+  std::string busPath;
+  std::string selector = interface;
+  int channel = 0;
+  auto hash = interface.rfind('#');
+  if(isUsbSelector(interface) && hash != std::string::npos){
+    auto name = boost::algorithm::to_upper_copy(interface.substr(hash + 1));
+    if(name.size() != 1 || name[0] < 'A' || name[0] > 'D'){
+      throw std::runtime_error(std::string("Invalid channel \"") + interface.substr(hash + 1) + std::string("\", expected A, B, C or D"));
+    }
+    channel = name[0] - 'A' + 1;
+    selector = interface.substr(0, hash);
+  }
+
+  if(boost::algorithm::starts_with(selector, "usb:")){
+    busPath = selector.substr(4);
+  }else if(boost::algorithm::starts_with(selector, "serial:")){
+    auto serial = selector.substr(7);
+    DIR* dir = opendir(devices.c_str());
+    if(dir == nullptr){
+      throw std::runtime_error(std::string("Could not read ") + devices);
+    }
+    /* interfaces (<bus path>:<config>.<interface>) carry no serial */
+    while(auto dirent = readdir(dir)){
+      std::string name = dirent->d_name;
+      if(name[0] == '.' || name.find(':') != std::string::npos || readAttribute(devices + name + "/serial") != serial){
+        continue;
+      }
+      if(!busPath.empty()){
+        closedir(dir);
+        throw std::runtime_error(std::string("Serial number ") + serial + std::string(" is used by ") + busPath + std::string(" and ") + name);
+      }
+      busPath = name;
+    }
+    closedir(dir);
+    if(busPath.empty()){
+      throw std::runtime_error(std::string("No USB device with serial number ") + serial);
+    }
+  }else{
+    auto tty = lookup(interface);
+    busPath = tty.busPath;
+    channel = tty.interfaceNumber + 1;
+  }
+
+  auto dir = devices + busPath;
+  UsbDevice device{busPath, readNumber(dir + "/busnum", 10), readNumber(dir + "/devnum", 10),
+                   readHex(dir + "/idVendor"), readHex(dir + "/idProduct"), readAttribute(dir + "/serial"),
+                   std::max(1, readNumber(dir + "/bNumInterfaces", 10)), channel};
+  if(busPath.empty() || device.bus < 0 || device.address < 0){
+    throw std::runtime_error(std::string("No USB device at ") + interface);
+  }
+  if(device.channel > device.interfaces){
+    throw std::runtime_error(interface + std::string(" has only ") + std::to_string(device.interfaces) + std::string(" channels"));
+  }
+  BOOST_LOG_TRIVIAL(info) << interface << " is USB device " << busPath << " (bus " << device.bus << ", address " << device.address << ")";
+  return device;
+}
+
+std::string UsbEnumerator::ttyOf(const std::string& interface){
+  if(!isUsbSelector(interface)){
+    return interface;
+  }
+  auto usb = findUsbDevice(interface);
+  for(const auto& device : scan()){
+    if(device.busPath == usb.busPath && (usb.channel == 0 || device.interfaceNumber == usb.channel - 1)){
+      return device.tty;
+    }
+  }
+  throw std::runtime_error(interface + std::string(" has no tty, is the serial driver bound?"));
+}
+
+std::string UsbEnumerator::selectorOf(const std::string& interface){
+  if(isUsbSelector(interface)){
+    return interface;
+  }
+  try{
+    auto device = lookup(interface);
+    auto selector = std::string("usb:") + device.busPath + std::string("#") + char('A' + device.interfaceNumber);
+    std::lock_guard<std::mutex> lock(mutex);
+    selectors[interface] = selector;
+    return selector;
+  }catch(const std::runtime_error&){
+    std::lock_guard<std::mutex> lock(mutex);
+    auto known = selectors.find(interface);
+    if(known == selectors.end()){
+      throw;
+    }
+    return known->second;
+  }
+}
+
+void UsbEnumerator::print(std::ostream& os, const std::vector<Device>& devices){
+  auto flags = os.flags();
+  std::size_t width = 3;
+  std::size_t serialWidth = 6;
+  for(const auto& d : devices){
+    width = std::max(width, d.tty.size());
+    serialWidth = std::max(serialWidth, d.serial.size());
+  }
+  os << std::left << std::setw(width + 2) << "TTY" << std::setw(12) << "Bus Path" << std::setw(11) << "VID:PID"
+     << std::setw(4) << "If" << std::setw(12) << "Driver" << std::setw(serialWidth + 2) << "Serial" << "Product" << std::endl;
+  for(const auto& d : devices){
+    char id[10];
+    snprintf(id, sizeof(id), "%04x:%04x", d.vid & 0xFFFF, d.pid & 0xFFFF);
+    os << std::left << std::setw(width + 2) << d.tty << std::setw(12) << d.busPath << std::setw(11) << id
+       << std::setw(4) << d.interfaceNumber << std::setw(12) << d.driver << std::setw(serialWidth + 2) << d.serial << d.product << std::endl;
+  }
+  os.flags(flags);
+}
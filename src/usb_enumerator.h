@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _USB_ENUMERATOR_H_
+#define _USB_ENUMERATOR_H_
+
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* Maps tty devices to the USB adapters behind them by scanning sysfs:
+ *
+ *   class/tty/<name>/device -> .../<bus path>:<config>.<interface>[/<port>]
+ *
+ * The interface directory holds bInterfaceNumber and the driver link, its
+ * parent is the USB device with idVendor, idProduct and serial. ttys that
+ * are not USB devices are skipped.
+ *
+ * Lookups are answered from the result of the last scan. A tty that is
+ * unknown or whose device link changed since (re-plugged adapter) triggers
+ * a new scan, so station and parallel runs scan sysfs once per hotplug
+ * instead of once per lookup. */
+class UsbEnumerator
+{
+public:
+  struct Device{
+    /* /dev/<name> */
+    std::string tty;
+    /* e.g. "1-1.2" for an adapter on port 2 of a hub on port 1 of bus 1 */
+    std::string busPath;
+    int vid;
+    int pid;
+    /* empty if the adapter has no serial number */
+    std::string serial;
+    std::string product;
+    int interfaceNumber;
+    std::string driver;
+  };
+
+  /* a USB device of bus/usb/devices. Unlike the tty it is present while
+   * libftdi has the kernel driver detached */
+  struct UsbDevice{
+    std::string busPath;
+    int bus;
+    int address;
+    int vid;
+    int pid;
+    std::string serial;
+    /* bNumInterfaces, 2 or 4 for FT2232H/FT4232H */
+    int interfaces;
+    /* 1-4 for channel A-D, 0 if not selected */
+    int channel;
+  };
+
+  explicit UsbEnumerator(const std::string& sysfs="/sys");
+
+  /* all USB serial ttys sorted by name, refreshes the cache */
+  std::vector<Device> scan();
+  /* dev is a tty name or path, symlinks like /dev/serial/by-id/... are
+   * resolved. Throws if it is not a USB serial device */
+  Device lookup(const std::string& dev);
+  /* interface is a tty, usb:<bus path>[#CHANNEL] or
+   * serial:<serial number>[#CHANNEL]. CHANNEL is A-D and selects one
+   * interface of a multi-channel FTDI part, a tty selects the channel it
+   * belongs to */
+  UsbDevice findUsbDevice(const std::string& interface);
+  /* the tty of the adapter selected by interface, see findUsbDevice */
+  std::string ttyOf(const std::string& interface);
+  /* usb:<bus path>#CHANNEL of a tty, usb: and serial: selectors unchanged.
+   * The result is remembered: once libftdi opened the adapter the serial
+   * driver is detached and the tty is gone, but its bus path still opens it */
+  std::string selectorOf(const std::string& interface);
+  /* true for usb:<bus path> and serial:<serial number> */
+  static bool isUsbSelector(const std::string& interface);
+
+  /* process wide enumerator of /sys */
+  static UsbEnumerator& system();
+  static void print(std::ostream& os, const std::vector<Device>& devices);
+
+private:
+  struct Entry{
+    /* resolved device link, changes when another adapter gets the name */
+    std::string link;
+    Device device;
+  };
+
+  bool read(const std::string& name, Entry& entry) const;
+  std::string resolve(const std::string& name) const;
+
+  std::string sysfs;
+  std::mutex mutex;
+  std::map<std::string, Entry> cache;
+  /* selectorOf, kept across scans */
+  std::map<std::string, std::string> selectors;
+};
+
+#endif /* _USB_ENUMERATOR_H_ */
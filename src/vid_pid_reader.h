@@ -14,6 +14,8 @@
 
 namespace VIDPIDReader{
     std::tuple<int, int> getVidPidForDev(std::string dev);
+    /* USB port path of the device, e.g. "1-1.2" for a converter on hub port 2 */
+    std::string getUsbPortForDev(std::string dev);
 }
 
 
@@ -0,0 +1,229 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "ftdi_mock.h"
+#include "mcu_mock.h"
+#include "temp_file.h"
+#include <application.h>
+#include <frame_stream.h>
+#include <k32w061.h>
+
+#include <gmock/gmock.h>
+#include <fstream>
+#include <stdexcept>
+
+using ::testing::_;
+using ::testing::Return;
+using ::testing::InSequence;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Throw;
+
+class Application_EnableISPMode : public testing::Test{
+public:
+  Application_EnableISPMode() : app(mcu, ftdi){};
+
+  NiceMock<FTDIMock> ftdi;
+  NiceMock<MCUMock> mcu;
+  Application app;
+};
+
+TEST_F(Application_EnableISPMode, probesUntilBootloaderAnswers){
+  {
+    InSequence s;
+    EXPECT_CALL(mcu, setResponseTimeout(std::chrono::milliseconds(5)));
+    EXPECT_CALL(mcu, enableISPMode(_)).WillOnce(Return(-1)).WillOnce(Throw(MCU::TimeoutError("No response")));
+    EXPECT_CALL(mcu, enableISPMode(_)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, setResponseTimeout(std::chrono::milliseconds(0)));
+    EXPECT_CALL(ftdi, flushInput());
+    EXPECT_CALL(ftdi, disableCBUSMode());
+  }
+  app.enableISPMode();
+}
+
+TEST_F(Application_EnableISPMode, waitsForAnswerBehindAdapterLatency){
+  ON_CALL(ftdi, latency()).WillByDefault(Return(std::chrono::milliseconds(16)));
+  /* 34 bytes at 115200 baud plus 16 ms latency timer */
+  EXPECT_CALL(mcu, setResponseTimeout(std::chrono::milliseconds(19)));
+  EXPECT_CALL(mcu, setResponseTimeout(std::chrono::milliseconds(0)));
+  EXPECT_CALL(mcu, enableISPMode(_)).WillOnce(Return(0));
+  app.enableISPMode();
+}
+
+TEST_F(Application_EnableISPMode, failsIfBootloaderNeverAnswers){
+  Application::IspTiming timing;
+  timing.timeout = std::chrono::milliseconds(20);
+  app.setIspTiming(timing);
+  EXPECT_CALL(mcu, enableISPMode(_)).WillRepeatedly(Return(-1));
+  EXPECT_CALL(ftdi, disableCBUSMode());
+  EXPECT_CALL(ftdi, flushInput()).Times(0);
+  EXPECT_THROW(app.enableISPMode(), std::runtime_error);
+}
+
+TEST_F(Application_EnableISPMode, measuresTimeToReady){
+  Application::IspTiming timing;
+  timing.firstProbe = std::chrono::milliseconds(15);
+  app.setIspTiming(timing);
+  EXPECT_CALL(mcu, enableISPMode(_)).WillOnce(Return(0));
+  app.enableISPMode();
+  EXPECT_GE(app.ispReadyTime().count(), 15);
+  EXPECT_LT(app.ispReadyTime().count(), 500);
+}
+
+TEST_F(Application_EnableISPMode, releasesPinsWhenCancelledWhileWaiting){
+  std::atomic<bool> cancel{false};
+  app.setCancel(&cancel);
+  EXPECT_CALL(mcu, enableISPMode(_)).WillOnce(Throw(MCU::Cancelled()));
+  EXPECT_CALL(ftdi, disableCBUSMode());
+  EXPECT_THROW(app.enableISPMode(), Application::Cancelled);
+}
+
+class Application_ProbeISPMode : public Application_EnableISPMode {};
+
+TEST_F(Application_ProbeISPMode, continuesSessionIfDeviceAnswers){
+  MCU::DeviceInfo info{K32W061::CHIP_ID_K32W061, 0};
+  EXPECT_CALL(ftdi, setBaudrate(1000000u)).WillOnce(Return(0));
+  EXPECT_CALL(mcu, getDeviceInfo()).WillOnce(Return(info));
+  EXPECT_TRUE(app.probeISPMode(1000000));
+}
+
+TEST_F(Application_ProbeISPMode, treatsTimeoutAsClosedSession){
+  EXPECT_CALL(mcu, getDeviceInfo()).WillOnce(Throw(MCU::TimeoutError("No response")));
+  EXPECT_FALSE(app.probeISPMode(K32W061::ISP_BAUDRATE));
+}
+
+TEST_F(Application_ProbeISPMode, fallsBackToIspBaudrate){
+  {
+    InSequence s;
+    EXPECT_CALL(ftdi, setBaudrate(1000000u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).WillOnce(Return(MCU::DeviceInfo{0, 0}));
+    EXPECT_CALL(ftdi, setBaudrate(K32W061::ISP_BAUDRATE));
+  }
+  EXPECT_FALSE(app.probeISPMode(1000000));
+}
+
+class Application_NegotiateBaudrate : public Application_EnableISPMode {
+public:
+  virtual void SetUp(){
+    ON_CALL(ftdi, supportsBaudrate(_)).WillByDefault(Return(true));
+  }
+  const MCU::DeviceInfo k32w061{K32W061::CHIP_ID_K32W061, 0};
+};
+
+TEST_F(Application_NegotiateBaudrate, choosesFastestRateThatAnswers){
+  EXPECT_CALL(mcu, setBaudrate(_)).WillRepeatedly(Return(0));
+  EXPECT_CALL(mcu, getDeviceInfo()).WillRepeatedly(Return(k32w061));
+  EXPECT_EQ(app.negotiateBaudrate(K32W061::ISP_BAUDRATE), 1000000u);
+}
+
+TEST_F(Application_NegotiateBaudrate, stopsAtMaximumAndSkipsUnsupportedRates){
+  ON_CALL(ftdi, supportsBaudrate(460800u)).WillByDefault(Return(false));
+  EXPECT_CALL(mcu, setBaudrate(230400u)).WillOnce(Return(0));
+  EXPECT_CALL(mcu, setBaudrate(460800u)).Times(0);
+  EXPECT_CALL(mcu, setBaudrate(500000u)).WillOnce(Return(0));
+  EXPECT_CALL(mcu, setBaudrate(1000000u)).Times(0);
+  EXPECT_CALL(mcu, getDeviceInfo()).WillRepeatedly(Return(k32w061));
+  EXPECT_EQ(app.negotiateBaudrate(K32W061::ISP_BAUDRATE, 500000), 500000u);
+}
+
+TEST_F(Application_NegotiateBaudrate, fallsBackToLastGoodRate){
+  {
+    InSequence s;
+    EXPECT_CALL(mcu, setBaudrate(230400u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).Times(3).WillRepeatedly(Return(k32w061));
+    EXPECT_CALL(mcu, setBaudrate(460800u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).WillOnce(Return(k32w061)).WillOnce(Throw(MCU::TimeoutError("No response")));
+    /* the device went back on request */
+    EXPECT_CALL(ftdi, setBaudrate(230400u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).WillOnce(Throw(MCU::TimeoutError("No response")));
+    EXPECT_CALL(ftdi, setBaudrate(460800u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, setBaudrate(230400u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).WillOnce(Return(k32w061));
+  }
+  EXPECT_EQ(app.negotiateBaudrate(K32W061::ISP_BAUDRATE), 230400u);
+}
+
+TEST_F(Application_NegotiateBaudrate, entersIspModeAgainIfDeviceIsLost){
+  {
+    InSequence s;
+    EXPECT_CALL(mcu, setBaudrate(230400u)).WillOnce(Throw(MCU::TimeoutError("No response")));
+    EXPECT_CALL(ftdi, setBaudrate(K32W061::ISP_BAUDRATE)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).WillOnce(Return(MCU::DeviceInfo{0, 0}));
+    EXPECT_CALL(ftdi, setBaudrate(230400u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, setBaudrate(K32W061::ISP_BAUDRATE)).WillOnce(Return(-1));
+    EXPECT_CALL(ftdi, setBaudrate(K32W061::ISP_BAUDRATE)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, enableISPMode(_)).WillOnce(Return(0));
+  }
+  EXPECT_EQ(app.negotiateBaudrate(K32W061::ISP_BAUDRATE), K32W061::ISP_BAUDRATE);
+}
+
+TEST_F(Application_NegotiateBaudrate, staysAtIspRateIfTheTransportRefusesEveryRate){
+  ON_CALL(ftdi, supportsBaudrate(_)).WillByDefault(Return(false));
+  ON_CALL(ftdi, supportsBaudrate(K32W061::ISP_BAUDRATE)).WillByDefault(Return(true));
+  /* the device is never asked to switch, so nothing has to be recovered */
+  EXPECT_CALL(mcu, setBaudrate(_)).Times(0);
+  EXPECT_CALL(ftdi, setBaudrate(_)).Times(0);
+  EXPECT_CALL(mcu, enableISPMode(_)).Times(0);
+  EXPECT_EQ(app.negotiateBaudrate(K32W061::ISP_BAUDRATE, 0, 1000000), K32W061::ISP_BAUDRATE);
+}
+
+TEST_F(Application_NegotiateBaudrate, keepsLearnedRateThatAnswers){
+  {
+    InSequence s;
+    EXPECT_CALL(mcu, setBaudrate(1000000u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).Times(3).WillRepeatedly(Return(k32w061));
+  }
+  EXPECT_EQ(app.negotiateBaudrate(K32W061::ISP_BAUDRATE, 0, 1000000), 1000000u);
+}
+
+TEST_F(Application_NegotiateBaudrate, stepsUpBelowLearnedRateThatFails){
+  {
+    InSequence s;
+    EXPECT_CALL(mcu, setBaudrate(460800u)).WillOnce(Throw(MCU::TimeoutError("No response")));
+    /* the device did not switch */
+    EXPECT_CALL(ftdi, setBaudrate(K32W061::ISP_BAUDRATE)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).WillOnce(Return(k32w061));
+    EXPECT_CALL(mcu, setBaudrate(230400u)).WillOnce(Return(0));
+    EXPECT_CALL(mcu, getDeviceInfo()).Times(3).WillRepeatedly(Return(k32w061));
+  }
+  EXPECT_EQ(app.negotiateBaudrate(K32W061::ISP_BAUDRATE, 0, 460800), 230400u);
+}
+
+TEST_F(Application_EnableISPMode, countsBytesOfEveryOperation){
+  EXPECT_CALL(mcu, readMemory(_, _, _, _)).WillRepeatedly(Return(0));
+  app.dump(MCU::MemoryID::flash, 0x100, 0x300, "/dev/null");
+  app.dump(MCU::MemoryID::flash, 0x0, 0x10, "/dev/null");
+  EXPECT_EQ(app.bytesTransferred(), 0x310u);
+}
+
+TEST_F(Application_EnableISPMode, readdressesFramesCompiledForAnotherHandle){
+  TempFile file{"app"};
+  std::vector<uint8_t> data(0x300, 0x5A);
+  std::ofstream(file.path, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), data.size());
+  auto fw = FrameStream::encode(FirmwareImage(file.path, K32W061::FLASH_SIZE, FirmwareImage::Format::binary));
+  ASSERT_EQ(fw->handle(), 0);
+
+  std::vector<std::vector<uint8_t>> sent;
+  EXPECT_CALL(mcu, getMemoryHandle(MCU::MemoryID::flash)).WillOnce(Return(2));
+  EXPECT_CALL(mcu, sendFrames(_, _)).WillOnce(Invoke([&sent](const std::vector<MCU::Frame>& frames, const std::function<void(std::size_t)>&){
+    for(const auto& frame : frames){
+      sent.emplace_back(frame.data, frame.data + frame.size);
+    }
+    return 0;
+  }));
+  EXPECT_CALL(mcu, closeMemory(2)).WillOnce(Return(0));
+  app.flashFirmware(*fw);
+
+  ASSERT_EQ(sent.size(), fw->frames().size());
+  std::size_t offset = 0;
+  for(const auto& frame : sent){
+    auto chunk = frame.size() - K32W061::WRITE_FRAME_OVERHEAD;
+    EXPECT_EQ(frame, K32W061::writeMemoryFrame(2, offset, data.data() + offset, chunk));
+    offset += chunk;
+  }
+}
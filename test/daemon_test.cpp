@@ -0,0 +1,76 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <daemon.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <boost/log/trivial.hpp>
+
+using ::testing::ContainerEq;
+
+class Daemon_request : public testing::Test{
+public:
+  virtual void TearDown(){
+    if(daemon){
+      daemon->stop();
+      thread.join();
+    }
+  };
+
+  void start(Daemon::Handler handler){
+    daemon.reset(new Daemon(path, handler));
+    thread = std::thread([this](){ daemon->run(); });
+  }
+
+  TempFile file{"daemon"};
+  std::string path = file.path;
+  std::unique_ptr<Daemon> daemon;
+  std::thread thread;
+};
+
+TEST_F(Daemon_request, passesArgumentsAndStreamsProgress){
+  std::vector<std::string> received;
+  std::string received_cwd;
+  start([&](const std::vector<std::string>& args, const std::string& cwd, const Daemon::Progress& progress){
+    received = args;
+    received_cwd = cwd;
+    BOOST_LOG_TRIVIAL(warning) << "flashing";
+    progress(512, 1024);
+    progress(1024, 1024);
+  });
+
+  std::vector<std::string> events;
+  std::string error;
+  EXPECT_TRUE(Daemon::request(path, {"-i", "/dev/ttyUSB3", "-f", "app bin.hex"}, "/home/test", [&](const std::string& type, const std::string& text){
+    events.push_back(type + ":" + text);
+  }, error));
+  EXPECT_TRUE(error.empty());
+  EXPECT_THAT(received, ContainerEq(std::vector<std::string>{"-i", "/dev/ttyUSB3", "-f", "app bin.hex"}));
+  EXPECT_EQ(received_cwd, "/home/test");
+  EXPECT_THAT(events, ContainerEq(std::vector<std::string>{"log:[info] Start job 1", "log:[warning] flashing", "progress:512 1024", "progress:1024 1024"}));
+}
+
+TEST_F(Daemon_request, reportsJobErrors){
+  start([](const std::vector<std::string>&, const std::string&, const Daemon::Progress&){
+    throw std::runtime_error("Could not enable ISP Mode");
+  });
+  std::string error;
+  EXPECT_FALSE(Daemon::request(path, {}, "/", [](const std::string&, const std::string&){}, error));
+  EXPECT_EQ(error, "Could not enable ISP Mode");
+}
+
+TEST_F(Daemon_request, failsIfNoDaemonIsRunning){
+  std::string error;
+  EXPECT_THROW(Daemon::request(path, {}, "/", [](const std::string&, const std::string&){}, error), std::runtime_error);
+}
@@ -0,0 +1,77 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "temp_file.h"
+#include <device_profiles.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+class DeviceProfiles_store : public testing::Test{
+public:
+  static DeviceProfiles::Profile profile(uint32_t chipId, uint32_t version, uint32_t speed){
+    DeviceProfiles::Profile p;
+    p.chipId = chipId;
+    p.version = version;
+    p.speed = speed;
+    p.ispReady = std::chrono::milliseconds(120);
+    p.erasePerPage = std::chrono::microseconds(4100);
+    return p;
+  }
+
+  TempDir dir{"profiles"};
+  std::string path = dir.path + "/nxp-isp/profiles";
+};
+
+TEST_F(DeviceProfiles_store, remembersProfilePerAdapterAndChip){
+  DeviceProfiles profiles(path);
+  profiles.store("FT1234", profile(0x88888888, 0x1, 1000000));
+  profiles.store("FT1234", profile(0x88888888, 0x2, 460800));
+  profiles.store("1-1.2", profile(0x88888888, 0x1, 230400));
+
+  DeviceProfiles::Profile p;
+  ASSERT_TRUE(DeviceProfiles(path).lookup("FT1234", 0x88888888, 0x1, p));
+  EXPECT_EQ(p.speed, 1000000u);
+  EXPECT_EQ(p.ispReady, std::chrono::milliseconds(120));
+  EXPECT_EQ(p.erasePerPage, std::chrono::microseconds(4100));
+  EXPECT_NE(p.updated, 0);
+  ASSERT_TRUE(profiles.lookup("1-1.2", 0x88888888, 0x1, p));
+  EXPECT_EQ(p.speed, 230400u);
+  EXPECT_FALSE(profiles.lookup("FT1234", 0x88888888, 0x3, p));
+  EXPECT_FALSE(profiles.lookup("FT9999", p));
+}
+
+TEST_F(DeviceProfiles_store, replacesAndForgetsProfiles){
+  DeviceProfiles profiles(path);
+  profiles.store("FT1234", profile(0x88888888, 0x1, 1000000));
+  profiles.store("FT1234", profile(0x88888888, 0x1, 500000));
+
+  DeviceProfiles::Profile p;
+  ASSERT_TRUE(profiles.lookup("FT1234", 0x88888888, 0x1, p));
+  EXPECT_EQ(p.speed, 500000u);
+
+  profiles.forget("FT1234", 0x88888888, 0x1);
+  EXPECT_FALSE(profiles.lookup("FT1234", 0x88888888, 0x1, p));
+}
+
+TEST_F(DeviceProfiles_store, latestProfileOfAdapterIsUsedBeforeTheChipIsKnown){
+  DeviceProfiles profiles(path);
+  profiles.store("FT1234", profile(0x88888888, 0x1, 1000000));
+  {
+    std::ofstream ofs(path, std::ios::app);
+    ofs << "FT1234 88888888 2 460800 95 0 4102444800\n";
+    ofs << "garbage\n";
+  }
+
+  DeviceProfiles::Profile p;
+  ASSERT_TRUE(profiles.lookup("FT1234", p));
+  EXPECT_EQ(p.version, 0x2u);
+  EXPECT_EQ(p.ispReady, std::chrono::milliseconds(95));
+}
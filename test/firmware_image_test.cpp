@@ -0,0 +1,98 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <firmware_image.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+class FirmwareImage_load : public testing::Test{
+public:
+  void write(const std::vector<uint8_t>& content){
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char*>(content.data()), content.size());
+  }
+
+  void writeText(const std::string& content){
+    write(std::vector<uint8_t>(content.begin(), content.end()));
+  }
+
+  TempFile file{"fwimage"};
+  std::string path = file.path;
+};
+
+TEST_F(FirmwareImage_load, returnsFileSize){
+  write(std::vector<uint8_t>(1034, 0x5A));
+  FirmwareImage fw(path, 4096);
+  EXPECT_EQ(fw.size(), 1034u);
+}
+
+TEST_F(FirmwareImage_load, returnsFileContent){
+  std::vector<uint8_t> content(700);
+  for(unsigned int i=0;i<content.size();i++){
+    content[i] = i;
+  }
+  write(content);
+  FirmwareImage fw(path, 4096);
+  ASSERT_EQ(fw.segments().size(), 1u);
+  auto seg = fw.segments().front();
+  EXPECT_EQ(seg.address, 0u);
+  std::vector<uint8_t> mapped(seg.data, seg.data + seg.size);
+  EXPECT_THAT(mapped, testing::ContainerEq(content));
+}
+
+TEST_F(FirmwareImage_load, acceptsEmptyFile){
+  FirmwareImage fw(path, 4096);
+  EXPECT_EQ(fw.size(), 0u);
+  EXPECT_TRUE(fw.segments().empty());
+}
+
+TEST_F(FirmwareImage_load, acceptsImageFillingWholeMemory){
+  write(std::vector<uint8_t>(512, 0xFF));
+  FirmwareImage fw(path, 512);
+  EXPECT_EQ(fw.size(), 512u);
+}
+
+TEST_F(FirmwareImage_load, failsIfImageExceedsMemory){
+  write(std::vector<uint8_t>(513, 0xFF));
+  EXPECT_THROW(FirmwareImage(path, 512), std::runtime_error);
+}
+
+TEST_F(FirmwareImage_load, failsIfFileDoesNotExist){
+  EXPECT_THROW(FirmwareImage(path + ".missing", 512), std::runtime_error);
+}
+
+TEST_F(FirmwareImage_load, decodesIntelHexAsBinaryIfFormatIsGiven){
+  writeText(":0400100010111213A6\n:00000001FF\n");
+  FirmwareImage fw(path, 4096, FirmwareImage::Format::intelHex);
+  ASSERT_EQ(fw.segments().size(), 1u);
+  EXPECT_EQ(fw.segments().front().address, 0x10u);
+  EXPECT_EQ(fw.size(), 4u);
+}
+
+TEST_F(FirmwareImage_load, failsIfSegmentEndsBeyondMemory){
+  writeText(":020000040001F9\n:04020000DEADBEEFC2\n:00000001FF\n");
+  EXPECT_THROW(FirmwareImage(path, 0x10000, FirmwareImage::Format::intelHex), std::runtime_error);
+}
+
+TEST(FirmwareImage_detectFormat, detectsFormatFromExtension){
+  const uint8_t data[] = ":00000001FF";
+  EXPECT_EQ(FirmwareImage::detectFormat("fw.hex", data, sizeof(data)), FirmwareImage::Format::intelHex);
+  EXPECT_EQ(FirmwareImage::detectFormat("fw.S19", data, sizeof(data)), FirmwareImage::Format::sRecord);
+  EXPECT_EQ(FirmwareImage::detectFormat("fw.bin", data, sizeof(data)), FirmwareImage::Format::binary);
+}
+
+TEST(FirmwareImage_detectFormat, detectsElfFromMagic){
+  const uint8_t data[] = {0x7F, 'E', 'L', 'F', 1, 1, 1};
+  EXPECT_EQ(FirmwareImage::detectFormat("fw.bin", data, sizeof(data)), FirmwareImage::Format::elf);
+}
@@ -0,0 +1,125 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <firmware_stream.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <zlib.h>
+
+using ::testing::ContainerEq;
+
+static std::vector<uint8_t> pattern(std::size_t size){
+  std::vector<uint8_t> data(size);
+  for(unsigned int i=0;i<data.size();i++){
+    data[i] = i * 7;
+  }
+  return data;
+}
+
+static std::vector<uint8_t> drain(FirmwareStream& stream, std::vector<std::size_t>* sizes=nullptr){
+  std::vector<uint8_t> all, chunk;
+  while(stream.next(chunk)){
+    if(sizes){
+      sizes->push_back(chunk.size());
+    }
+    all.insert(all.end(), chunk.begin(), chunk.end());
+  }
+  return all;
+}
+
+class FirmwareStream_pipe : public testing::Test{
+public:
+  virtual void SetUp(){
+    ASSERT_EQ(pipe(fds), 0);
+    path = std::string("/dev/fd/") + std::to_string(fds[0]);
+  };
+  virtual void TearDown(){
+    if(writer.joinable()){
+      writer.join();
+    }
+    close(fds[0]);
+  };
+
+  void produce(const std::vector<uint8_t>& data){
+    writer = std::thread([this, data]{
+      std::size_t off = 0;
+      while(off < data.size()){
+        /* small writes so the reader sees partial chunks */
+        auto n = write(fds[1], data.data() + off, std::min<std::size_t>(100, data.size() - off));
+        if(n <= 0){
+          break;
+        }
+        off += n;
+      }
+      close(fds[1]);
+    });
+  }
+
+  int fds[2];
+  std::string path;
+  std::thread writer;
+};
+
+TEST_F(FirmwareStream_pipe, deliversPipeContentInPageSizedChunks){
+  auto data = pattern(1300);
+  produce(data);
+  FirmwareStream stream(path, 4096, 512);
+  std::vector<std::size_t> sizes;
+  auto received = drain(stream, &sizes);
+  EXPECT_THAT(received, ContainerEq(data));
+  EXPECT_THAT(sizes, ContainerEq(std::vector<std::size_t>{512, 512, 276}));
+  EXPECT_EQ(stream.bytesRead(), 1300u);
+}
+
+TEST_F(FirmwareStream_pipe, failsIfStreamExceedsMemory){
+  produce(pattern(2000));
+  FirmwareStream stream(path, 1024, 512);
+  EXPECT_THROW(drain(stream), std::runtime_error);
+}
+
+TEST_F(FirmwareStream_pipe, stopsReaderWaitingForInputOnDestruction){
+  {
+    FirmwareStream stream(path, 1024, 512);
+  }
+  close(fds[1]);
+}
+
+TEST(FirmwareStream_gzip, decompressesGzipFile){
+  TempFile file("fwstream");
+  auto data = pattern(100000);
+  gzFile gz = gzopen(file.path.c_str(), "wb");
+  ASSERT_NE(gz, nullptr);
+  gzwrite(gz, data.data(), data.size());
+  gzclose(gz);
+
+  FirmwareStream stream(file.path, 0x9DE00, 512);
+  auto received = drain(stream);
+  EXPECT_THAT(received, ContainerEq(data));
+}
+
+TEST(FirmwareStream_detectCompression, recognizesMagicBytes){
+  const uint8_t gz[] = {0x1F, 0x8B, 0x08, 0x00};
+  const uint8_t zst[] = {0x28, 0xB5, 0x2F, 0xFD};
+  const uint8_t raw[] = {0x00, 0x20, 0x01, 0x04};
+  EXPECT_EQ(FirmwareStream::detectCompression(gz, sizeof(gz)), FirmwareStream::Compression::gzip);
+  EXPECT_EQ(FirmwareStream::detectCompression(zst, sizeof(zst)), FirmwareStream::Compression::zstd);
+  EXPECT_EQ(FirmwareStream::detectCompression(raw, sizeof(raw)), FirmwareStream::Compression::none);
+}
+
+TEST(FirmwareStream_isStreamInput, treatsStdinAndCompressedFilesAsStreams){
+  EXPECT_TRUE(FirmwareStream::isStreamInput("-"));
+  EXPECT_TRUE(FirmwareStream::isStreamInput("fw.bin.gz"));
+  EXPECT_TRUE(FirmwareStream::isStreamInput("fw.bin.zst"));
+  EXPECT_FALSE(FirmwareStream::isStreamInput("fw.bin"));
+}
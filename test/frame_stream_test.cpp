@@ -0,0 +1,146 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <frame_stream.h>
+#include <k32w061.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+
+using ::testing::ContainerEq;
+
+class FrameStream_compile : public testing::Test{
+public:
+  void writeImage(const std::string& content){
+    std::ofstream ofs(image_path, std::ios::binary | std::ios::trunc);
+    ofs << content;
+  }
+
+  TempDir dir{"ispf"};
+  std::string image_path = dir.path + "/image.hex";
+  std::string stream_path = dir.path + "/image.ispf";
+};
+
+TEST_F(FrameStream_compile, writesOneFramePerChunk){
+  writeImage(":10000000000102030405060708090A0B0C0D0E0F78\n"
+             ":020000040001F9\n"
+             ":04020000DEADBEEFC2\n"
+             ":00000001FF\n");
+  FirmwareImage image(image_path, K32W061::FLASH_SIZE);
+  FrameStream::compile(image, stream_path);
+
+  EXPECT_TRUE(FrameStream::isFrameStream(stream_path));
+  FrameStream fs(stream_path);
+  EXPECT_EQ(fs.memory(), MCU::MemoryID::flash);
+  EXPECT_EQ(fs.handle(), 0);
+  EXPECT_EQ(fs.payloadSize(), 20u);
+  ASSERT_EQ(fs.frames().size(), 2u);
+  EXPECT_EQ(fs.frames()[0].address, 0x0u);
+  EXPECT_EQ(fs.frames()[1].address, 0x10200u);
+}
+
+TEST_F(FrameStream_compile, framesMatchOnlineEncoding){
+  std::vector<uint8_t> data(1100);
+  for(unsigned int i=0;i<data.size();i++){
+    data[i] = i;
+  }
+  image_path += ".bin";
+  {
+    std::ofstream ofs(image_path, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+  }
+  FirmwareImage image(image_path, K32W061::FLASH_SIZE);
+  FrameStream::compile(image, stream_path);
+  FrameStream fs(stream_path);
+
+  ASSERT_EQ(fs.frames().size(), 3u);
+  uint32_t offset = 0;
+  for(const auto& frame : fs.frames()){
+    auto chunk = K32W061::frameChunkSize(offset, data.size() - offset);
+    auto expected = K32W061::writeMemoryFrame(0, offset, data.data() + offset, chunk);
+    EXPECT_EQ(frame.address, offset);
+    EXPECT_THAT(std::vector<uint8_t>(frame.data, frame.data + frame.size), ContainerEq(expected));
+    offset += chunk;
+  }
+  /* across the border of the first two frames, but not beyond the image */
+  EXPECT_TRUE(fs.covers(MCU::MemoryID::flash, 0x1FC, 8));
+  EXPECT_FALSE(fs.covers(MCU::MemoryID::flash, 0x448, 8));
+  EXPECT_FALSE(fs.covers(MCU::MemoryID::psect, 0x0, 4));
+}
+
+TEST_F(FrameStream_compile, rejectsFileWithoutMagic){
+  writeImage("not a frame stream at all");
+  EXPECT_FALSE(FrameStream::isFrameStream(image_path));
+  EXPECT_THROW(FrameStream fs(image_path), std::runtime_error);
+}
+
+TEST_F(FrameStream_compile, rejectsMalformedFrames){
+  image_path += ".bin";
+  {
+    std::ofstream ofs(image_path, std::ios::binary | std::ios::trunc);
+    ofs << std::string(0x300, '\x5A');
+  }
+  FrameStream::compile(FirmwareImage(image_path, K32W061::FLASH_SIZE), stream_path);
+  std::string original;
+  {
+    std::ifstream ifs(stream_path, std::ios::binary);
+    original.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+  }
+  auto corrupt = [&](std::size_t offset, uint8_t value){
+    std::string content = original;
+    content[offset] = value;
+    std::ofstream(stream_path, std::ios::binary | std::ios::trunc) << content;
+  };
+  /* the first frame follows the 28 byte file header, the index offset is its fourth field */
+  const std::size_t frame = 28;
+  uint32_t index;
+  memcpy(&index, original.data() + 12, sizeof(index));
+
+  corrupt(frame, original[frame]);
+  EXPECT_NO_THROW(FrameStream fs(stream_path));
+  /* index entry shorter than the frame overhead */
+  corrupt(index + 8, 4);
+  EXPECT_THROW(FrameStream fs(stream_path), std::runtime_error);
+  /* frame header announces another size */
+  corrupt(frame + 2, original[frame + 2] ^ 1);
+  EXPECT_THROW(FrameStream fs(stream_path), std::runtime_error);
+  /* ReadMemory instead of WriteMemory */
+  corrupt(frame + 3, 0x46);
+  EXPECT_THROW(FrameStream fs(stream_path), std::runtime_error);
+  /* payload length does not match the frame */
+  corrupt(frame + 10, original[frame + 10] ^ 1);
+  EXPECT_THROW(FrameStream fs(stream_path), std::runtime_error);
+}
+
+TEST_F(FrameStream_compile, encodingInMemoryMatchesTheFile){
+  image_path += ".bin";
+  {
+    std::ofstream ofs(image_path, std::ios::binary | std::ios::trunc);
+    ofs << std::string(0x300, '\x5A');
+  }
+  FirmwareImage image(image_path, K32W061::FLASH_SIZE);
+  FrameStream::compile(image, stream_path);
+  FrameStream fs(stream_path);
+  auto encoded = FrameStream::encode(image);
+
+  EXPECT_EQ(encoded->payloadSize(), fs.payloadSize());
+  ASSERT_EQ(encoded->frames().size(), fs.frames().size());
+  for(std::size_t i=0;i<fs.frames().size();i++){
+    const auto& a = encoded->frames()[i];
+    const auto& b = fs.frames()[i];
+    EXPECT_EQ(a.address, b.address);
+    EXPECT_THAT(std::vector<uint8_t>(a.data, a.data + a.size), ContainerEq(std::vector<uint8_t>(b.data, b.data + b.size)));
+  }
+}
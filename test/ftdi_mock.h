@@ -16,12 +16,18 @@
 class FTDIMock : public FTDI::Interface {
 public:
   MOCK_METHOD2(open, void(const int vid, const int pid));
+  MOCK_METHOD1(open, void(std::string dev));
   MOCK_METHOD0(is_open, bool());
   MOCK_METHOD1(setCBUSPins, int(const FTDI::CBUSPins& pins));
   MOCK_METHOD0(disableCBUSMode, int());
 
   MOCK_METHOD1(writeData, int(std::vector<uint8_t> data));
   MOCK_METHOD0(readData, std::vector<uint8_t>());
+  MOCK_METHOD1(setReadTimeout, int(unsigned int milliseconds));
+  MOCK_METHOD1(setBaudrate, int(uint32_t speed));
+  MOCK_METHOD0(flushInput, void());
+  MOCK_CONST_METHOD0(latency, std::chrono::microseconds());
+  MOCK_CONST_METHOD1(supportsBaudrate, bool(uint32_t speed));
 };
 
 #endif /* _FTDI_MOCK_H_ */
\ No newline at end of file
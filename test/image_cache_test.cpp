@@ -0,0 +1,61 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <image_cache.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+class ImageCache_load : public testing::Test{
+public:
+  void write(std::size_t size){
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs << std::string(size, '\x5A');
+  }
+
+  TempFile file{"cache"};
+  std::string path = file.path;
+  ImageCache cache;
+};
+
+TEST_F(ImageCache_load, returnsCachedImage){
+  write(100);
+  auto first = cache.image(path, 4096);
+  auto second = cache.image(path, 4096);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(first->size(), 100u);
+}
+
+TEST_F(ImageCache_load, reloadsModifiedFile){
+  write(100);
+  auto first = cache.image(path, 4096);
+  std::remove(path.c_str());
+  write(200);
+  auto second = cache.image(path, 4096);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(second->size(), 200u);
+  EXPECT_EQ(first->size(), 100u);
+}
+
+TEST_F(ImageCache_load, encodesFramesOnce){
+  write(1000);
+  auto first = cache.frames(path, 4096);
+  auto second = cache.frames(path, 4096);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(first->payloadSize(), 1000u);
+  EXPECT_EQ(first->frames().size(), 2u);
+}
+
+TEST_F(ImageCache_load, failsIfFileDoesNotExist){
+  EXPECT_THROW(cache.image(path + ".missing", 4096), std::runtime_error);
+}
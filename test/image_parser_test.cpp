@@ -0,0 +1,175 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include <image_parser.h>
+#include <gmock/gmock.h>
+
+#include <elf.h>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+using ::testing::ContainerEq;
+
+static std::vector<uint8_t> bytes(const std::string& str){
+  return std::vector<uint8_t>(str.begin(), str.end());
+}
+
+TEST(ImageParser_insert, mergesAdjacentRanges){
+  ImageParser::SegmentMap map;
+  std::vector<uint8_t> a{1, 2}, b{3, 4};
+  ImageParser::insert(map, 0x100, a.data(), a.size());
+  ImageParser::insert(map, 0x102, b.data(), b.size());
+  ASSERT_EQ(map.size(), 1u);
+  EXPECT_THAT(map.at(0x100), ContainerEq(std::vector<uint8_t>{1, 2, 3, 4}));
+}
+
+TEST(ImageParser_insert, closesGapBetweenRanges){
+  ImageParser::SegmentMap map;
+  std::vector<uint8_t> a{1}, b{2}, c{3};
+  ImageParser::insert(map, 0x10, a.data(), a.size());
+  ImageParser::insert(map, 0x12, c.data(), c.size());
+  ImageParser::insert(map, 0x11, b.data(), b.size());
+  ASSERT_EQ(map.size(), 1u);
+  EXPECT_THAT(map.at(0x10), ContainerEq(std::vector<uint8_t>{1, 2, 3}));
+}
+
+TEST(ImageParser_insert, keepsGapsAsSeparateRanges){
+  ImageParser::SegmentMap map;
+  std::vector<uint8_t> a{1, 2};
+  ImageParser::insert(map, 0x0, a.data(), a.size());
+  ImageParser::insert(map, 0x1000, a.data(), a.size());
+  EXPECT_EQ(map.size(), 2u);
+}
+
+TEST(ImageParser_insert, failsOnOverlap){
+  ImageParser::SegmentMap map;
+  std::vector<uint8_t> a{1, 2, 3, 4};
+  ImageParser::insert(map, 0x10, a.data(), a.size());
+  EXPECT_THROW(ImageParser::insert(map, 0x12, a.data(), a.size()), std::runtime_error);
+  EXPECT_THROW(ImageParser::insert(map, 0x0E, a.data(), a.size()), std::runtime_error);
+}
+
+TEST(ImageParser_parseIntelHex, returnsSparseRanges){
+  auto hex = bytes(":10000000000102030405060708090A0B0C0D0E0F78\r\n"
+                   ":0400100010111213A6\r\n"
+                   ":020000040001F9\r\n"
+                   ":04020000DEADBEEFC2\r\n"
+                   ":00000001FF\r\n");
+  auto map = ImageParser::parseIntelHex(hex.data(), hex.size());
+  ASSERT_EQ(map.size(), 2u);
+  std::vector<uint8_t> first(20);
+  for(unsigned int i=0;i<first.size();i++){
+    first[i] = i;
+  }
+  EXPECT_THAT(map.at(0x0), ContainerEq(first));
+  EXPECT_THAT(map.at(0x10200), ContainerEq(std::vector<uint8_t>{0xDE, 0xAD, 0xBE, 0xEF}));
+}
+
+TEST(ImageParser_parseIntelHex, failsIfChecksumIsWrong){
+  auto hex = bytes(":0400100010111213A7\n:00000001FF\n");
+  EXPECT_THROW(ImageParser::parseIntelHex(hex.data(), hex.size()), std::runtime_error);
+}
+
+TEST(ImageParser_parseIntelHex, failsIfAddressRecordIsNotTwoBytes){
+  auto empty = bytes(":00000004FC\n:00000001FF\n");
+  EXPECT_THROW(ImageParser::parseIntelHex(empty.data(), empty.size()), std::runtime_error);
+  auto shortSegment = bytes(":0100000201FC\n:00000001FF\n");
+  EXPECT_THROW(ImageParser::parseIntelHex(shortSegment.data(), shortSegment.size()), std::runtime_error);
+  auto shortLinear = bytes(":0100000401FA\n:00000001FF\n");
+  EXPECT_THROW(ImageParser::parseIntelHex(shortLinear.data(), shortLinear.size()), std::runtime_error);
+}
+
+TEST(ImageParser_parseIntelHex, failsWithoutEndOfFileRecord){
+  auto hex = bytes(":0400100010111213A6\n");
+  EXPECT_THROW(ImageParser::parseIntelHex(hex.data(), hex.size()), std::runtime_error);
+}
+
+TEST(ImageParser_parseSRecord, returnsSparseRanges){
+  auto srec = bytes("S00600004844521B\n"
+                    "S107010001020304ED\n"
+                    "S3090002000005060708DA\n"
+                    "S30700020004090ADF\n"
+                    "S70500000000FA\n");
+  auto map = ImageParser::parseSRecord(srec.data(), srec.size());
+  ASSERT_EQ(map.size(), 2u);
+  EXPECT_THAT(map.at(0x100), ContainerEq(std::vector<uint8_t>{1, 2, 3, 4}));
+  EXPECT_THAT(map.at(0x20000), ContainerEq(std::vector<uint8_t>{5, 6, 7, 8, 9, 10}));
+}
+
+TEST(ImageParser_parseSRecord, failsIfChecksumIsWrong){
+  auto srec = bytes("S107010001020304EE\n");
+  EXPECT_THROW(ImageParser::parseSRecord(srec.data(), srec.size()), std::runtime_error);
+}
+
+static std::vector<uint8_t> makeElf(const std::vector<Elf32_Phdr>& phdrs, std::size_t size){
+  std::vector<uint8_t> elf(size);
+  Elf32_Ehdr ehdr{};
+  memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type = ET_EXEC;
+  ehdr.e_machine = EM_ARM;
+  ehdr.e_phoff = sizeof(Elf32_Ehdr);
+  ehdr.e_phentsize = sizeof(Elf32_Phdr);
+  ehdr.e_phnum = phdrs.size();
+  memcpy(elf.data(), &ehdr, sizeof(ehdr));
+  memcpy(elf.data() + sizeof(ehdr), phdrs.data(), phdrs.size() * sizeof(Elf32_Phdr));
+  return elf;
+}
+
+TEST(ImageParser_parseElf, returnsLoadSegmentsAtPhysicalAddress){
+  Elf32_Phdr text{};
+  text.p_type = PT_LOAD;
+  text.p_offset = 0x100;
+  text.p_vaddr = 0x0;
+  text.p_paddr = 0x0;
+  text.p_filesz = 0x40;
+  text.p_memsz = 0x40;
+  Elf32_Phdr data{};
+  data.p_type = PT_LOAD;
+  data.p_offset = 0x140;
+  data.p_vaddr = 0x04000000;
+  data.p_paddr = 0x2000;
+  data.p_filesz = 0x10;
+  data.p_memsz = 0x80;
+  Elf32_Phdr bss{};
+  bss.p_type = PT_LOAD;
+  bss.p_vaddr = 0x04000080;
+  bss.p_memsz = 0x100;
+  Elf32_Phdr note{};
+  note.p_type = PT_NOTE;
+  note.p_filesz = 0x10;
+
+  auto elf = makeElf({text, data, bss, note}, 0x200);
+  auto segments = ImageParser::parseElf(elf.data(), elf.size());
+  ASSERT_EQ(segments.size(), 2u);
+  EXPECT_EQ(segments[0].address, 0x0u);
+  EXPECT_EQ(segments[0].offset, 0x100u);
+  EXPECT_EQ(segments[0].size, 0x40u);
+  EXPECT_EQ(segments[1].address, 0x2000u);
+  EXPECT_EQ(segments[1].offset, 0x140u);
+  EXPECT_EQ(segments[1].size, 0x10u);
+}
+
+TEST(ImageParser_parseElf, failsIfSegmentExceedsFile){
+  Elf32_Phdr text{};
+  text.p_type = PT_LOAD;
+  text.p_offset = 0x100;
+  text.p_filesz = 0x200;
+  auto elf = makeElf({text}, 0x200);
+  EXPECT_THROW(ImageParser::parseElf(elf.data(), elf.size()), std::runtime_error);
+}
+
+TEST(ImageParser_parseElf, failsOn64BitElf){
+  auto elf = makeElf({}, 0x100);
+  elf[EI_CLASS] = ELFCLASS64;
+  EXPECT_THROW(ImageParser::parseElf(elf.data(), elf.size()), std::runtime_error);
+}
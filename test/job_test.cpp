@@ -0,0 +1,100 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "temp_file.h"
+#include <job.h>
+#include <options.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <unistd.h>
+
+class Job_pendingFrames : public testing::Test{
+public:
+  virtual void SetUp(){
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs << std::string(0x300, '\x5A');
+  };
+
+  Job build(std::vector<std::string> args){
+    return Options::buildJob(Options::parseJob(args, "in a test"), "", nullptr, true);
+  }
+
+  TempFile file{"job"};
+  std::string path = file.path;
+};
+
+TEST_F(Job_pendingFrames, firmwareIsEncodedWhileTheJobIsPrepared){
+  auto job = build({"-f", path, "--format", "bin"});
+  EXPECT_FALSE(job.frames);
+  ASSERT_TRUE(job.pendingFrames.valid());
+
+  auto frames = job.firmwareFrames();
+  ASSERT_TRUE(frames);
+  EXPECT_EQ(frames->payloadSize(), 0x300u);
+  /* the same frames on every call, they are shared by all devices */
+  EXPECT_EQ(job.firmwareFrames(), frames);
+}
+
+TEST_F(Job_pendingFrames, missingFirmwareFailsBeforeEncoding){
+  std::remove(path.c_str());
+  try{
+    build({"-f", path});
+    FAIL() << "Expected std::runtime_error";
+  }catch(const std::runtime_error& e){
+    EXPECT_THAT(e.what(), testing::HasSubstr("Could not open firmware " + path));
+  }
+}
+
+TEST_F(Job_pendingFrames, programMustBeOrderedForPendingFrames){
+  EXPECT_THROW(build({"-f", path, "--format", "bin", "--order", "verify,reset"}), std::runtime_error);
+  EXPECT_NO_THROW(build({"-f", path, "--format", "bin", "--order", "program,reset"}));
+}
+
+TEST_F(Job_pendingFrames, encodingErrorsAreRethrownToTheJob){
+  Job job;
+  job.pendingFrames = std::async(std::launch::async, []() -> std::shared_ptr<const FrameStream>{
+    throw std::runtime_error("broken image");
+  }).share();
+  EXPECT_NO_THROW(job.validate());
+  EXPECT_THROW(job.firmwareFrames(), std::runtime_error);
+  /* every device of the job sees the error, not only the first */
+  EXPECT_THROW(job.firmwareFrames(), std::runtime_error);
+}
+
+TEST_F(Job_pendingFrames, readyFramesArePreferred){
+  Job job;
+  EXPECT_FALSE(job.firmwareFrames());
+  std::promise<std::shared_ptr<const FrameStream>> never;
+  job.pendingFrames = never.get_future().share();
+  job.frames = build({"-f", path, "--format", "bin"}).firmwareFrames();
+  /* does not wait for the pending frames */
+  EXPECT_EQ(job.firmwareFrames(), job.frames);
+}
+
+static Job buildSpeed(const std::string& speed){
+  return Options::buildJob(Options::parseJob({"--speed", speed}, "in a test"), "", nullptr, true);
+}
+
+TEST(Job_speed, parsesFixedAndAutomaticRates){
+  EXPECT_EQ(buildSpeed("1000000").speed, 1000000u);
+  auto job = buildSpeed("auto:500000");
+  EXPECT_TRUE(job.autoSpeed);
+  EXPECT_EQ(job.speed, 500000u);
+  EXPECT_EQ(buildSpeed("auto").speed, 0u);
+}
+
+TEST(Job_speed, rejectsNegativeAndOversizedRates){
+  EXPECT_THROW(buildSpeed("-1"), std::runtime_error);
+  EXPECT_THROW(buildSpeed("auto:-1"), std::runtime_error);
+  EXPECT_THROW(buildSpeed("4294967296"), std::runtime_error);
+  EXPECT_THROW(buildSpeed("1000000x"), std::runtime_error);
+}
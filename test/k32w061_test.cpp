@@ -11,11 +11,16 @@
 
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <zlib.h>
 
 using ::testing::_;
 using ::testing::Return;
 using ::testing::ContainerEq;
 using ::testing::AllOf;
+using ::testing::Invoke;
 
 int ftdi_usb_close(struct ftdi_context *ftdi){
   return 0;
@@ -36,7 +41,7 @@ public:
 
   virtual void SetUp(){};
   virtual void TearDown(){};
-  FTDIMock ftdi;
+  ::testing::NiceMock<FTDIMock> ftdi;
   K32W061 dev;
 };
 
@@ -47,6 +52,7 @@ class K32W061_MemoryIsErased : public K32W061_EnableISPMode {};
 class K32W061_FlashMemory : public K32W061_EnableISPMode {};
 class K32W061_CloseMemory : public K32W061_EnableISPMode {};
 class K32W061_Reset : public K32W061_EnableISPMode {};
+class K32W061_ReadMemory : public K32W061_EnableISPMode {};
 
 TEST_F(K32W061_EnableISPMode, callsReadAfterWrite){
   testing::Sequence s1;
@@ -557,6 +563,92 @@ TEST_F(K32W061_FlashMemory, largePayloadIsSplitInto512byteChunks){
   dev.flashMemory(0, data);
 }
 
+TEST_F(K32W061_FlashMemory, framesDoNotCrossFlashPages){
+  std::vector<uint8_t> resp{0x00, 0x00, 0x09, 0x49, 0x00, 0xE8, 0x48, 0x38, 0xDE};
+  EXPECT_CALL(ftdi, writeData(AllOf(FrameMemoryAddressEq(0x1200u), FrameMemoryPayloadLengthEq(100u))) ).Times(1).WillOnce(Return(118));
+  EXPECT_CALL(ftdi, writeData(AllOf(FrameMemoryAddressEq(0x1000u), FrameMemoryPayloadLengthEq(512u))) ).Times(1).WillOnce(Return(530));
+  EXPECT_CALL(ftdi, writeData(AllOf(FrameMemoryAddressEq(0xF00u), FrameMemoryPayloadLengthEq(256u))) ).Times(1).WillOnce(Return(274));
+  EXPECT_CALL(ftdi, readData()).WillRepeatedly(Return(resp));
+  std::vector<uint8_t> data(868);
+  dev.flashMemory(0, 0xF00, data.data(), data.size());
+}
+
+TEST_F(K32W061_FlashMemory, keepsWindowOfFramesInFlight){
+  std::vector<uint8_t> resp{0x00, 0x00, 0x09, 0x49, 0x00, 0xE8, 0x48, 0x38, 0xDE};
+  testing::InSequence s;
+  EXPECT_CALL(ftdi, writeData(FrameMemoryAddressEq(0u))).WillOnce(Return(530));
+  EXPECT_CALL(ftdi, writeData(FrameMemoryAddressEq(512u))).WillOnce(Return(530));
+  EXPECT_CALL(ftdi, writeData(FrameMemoryAddressEq(1024u))).WillOnce(Return(530));
+  EXPECT_CALL(ftdi, readData()).WillOnce(Return(resp));
+  EXPECT_CALL(ftdi, writeData(FrameMemoryAddressEq(1536u))).WillOnce(Return(530));
+  EXPECT_CALL(ftdi, readData()).Times(3).WillRepeatedly(Return(resp));
+  dev.setWriteWindow(3);
+  std::vector<uint8_t> data(2048);
+  EXPECT_EQ(dev.flashMemory(0, data), 0);
+}
+
+TEST_F(K32W061_FlashMemory, sendsPrecompiledFramesWithWindowInFlight){
+  std::vector<uint8_t> resp{0x00, 0x00, 0x09, 0x49, 0x00, 0xE8, 0x48, 0x38, 0xDE};
+  std::vector<std::vector<uint8_t>> encoded;
+  std::vector<MCU::Frame> frames;
+  for(uint32_t address = 0; address < 2048; address += 512){
+    std::vector<uint8_t> data(512);
+    encoded.push_back(K32W061::writeMemoryFrame(0, address, data.data(), data.size()));
+  }
+  for(const auto& frame : encoded){
+    frames.push_back(MCU::Frame{frame.data(), frame.size()});
+  }
+  {
+    testing::InSequence s;
+    EXPECT_CALL(ftdi, writeData(FrameMemoryAddressEq(0u))).WillOnce(Return(530));
+    EXPECT_CALL(ftdi, writeData(FrameMemoryAddressEq(512u))).WillOnce(Return(530));
+    EXPECT_CALL(ftdi, readData()).WillOnce(Return(resp));
+    EXPECT_CALL(ftdi, writeData(FrameMemoryAddressEq(1024u))).WillOnce(Return(530));
+    EXPECT_CALL(ftdi, readData()).WillOnce(Return(resp));
+    EXPECT_CALL(ftdi, writeData(FrameMemoryAddressEq(1536u))).WillOnce(Return(530));
+    EXPECT_CALL(ftdi, readData()).Times(2).WillRepeatedly(Return(resp));
+  }
+  dev.setWriteWindow(2);
+  std::vector<std::size_t> acknowledged;
+  EXPECT_EQ(dev.sendFrames(frames, [&acknowledged](std::size_t index){ acknowledged.push_back(index); }), 0);
+  EXPECT_EQ(acknowledged, std::vector<std::size_t>({0, 1, 2, 3}));
+}
+
+TEST(K32W061_WriteWindow, coversTheRoundTrip){
+  /* local adapters wait for every response */
+  EXPECT_EQ(K32W061::writeWindow(115200, 530, std::chrono::microseconds(0)), 1u);
+  /* a 530 byte frame takes 5.3 ms at 1 MBaud, 20 ms round trip */
+  EXPECT_EQ(K32W061::writeWindow(1000000, 530, std::chrono::milliseconds(20)), 5u);
+  EXPECT_EQ(K32W061::writeWindow(1000000, 530, std::chrono::seconds(1)), K32W061::MAX_WRITE_WINDOW);
+}
+
+TEST(K32W061_PatchWriteFrame, matchesFreshlyEncodedFrame){
+  std::vector<uint8_t> data(300);
+  for(std::size_t i=0;i<data.size();i++){
+    data[i] = i & 0xFF;
+  }
+  auto frame = K32W061::writeMemoryFrame(0, 0x2000, data.data(), data.size());
+  std::vector<uint8_t> patch{0xDE, 0xAD, 0xBE, 0xEF};
+  K32W061::patchWriteFrame(frame, 17, patch.data(), patch.size());
+
+  std::copy(patch.begin(), patch.end(), data.begin() + 17);
+  EXPECT_THAT(frame, ContainerEq(K32W061::writeMemoryFrame(0, 0x2000, data.data(), data.size())));
+}
+
+TEST(K32W061_PatchWriteFrame, movesFrameToAnotherHandle){
+  std::vector<uint8_t> data(300, 0xA5);
+  auto frame = K32W061::writeMemoryFrame(0, 0x2000, data.data(), data.size());
+  K32W061::setWriteFrameHandle(frame, 3);
+  EXPECT_THAT(frame, ContainerEq(K32W061::writeMemoryFrame(3, 0x2000, data.data(), data.size())));
+}
+
+TEST(K32W061_PatchWriteFrame, failsIfPatchExceedsPayload){
+  std::vector<uint8_t> data(8);
+  auto frame = K32W061::writeMemoryFrame(0, 0, data.data(), data.size());
+  std::vector<uint8_t> patch(4);
+  EXPECT_THROW(K32W061::patchWriteFrame(frame, 6, patch.data(), patch.size()), std::out_of_range);
+}
+
 TEST_F(K32W061_FlashMemory, failsifWriteFails){
   
   EXPECT_CALL(ftdi, writeData(_)).Times(1).WillOnce(Return(-1));
@@ -768,4 +860,95 @@ TEST_F(K32W061_Reset, failsIfResponseIsNotSuccess){
   EXPECT_CALL(ftdi, readData()).Times(1).WillOnce(Return(resp));
   auto ret = dev.reset();
   EXPECT_NE(ret, 0);
-}
\ No newline at end of file
+}
+static std::vector<uint8_t> readMemoryResponse(const std::vector<uint8_t>& data){
+  std::vector<uint8_t> resp{0x00, 0x00, uint8_t(data.size() + 9), 0x47, 0x00};
+  resp.insert(resp.end(), data.begin(), data.end());
+  auto crc = crc32(0, resp.data(), resp.size());
+  resp.push_back(crc >> 24);
+  resp.push_back(crc >> 16);
+  resp.push_back(crc >> 8);
+  resp.push_back(crc);
+  return resp;
+}
+
+TEST_F(K32W061_ReadMemory, verifyRequestPayload){
+  std::vector<uint8_t> payload{0x02, 0x00, 0x10, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00};
+  EXPECT_CALL(ftdi, writeData(AllOf(FrameTypeIs(0x46), FramePayloadEq(payload)))).WillOnce(Return(18));
+  EXPECT_CALL(ftdi, readData()).WillOnce(Return(readMemoryResponse({1, 2, 3, 4})));
+  std::vector<uint8_t> data(4);
+  EXPECT_EQ(dev.readMemory(2, 0x10, data.data(), data.size()), 0);
+  EXPECT_THAT(data, ContainerEq(std::vector<uint8_t>{1, 2, 3, 4}));
+}
+
+TEST_F(K32W061_ReadMemory, failsIfResponseCrcIsWrong){
+  auto resp = readMemoryResponse({1, 2, 3, 4});
+  resp.back() ^= 0xFF;
+  EXPECT_CALL(ftdi, writeData(_)).WillOnce(Return(18));
+  EXPECT_CALL(ftdi, readData()).WillOnce(Return(resp));
+  std::vector<uint8_t> data(4);
+  EXPECT_LT(dev.readMemory(0, 0, data.data(), data.size()), 0);
+}
+
+TEST_F(K32W061_ReadMemory, failsIfResponseIsShort){
+  EXPECT_CALL(ftdi, writeData(_)).WillOnce(Return(18));
+  EXPECT_CALL(ftdi, readData()).WillOnce(Return(readMemoryResponse({1, 2})));
+  std::vector<uint8_t> data(4);
+  EXPECT_LT(dev.readMemory(0, 0, data.data(), data.size()), 0);
+}
+
+class K32W061_ResponseTimeout : public K32W061_EnableISPMode {};
+
+TEST_F(K32W061_ResponseTimeout, growsWithFrameSizeAndWork){
+  EXPECT_EQ(K32W061::responseTimeout(115200, 1152, std::chrono::milliseconds(0)).count(), 100 + 100);
+  EXPECT_EQ(K32W061::responseTimeout(1000000, 1152, std::chrono::milliseconds(10)).count(), 12 + 100 + 10);
+}
+
+TEST_F(K32W061_ResponseTimeout, throwsIfDeviceStaysSilent){
+  dev.setResponseTimeout(std::chrono::milliseconds(20));
+  EXPECT_CALL(ftdi, writeData(_)).WillOnce(Return(8));
+  EXPECT_CALL(ftdi, readData()).WillRepeatedly(Invoke([](){
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    return std::vector<uint8_t>();
+  }));
+  EXPECT_THROW(dev.getDeviceInfo(), MCU::TimeoutError);
+}
+
+TEST_F(K32W061_ResponseTimeout, stopsWaitingWhenCancelled){
+  std::atomic<bool> cancel{false};
+  dev.setCancel(&cancel);
+  EXPECT_CALL(ftdi, writeData(_)).WillOnce(Return(8));
+  EXPECT_CALL(ftdi, readData()).WillOnce(Invoke([&cancel](){
+    std::this_thread::sleep_for(std::chrono::milliseconds(K32W061::CANCEL_POLL_MS + 5));
+    cancel = true;
+    return std::vector<uint8_t>();
+  }));
+  EXPECT_THROW(dev.reset(), MCU::Cancelled);
+}
+
+class K32W061_SetBaudrate : public K32W061_EnableISPMode {
+public:
+  static std::vector<uint8_t> response(){
+    std::vector<uint8_t> resp{0x00, 0x00, 0x09, 0x28, 0x00};
+    auto crc = crc32(0, resp.data(), resp.size());
+    resp.push_back(crc >> 24);
+    resp.push_back(crc >> 16);
+    resp.push_back(crc >> 8);
+    resp.push_back(crc);
+    return resp;
+  }
+};
+
+TEST_F(K32W061_SetBaudrate, followsTheDevice){
+  EXPECT_CALL(ftdi, writeData(FrameTypeIs(0x27))).WillOnce(Return(13));
+  EXPECT_CALL(ftdi, readData()).WillOnce(Return(response()));
+  EXPECT_CALL(ftdi, setBaudrate(1000000u)).WillOnce(Return(0));
+  EXPECT_EQ(dev.setBaudrate(1000000), 0);
+}
+
+TEST_F(K32W061_SetBaudrate, failsIfTheTransportCanNotFollow){
+  EXPECT_CALL(ftdi, writeData(FrameTypeIs(0x27))).WillOnce(Return(13));
+  EXPECT_CALL(ftdi, readData()).WillOnce(Return(response()));
+  EXPECT_CALL(ftdi, setBaudrate(1000000u)).WillOnce(Return(-1));
+  EXPECT_NE(dev.setBaudrate(1000000), 0);
+}
@@ -0,0 +1,93 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <manifest.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+using ::testing::ContainerEq;
+
+class Manifest_parse : public testing::Test{
+public:
+  virtual void SetUp(){
+    for(auto n : {"ttyUSB0", "ttyUSB1", "ttyACM0"}){
+      std::ofstream(dir + "/" + n);
+    }
+  };
+
+  Manifest parse(const std::string& json){
+    std::istringstream is(json);
+    return Manifest(is, dir);
+  }
+
+  TempDir tmp{"manifest"};
+  std::string dir = tmp.path;
+};
+
+TEST_F(Manifest_parse, turnsKeysIntoOptions){
+  auto manifest = parse(R"({
+    "concurrency": 2,
+    "retries": 1,
+    "firmware": "app.hex",
+    "verify": true,
+    "reset": false,
+    "erase": ["PSECT", "CONFIG"],
+    "devices": [ { "interface": ")" + dir + R"(/ttyUSB0", "speed": 1000000 } ]
+  })");
+  EXPECT_EQ(manifest.concurrency(), 2u);
+  EXPECT_EQ(manifest.retries(), 1u);
+  ASSERT_EQ(manifest.devices().size(), 1u);
+  EXPECT_EQ(manifest.devices()[0].interface, dir + "/ttyUSB0");
+  EXPECT_THAT(manifest.devices()[0].args, ContainerEq(std::vector<std::string>{
+    "--erase", "PSECT", "--erase", "CONFIG", "--firmware", "app.hex", "--speed", "1000000", "--verify"}));
+}
+
+TEST_F(Manifest_parse, deviceOverridesTopLevelAndMergesFields){
+  auto manifest = parse(R"({
+    "speed": 115200,
+    "set": { "SERIAL": "1", "MAC": "00:11" },
+    "devices": [
+      { "interface": ")" + dir + R"(/ttyUSB0", "speed": 1000000, "set": { "SERIAL": "2" } },
+      { "interface": ")" + dir + R"(/ttyACM0" }
+    ]
+  })");
+  ASSERT_EQ(manifest.devices().size(), 2u);
+  EXPECT_THAT(manifest.devices()[0].args, ContainerEq(std::vector<std::string>{
+    "--speed", "1000000", "--set", "MAC=00:11", "--set", "SERIAL=2"}));
+  EXPECT_THAT(manifest.devices()[1].args, ContainerEq(std::vector<std::string>{
+    "--speed", "115200", "--set", "MAC=00:11", "--set", "SERIAL=1"}));
+}
+
+TEST_F(Manifest_parse, expandsInterfaceGlobs){
+  auto manifest = parse(R"({ "devices": [ { "interface": ")" + dir + R"(/ttyUSB*" } ] })");
+  ASSERT_EQ(manifest.devices().size(), 2u);
+  EXPECT_EQ(manifest.devices()[0].interface, dir + "/ttyUSB0");
+  EXPECT_EQ(manifest.devices()[1].interface, dir + "/ttyUSB1");
+}
+
+TEST_F(Manifest_parse, failsOnInvalidManifests){
+  EXPECT_THROW(parse("{"), std::runtime_error);
+  EXPECT_THROW(parse(R"({ "firmware": "app.hex" })"), std::runtime_error);
+  EXPECT_THROW(parse(R"({ "devices": [ { "speed": 1 } ] })"), std::runtime_error);
+  EXPECT_THROW(parse(R"({ "concurrency": -1, "devices": [ { "interface": ")" + dir + R"(/ttyUSB0" } ] })"), std::runtime_error);
+  EXPECT_THROW(parse(R"({ "devices": [ { "interface": ")" + dir + R"(/ttyUSB*" }, { "interface": ")" + dir + R"(/ttyUSB0" } ] })"), std::runtime_error);
+  EXPECT_THROW(parse(R"({ "devices": [ { "interface": ")" + dir + R"(/ttyS*" } ] })"), std::runtime_error);
+}
+
+TEST_F(Manifest_parse, resolvesPathsAgainstItsDirectory){
+  std::ofstream(dir + "/run.json") << R"({ "devices": [ { "interface": ")" + dir + R"(/ttyUSB0" } ] })";
+  Manifest manifest(dir + "/run.json");
+  EXPECT_EQ(manifest.directory(), dir);
+}
@@ -0,0 +1,34 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _MCU_MOCK_H_
+#define _MCU_MOCK_H_
+
+#include <mcu.h>
+
+#include <gmock/gmock.h>
+
+class MCUMock : public MCU {
+public:
+  MOCK_METHOD1(enableISPMode, int(const std::vector<uint8_t> key));
+  MOCK_METHOD0(getDeviceInfo, DeviceInfo());
+  MOCK_METHOD3(eraseMemory, int(uint8_t handle, uint32_t address, uint32_t length));
+  MOCK_METHOD1(getMemoryHandle, int(const MemoryID));
+  MOCK_METHOD3(memoryIsErased, bool(uint8_t handle, uint32_t address, uint32_t length));
+  MOCK_METHOD4(flashMemory, int(uint8_t handle, uint32_t address, const uint8_t* data, std::size_t size));
+  MOCK_METHOD2(sendFrames, int(const std::vector<Frame>& frames, const std::function<void(std::size_t index)>& acknowledged));
+  MOCK_METHOD4(readMemory, int(uint8_t handle, uint32_t address, uint8_t* data, std::size_t size));
+  MOCK_METHOD1(closeMemory, int(uint8_t handle));
+  MOCK_METHOD0(reset, int());
+  MOCK_METHOD1(setBaudrate, int(uint32_t speed));
+  MOCK_CONST_METHOD1(memoryInfo, MemoryInfo(const MemoryID));
+  MOCK_METHOD1(setResponseTimeout, void(std::chrono::milliseconds timeout));
+  MOCK_METHOD1(setCancel, void(const std::atomic<bool>* cancel));
+};
+
+#endif /* _MCU_MOCK_H_ */
@@ -0,0 +1,80 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include <nxpisp.h>
+#include <gmock/gmock.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+using ::testing::HasSubstr;
+using ::testing::Contains;
+
+/* the interface does not exist, so every operation fails at ISP entry */
+class NXPISP_session : public testing::Test{
+public:
+  virtual void SetUp(){
+    session = nxpisp_open("/nonexistent/ttyUSB0");
+    ASSERT_NE(session, nullptr);
+    nxpisp_callbacks callbacks{};
+    callbacks.size = sizeof(callbacks);
+    callbacks.user = this;
+    callbacks.log = [](void* user, int severity, const char* message){
+      auto self = static_cast<NXPISP_session*>(user);
+      std::lock_guard<std::mutex> lock(self->mutex);
+      if(severity >= NXPISP_LOG_ERROR){
+        self->errors.push_back(message);
+      }
+    };
+    callbacks.done = [](void* user, int status, const char*){
+      auto self = static_cast<NXPISP_session*>(user);
+      std::lock_guard<std::mutex> lock(self->mutex);
+      self->done.push_back(status);
+    };
+    ASSERT_EQ(nxpisp_set_callbacks(session, &callbacks), NXPISP_OK);
+  };
+  virtual void TearDown(){
+    nxpisp_close(session);
+  };
+
+  nxpisp_session* session;
+  std::mutex mutex;
+  std::vector<std::string> errors;
+  std::vector<int> done;
+};
+
+TEST(NXPISP_api, reportsVersion){
+  EXPECT_EQ(nxpisp_api_version(), unsigned(NXPISP_API_VERSION));
+  EXPECT_STRNE(nxpisp_version(), "");
+}
+
+TEST_F(NXPISP_session, rejectsInvalidOptions){
+  const char* args[] = {"--no-such-option"};
+  EXPECT_EQ(nxpisp_run(session, args, 1), NXPISP_INVALID);
+  EXPECT_THAT(nxpisp_last_error(session), HasSubstr("no-such-option"));
+  const char* daemon[] = {"--daemon", "/tmp/socket"};
+  EXPECT_EQ(nxpisp_run(session, daemon, 2), NXPISP_INVALID);
+}
+
+TEST_F(NXPISP_session, reportsFailedOperations){
+  const char* args[] = {"-n", "--timing", "fast"};
+  EXPECT_EQ(nxpisp_run(session, args, 3), NXPISP_ERROR);
+  EXPECT_THAT(nxpisp_last_error(session), HasSubstr("Could not enable ISP Mode"));
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_THAT(errors, Contains(HasSubstr("Could not enable ISP Mode")));
+  EXPECT_THAT(done, Contains(NXPISP_ERROR));
+}
+
+TEST_F(NXPISP_session, cancelsRunningOperation){
+  const char* args[] = {"-n", "--timing", "slow"};
+  ASSERT_EQ(nxpisp_start(session, args, 3), NXPISP_OK);
+  EXPECT_EQ(nxpisp_start(session, args, 3), NXPISP_BUSY);
+  EXPECT_EQ(nxpisp_cancel(session), NXPISP_OK);
+  EXPECT_EQ(nxpisp_wait(session), NXPISP_CANCELLED);
+}
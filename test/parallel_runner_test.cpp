@@ -0,0 +1,119 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <parallel_runner.h>
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+using ::testing::ContainerEq;
+using ::testing::HasSubstr;
+
+class ParallelRunner_expand : public testing::Test{
+public:
+  virtual void SetUp(){
+    for(auto n : {"ttyUSB1", "ttyUSB0", "ttyACM0"}){
+      std::ofstream(dir + "/" + n);
+    }
+  };
+
+  TempDir tmp{"parallel"};
+  std::string dir = tmp.path;
+};
+
+TEST_F(ParallelRunner_expand, expandsGlobsSortedAndUnique){
+  auto interfaces = ParallelRunner::expand({dir + "/ttyUSB*", dir + "/ttyUSB0"});
+  EXPECT_THAT(interfaces, ContainerEq(std::vector<std::string>{dir + "/ttyUSB0", dir + "/ttyUSB1"}));
+}
+
+TEST_F(ParallelRunner_expand, keepsUsbSelectors){
+  auto interfaces = ParallelRunner::expand({"serial:A50285BI", dir + "/ttyACM0", "usb:1-1.2"});
+  EXPECT_THAT(interfaces, ContainerEq(std::vector<std::string>{dir + "/ttyACM0", "serial:A50285BI", "usb:1-1.2"}));
+}
+
+TEST_F(ParallelRunner_expand, failsIfNothingMatches){
+  EXPECT_THROW(ParallelRunner::expand({dir + "/ttyS*"}), std::runtime_error);
+}
+
+TEST(ParallelRunner_run, runsTasksConcurrently){
+  std::atomic<int> running{0};
+  std::atomic<int> peak{0};
+  auto results = ParallelRunner::run({"a", "b", "c"}, [&](const std::string&){
+    auto now = ++running;
+    int expected = peak;
+    while(now > expected && !peak.compare_exchange_weak(expected, now));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    running--;
+  });
+  ASSERT_EQ(results.size(), 3u);
+  EXPECT_EQ(peak, 3);
+  for(const auto& r : results){
+    EXPECT_TRUE(r.success);
+  }
+}
+
+TEST(ParallelRunner_run, reportsFailuresPerInterface){
+  auto results = ParallelRunner::run({"good", "bad"}, [](const std::string& interface){
+    if(interface == "bad"){
+      throw std::runtime_error("Could not enable ISP Mode");
+    }
+  });
+  ASSERT_EQ(results.size(), 2u);
+  EXPECT_EQ(results[0].interface, "good");
+  EXPECT_TRUE(results[0].success);
+  EXPECT_EQ(results[1].interface, "bad");
+  EXPECT_FALSE(results[1].success);
+  EXPECT_EQ(results[1].error, "Could not enable ISP Mode");
+
+  std::stringstream ss;
+  ParallelRunner::printSummary(ss, results);
+  EXPECT_THAT(ss.str(), HasSubstr("good    PASS    1"));
+  EXPECT_THAT(ss.str(), HasSubstr("FAIL"));
+  EXPECT_THAT(ss.str(), HasSubstr("1/2 devices passed"));
+}
+
+TEST(ParallelRunner_run, respectsConcurrencyLimit){
+  std::atomic<int> running{0};
+  std::atomic<int> peak{0};
+  auto results = ParallelRunner::run({"a", "b", "c", "d", "e"}, [&](const std::string&){
+    auto now = ++running;
+    int expected = peak;
+    while(now > expected && !peak.compare_exchange_weak(expected, now));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    running--;
+  }, 2);
+  ASSERT_EQ(results.size(), 5u);
+  EXPECT_EQ(peak, 2);
+  for(const auto& r : results){
+    EXPECT_TRUE(r.success);
+    EXPECT_EQ(r.attempts, 1u);
+  }
+}
+
+TEST(ParallelRunner_run, retriesFailedInterfaces){
+  std::atomic<int> flaky{0};
+  auto results = ParallelRunner::run({"flaky", "bad"}, [&](const std::string& interface){
+    if(interface == "bad" || ++flaky < 2){
+      throw std::runtime_error("Could not enable ISP Mode");
+    }
+  }, 1, 2);
+  ASSERT_EQ(results.size(), 2u);
+  EXPECT_TRUE(results[0].success);
+  EXPECT_EQ(results[0].attempts, 2u);
+  EXPECT_FALSE(results[1].success);
+  EXPECT_EQ(results[1].attempts, 3u);
+}
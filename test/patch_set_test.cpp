@@ -0,0 +1,151 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <patch_set.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+using ::testing::ContainerEq;
+
+TEST(PatchSet_declare, parsesNameAddressAndLength){
+  PatchSet patches;
+  patches.declare("serial@0x1F000:4");
+  ASSERT_EQ(patches.fields().size(), 1u);
+  EXPECT_EQ(patches.fields()[0].name, "serial");
+  EXPECT_EQ(patches.fields()[0].address, 0x1F000u);
+  EXPECT_EQ(patches.fields()[0].size, 4u);
+}
+
+TEST(PatchSet_declare, failsOnOverlappingFields){
+  PatchSet patches;
+  patches.declare("a@0x100:4");
+  EXPECT_THROW(patches.declare("b@0x102:4"), std::runtime_error);
+}
+
+TEST(PatchSet_declare, failsOnInvalidSpec){
+  PatchSet patches;
+  EXPECT_THROW(patches.declare("serial:4"), std::runtime_error);
+  EXPECT_THROW(patches.declare("serial@-1:4"), std::runtime_error);
+}
+
+TEST(PatchSet_declare, failsOutsideTheFlash){
+  PatchSet patches;
+  patches.declare("last@0x9DDFC:4");
+  EXPECT_THROW(patches.declare("beyond@0x9DDFE:4"), std::runtime_error);
+  /* 0x100 once truncated to 32 bits */
+  EXPECT_THROW(patches.declare("wide@0x100000100:4"), std::runtime_error);
+  EXPECT_THROW(patches.declare("wrap@0xFFFFFFFE:4"), std::runtime_error);
+  EXPECT_THROW(patches.declare(PatchSet::Field{"raw", 0xFFFFFFFE, 4}), std::runtime_error);
+  EXPECT_EQ(patches.fields().size(), 1u);
+}
+
+TEST(PatchSet_set, storesIntegersLittleEndian){
+  PatchSet patches;
+  patches.declare("serial@0x10:4");
+  patches.set("serial=0x11223344");
+  std::vector<uint8_t> data(8, 0xFF);
+  patches.apply(0x0E, data.data(), data.size());
+  EXPECT_THAT(data, ContainerEq(std::vector<uint8_t>{0xFF, 0xFF, 0x44, 0x33, 0x22, 0x11, 0xFF, 0xFF}));
+}
+
+TEST(PatchSet_set, storesByteSequencesInOrder){
+  PatchSet patches;
+  patches.declare("mac@0:6");
+  patches.set("mac=00:11:22:33:44:55");
+  std::vector<uint8_t> data(6);
+  patches.apply(0, data.data(), data.size());
+  EXPECT_THAT(data, ContainerEq(std::vector<uint8_t>{0x00, 0x11, 0x22, 0x33, 0x44, 0x55}));
+}
+
+TEST(PatchSet_set, padsStrings){
+  PatchSet patches;
+  patches.declare("name@0:4");
+  patches.set("name=str:ab");
+  std::vector<uint8_t> data(4, 0xFF);
+  patches.apply(0, data.data(), data.size());
+  EXPECT_THAT(data, ContainerEq(std::vector<uint8_t>{'a', 'b', 0, 0}));
+}
+
+TEST(PatchSet_set, failsIfValueDoesNotFit){
+  PatchSet patches;
+  patches.declare("serial@0:2");
+  EXPECT_THROW(patches.set("serial=0x10000"), std::runtime_error);
+  EXPECT_THROW(patches.set("serial=hex:001122"), std::runtime_error);
+}
+
+TEST(PatchSet_set, failsOnUnknownField){
+  PatchSet patches;
+  EXPECT_THROW(patches.set("serial=1"), std::runtime_error);
+}
+
+TEST(PatchSet_validate, failsIfFieldHasNoValue){
+  PatchSet patches;
+  patches.declare("serial@0:4");
+  EXPECT_THROW(patches.validate(), std::runtime_error);
+  patches.set("serial=1");
+  EXPECT_NO_THROW(patches.validate());
+}
+
+TEST(PatchSet_forEach, reportsOnlyTheOverlappingPart){
+  PatchSet patches;
+  patches.declare("serial@0x1FE:4");
+  patches.set("serial=hex:01020304");
+  std::vector<std::size_t> offsets;
+  std::vector<uint8_t> bytes;
+  patches.forEach(0x200, 0x200, [&](std::size_t offset, const uint8_t* data, std::size_t size){
+    offsets.push_back(offset);
+    bytes.insert(bytes.end(), data, data + size);
+  });
+  EXPECT_THAT(offsets, ContainerEq(std::vector<std::size_t>{0}));
+  EXPECT_THAT(bytes, ContainerEq(std::vector<uint8_t>{0x03, 0x04}));
+  EXPECT_TRUE(patches.overlaps(0x1F0, 0x10));
+  EXPECT_FALSE(patches.overlaps(0x202, 0x10));
+}
+
+class PatchSet_loadCsv : public testing::Test{
+public:
+  virtual void SetUp(){
+    std::ofstream ofs(path, std::ios::trunc);
+    ofs << "board;serial;mac\r\n"
+        << "A1;1;00:00:00:00:00:01\r\n"
+        << "\r\n"
+        << "B2;2;00:00:00:00:00:02\r\n";
+    patches.declare("serial@0:2");
+    patches.declare("mac@2:6");
+  };
+
+  TempFile file{"patch"};
+  std::string path = file.path;
+  PatchSet patches;
+};
+
+TEST_F(PatchSet_loadCsv, selectsRowByIndex){
+  patches.loadCsv(path, "2");
+  std::vector<uint8_t> data(8);
+  patches.apply(0, data.data(), data.size());
+  EXPECT_THAT(data, ContainerEq(std::vector<uint8_t>{2, 0, 0, 0, 0, 0, 0, 2}));
+}
+
+TEST_F(PatchSet_loadCsv, selectsRowByKey){
+  patches.loadCsv(path, "board=A1");
+  std::vector<uint8_t> data(8);
+  patches.apply(0, data.data(), data.size());
+  EXPECT_THAT(data, ContainerEq(std::vector<uint8_t>{1, 0, 0, 0, 0, 0, 0, 1}));
+}
+
+TEST_F(PatchSet_loadCsv, failsIfRowDoesNotExist){
+  EXPECT_THROW(patches.loadCsv(path, "3"), std::runtime_error);
+  EXPECT_THROW(patches.loadCsv(path, "board=C3"), std::runtime_error);
+  EXPECT_THROW(patches.loadCsv(path, "slot=1"), std::runtime_error);
+}
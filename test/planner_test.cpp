@@ -0,0 +1,122 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "temp_file.h"
+#include <planner.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+class Planner_plan : public testing::Test{
+public:
+  virtual void SetUp(){
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs << std::string(0x500, '\xAA');
+  };
+
+  TempFile file{"planner"};
+  std::string path = file.path;
+};
+
+TEST_F(Planner_plan, splitsWritesIntoPageFrames){
+  Session session;
+  session.addErase("FLASH:0x0+0x800");
+  session.addWrite(std::string("FLASH@0x100:") + path);
+  Planner planner;
+  planner.enterISPMode();
+  planner.program(session);
+
+  std::vector<Planner::Kind> kinds;
+  std::vector<std::size_t> lengths;
+  for(const auto& r : planner.requests()){
+    kinds.push_back(r.kind);
+    if(r.kind == Planner::Kind::write){
+      lengths.push_back(r.length);
+    }
+  }
+  EXPECT_EQ(kinds, std::vector<Planner::Kind>({Planner::Kind::ispEntry, Planner::Kind::openMemory, Planner::Kind::erase, Planner::Kind::blankCheck,
+                                               Planner::Kind::write, Planner::Kind::write, Planner::Kind::write,
+                                               Planner::Kind::closeMemory}));
+  EXPECT_EQ(lengths, std::vector<std::size_t>({0x100, 0x200, 0x200}));
+  EXPECT_EQ(Planner::sent(planner.requests()[5], Planner::Settings()), 0x200u + K32W061::WRITE_FRAME_OVERHEAD);
+}
+
+TEST_F(Planner_plan, predictsWireTimeAndTurnaround){
+  Planner planner;
+  planner.reset();
+  Planner::Settings settings;
+  /* 8 + 9 bytes at 115200 baud plus the turnaround */
+  EXPECT_EQ(planner.duration(settings), std::chrono::microseconds(1475 + Planner::DEFAULT_TURNAROUND_US));
+}
+
+TEST_F(Planner_plan, fasterBaudrateAndWiderWindowShortenWrites){
+  Session session;
+  session.addWrite(std::string("FLASH:") + path);
+  Planner planner;
+  planner.enterISPMode();
+  planner.setBaudrate();
+  planner.program(session);
+
+  Planner::Settings slow;
+  Planner::Settings fast;
+  fast.speed = 1000000;
+  Planner::Settings pipelined = fast;
+  pipelined.writeWindow = 16;
+  EXPECT_GT(planner.duration(slow), planner.duration(fast));
+  EXPECT_GT(planner.duration(fast), planner.duration(pipelined));
+  /* the ISP entry is the same at every speed */
+  EXPECT_GT(planner.duration(pipelined), std::chrono::milliseconds(Planner::NOMINAL_ISP_READY_MS));
+}
+
+TEST_F(Planner_plan, printsRunsOfFramesAndComparesSettings){
+  Session session;
+  session.addWrite(std::string("FLASH:") + path);
+  Planner planner;
+  planner.enterISPMode();
+  planner.setBaudrate();
+  planner.program(session);
+
+  std::ostringstream plan;
+  planner.print(plan, Planner::Settings());
+  EXPECT_THAT(plan.str(), testing::HasSubstr("0x00000000-0x000004ff"));
+  EXPECT_THAT(plan.str(), testing::Not(testing::HasSubstr("SetBaudRate")));
+  EXPECT_THAT(plan.str(), testing::HasSubstr("Predicted duration"));
+
+  std::ostringstream compare;
+  planner.compare(compare, Planner::Settings());
+  EXPECT_THAT(compare.str(), testing::HasSubstr("1000000"));
+  EXPECT_THAT(compare.str(), testing::HasSubstr("window 16"));
+  EXPECT_THAT(compare.str(), testing::HasSubstr("*"));
+}
+
+TEST_F(Planner_plan, precompiledFramesAreTimedWithTheWindow){
+  auto fw = FrameStream::encode(FirmwareImage(path, K32W061::FLASH_SIZE, FirmwareImage::Format::binary));
+  Planner planner;
+  planner.flashFirmware(*fw);
+
+  std::size_t frames = 0;
+  for(const auto& r : planner.requests()){
+    EXPECT_NE(r.kind, Planner::Kind::write);
+    frames += r.kind == Planner::Kind::frame;
+  }
+  EXPECT_EQ(frames, fw->frames().size());
+  EXPECT_EQ(Planner::sent(planner.requests()[1], Planner::Settings()), fw->frames()[0].size);
+
+  Planner::Settings single;
+  Planner::Settings pipelined;
+  pipelined.writeWindow = 8;
+  EXPECT_GT(planner.duration(single), planner.duration(pipelined));
+
+  std::ostringstream plan;
+  planner.print(plan, Planner::Settings());
+  EXPECT_THAT(plan.str(), testing::HasSubstr("WriteFrame"));
+  EXPECT_THAT(plan.str(), testing::HasSubstr("0x00000000-0x000004ff"));
+}
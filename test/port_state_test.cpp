@@ -0,0 +1,86 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include "temp_file.h"
+#include <port_state.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+class PortState_store : public testing::Test{
+public:
+  TempDir dir{"portstate"};
+  std::string path = dir.path + "/state";
+};
+
+TEST_F(PortState_store, remembersStatePerPort){
+  PortState state(path);
+  state.store("/dev/ttyUSB0", 1000000, true);
+  state.store("/dev/ttyUSB1", 115200, false);
+  state.store("/dev/ttyUSB0", 2000000, true);
+
+  PortState::Entry entry;
+  ASSERT_TRUE(PortState(path).lookup("/dev/ttyUSB0", entry));
+  EXPECT_EQ(entry.speed, 2000000u);
+  EXPECT_TRUE(entry.unlocked);
+  ASSERT_TRUE(state.lookup("/dev/ttyUSB1", entry));
+  EXPECT_EQ(entry.speed, 115200u);
+  EXPECT_FALSE(entry.unlocked);
+  EXPECT_FALSE(state.lookup("/dev/ttyUSB2", entry));
+}
+
+TEST_F(PortState_store, forgetsPorts){
+  PortState state(path);
+  state.store("/dev/ttyUSB0", 1000000, true);
+  state.store("/dev/ttyUSB1", 1000000, true);
+  state.forget("/dev/ttyUSB0");
+  PortState::Entry entry;
+  EXPECT_FALSE(state.lookup("/dev/ttyUSB0", entry));
+  EXPECT_TRUE(state.lookup("/dev/ttyUSB1", entry));
+}
+
+TEST_F(PortState_store, ignoresOldAndMissingEntries){
+  PortState::Entry entry;
+  EXPECT_FALSE(PortState(path).lookup("/dev/ttyUSB0", entry));
+  std::ofstream(path) << "/dev/ttyUSB0 1000000 1 " << (std::time(nullptr) - 600) << "\ngarbage\n";
+  EXPECT_FALSE(PortState(path).lookup("/dev/ttyUSB0", entry));
+  EXPECT_TRUE(PortState(path, 3600).lookup("/dev/ttyUSB0", entry));
+}
+
+TEST_F(PortState_store, doesNotFollowPlantedLinks){
+  auto target = dir.path + "/target";
+  std::ofstream(target) << "keep\n";
+  ASSERT_EQ(symlink(target.c_str(), (path + ".lock").c_str()), 0);
+  EXPECT_THROW(PortState(path).store("/dev/ttyUSB0", 1000000, true), std::runtime_error);
+
+  std::remove((path + ".lock").c_str());
+  ASSERT_EQ(symlink(target.c_str(), (path + ".tmp").c_str()), 0);
+  PortState(path).store("/dev/ttyUSB0", 1000000, true);
+  std::string line;
+  std::getline(std::ifstream(target), line);
+  EXPECT_EQ(line, "keep");
+  PortState::Entry entry;
+  EXPECT_TRUE(PortState(path).lookup("/dev/ttyUSB0", entry));
+}
+
+TEST(PortState_defaultPath, isEmptyWithoutRuntimeDirectory){
+  auto runtime = std::getenv("XDG_RUNTIME_DIR");
+  std::string saved = runtime ? runtime : "";
+  setenv("XDG_RUNTIME_DIR", "/run/user/1000", 1);
+  EXPECT_EQ(PortState::defaultPath(), "/run/user/1000/nxp-isp.state");
+  unsetenv("XDG_RUNTIME_DIR");
+  EXPECT_EQ(PortState::defaultPath(), "");
+  if(runtime){
+    setenv("XDG_RUNTIME_DIR", saved.c_str(), 1);
+  }
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include <scheduling.h>
+#include <gmock/gmock.h>
+
+#include <stdexcept>
+#include <thread>
+#include <sched.h>
+
+using ::testing::ContainerEq;
+using ::testing::HasSubstr;
+using ::testing::StartsWith;
+
+TEST(Scheduling_parseCpus, expandsRanges){
+  EXPECT_THAT(Scheduling::parseCpus("2,3,6-8"), ContainerEq(std::vector<int>{2, 3, 6, 7, 8}));
+  EXPECT_THAT(Scheduling::parseCpus("0"), ContainerEq(std::vector<int>{0}));
+}
+
+TEST(Scheduling_parseCpus, failsOnInvalidList){
+  EXPECT_THROW(Scheduling::parseCpus(""), std::runtime_error);
+  EXPECT_THROW(Scheduling::parseCpus("1,,2"), std::runtime_error);
+  EXPECT_THROW(Scheduling::parseCpus("3-1"), std::runtime_error);
+  EXPECT_THROW(Scheduling::parseCpus("a"), std::runtime_error);
+}
+
+TEST(Scheduling_parsePolicy, parsesFifoAndNice){
+  Scheduling::Settings settings;
+  Scheduling::parsePolicy("fifo:10", settings);
+  EXPECT_EQ(settings.policy, Scheduling::Policy::fifo);
+  EXPECT_EQ(settings.priority, 10);
+  Scheduling::parsePolicy("nice:-5", settings);
+  EXPECT_EQ(settings.policy, Scheduling::Policy::nice);
+  EXPECT_EQ(settings.priority, -5);
+  EXPECT_THROW(Scheduling::parsePolicy("fifo:100", settings), std::runtime_error);
+  EXPECT_THROW(Scheduling::parsePolicy("nice", settings), std::runtime_error);
+  EXPECT_THROW(Scheduling::parsePolicy("rr", settings), std::runtime_error);
+}
+
+TEST(Scheduling_apply, pinsThreadToCPU){
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  ASSERT_EQ(sched_getaffinity(0, sizeof(set), &set), 0);
+  int cpu = 0;
+  while(!CPU_ISSET(cpu, &set)){
+    cpu++;
+  }
+
+  Scheduling::Settings settings;
+  settings.cpus = {cpu};
+  std::string achieved;
+  /* a thread of its own, the test runner keeps its affinity */
+  std::thread([&](){ achieved = Scheduling::apply(settings, "/dev/ttyUSB0"); }).join();
+  EXPECT_THAT(achieved, StartsWith("SCHED_OTHER"));
+  EXPECT_THAT(achieved, HasSubstr(std::string(", CPU ") + std::to_string(cpu)));
+}
@@ -0,0 +1,112 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <session.h>
+#include <k32w061.h>
+#include <gmock/gmock.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+TEST(Session_addErase, erasesWholeMemoryIfNoRangeIsGiven){
+  Session session;
+  session.addErase("CONFIG");
+  ASSERT_EQ(session.steps().size(), 1u);
+  EXPECT_EQ(session.steps()[0].memory, MCU::MemoryID::config);
+  ASSERT_EQ(session.steps()[0].erases.size(), 1u);
+  EXPECT_EQ(session.steps()[0].erases[0].address, K32W061::memoryGeometry(MCU::MemoryID::config).base);
+  EXPECT_EQ(session.steps()[0].erases[0].length, 0x200u);
+}
+
+TEST(Session_addErase, mergesAdjacentAndOverlappingRanges){
+  Session session;
+  session.addErase("FLASH:0x1000+0x400");
+  session.addErase("FLASH:0x0+0x200");
+  session.addErase("flash:0x1200+0x400");
+  ASSERT_EQ(session.steps().size(), 1u);
+  const auto& erases = session.steps()[0].erases;
+  ASSERT_EQ(erases.size(), 2u);
+  EXPECT_EQ(erases[0].address, 0x0u);
+  EXPECT_EQ(erases[0].length, 0x200u);
+  EXPECT_EQ(erases[1].address, 0x1000u);
+  EXPECT_EQ(erases[1].length, 0x600u);
+}
+
+TEST(Session_addErase, fullEraseSwallowsRanges){
+  Session session;
+  session.addErase("FLASH:0x1000+0x400");
+  session.addErase("FLASH");
+  ASSERT_EQ(session.steps()[0].erases.size(), 1u);
+  EXPECT_EQ(session.steps()[0].erases[0].length, uint32_t(K32W061::FLASH_SIZE));
+}
+
+TEST(Session_addErase, failsOnUnalignedOrOutOfRangeErase){
+  Session session;
+  EXPECT_THROW(session.addErase("FLASH:0x100+0x200"), std::runtime_error);
+  EXPECT_THROW(session.addErase("FLASH:0x9DC00+0x400"), std::runtime_error);
+  EXPECT_THROW(session.addErase("FLASH:0x1000"), std::runtime_error);
+  EXPECT_THROW(session.addErase("ROM"), std::runtime_error);
+  EXPECT_THROW(session.addErase("NVRAM"), std::runtime_error);
+}
+
+TEST(Session_steps, areOrderedByMemory){
+  Session session;
+  session.addErase("CONFIG");
+  session.addErase("PSECT");
+  session.addErase("FLASH");
+  ASSERT_EQ(session.steps().size(), 3u);
+  EXPECT_EQ(session.steps()[0].memory, MCU::MemoryID::flash);
+  EXPECT_EQ(session.steps()[1].memory, MCU::MemoryID::psect);
+  EXPECT_EQ(session.steps()[2].memory, MCU::MemoryID::config);
+}
+
+class Session_addWrite : public testing::Test{
+public:
+  void write(std::size_t size){
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs << std::string(size, '\xAA');
+  }
+
+  TempFile file{"session"};
+  std::string path = file.path;
+};
+
+TEST_F(Session_addWrite, placesImageAtOffset){
+  write(0x10);
+  Session session;
+  session.addWrite(std::string("FLASH@0x2000:") + path);
+  session.addWrite(std::string("FLASH@0x1000:") + path);
+  ASSERT_EQ(session.steps().size(), 1u);
+  const auto& writes = session.steps()[0].writes;
+  ASSERT_EQ(writes.size(), 2u);
+  EXPECT_EQ(writes[0].offset, 0x1000u);
+  EXPECT_EQ(writes[1].offset, 0x2000u);
+  EXPECT_TRUE(session.covers(MCU::MemoryID::flash, 0x2008, 8));
+  EXPECT_FALSE(session.covers(MCU::MemoryID::flash, 0x2008, 9));
+  EXPECT_FALSE(session.covers(MCU::MemoryID::psect, 0x2008, 8));
+}
+
+TEST_F(Session_addWrite, failsIfImageDoesNotFitIntoMemory){
+  write(0x1E1);
+  Session session;
+  EXPECT_THROW(session.addWrite(std::string("PSECT:") + path), std::runtime_error);
+  write(0x10);
+  EXPECT_THROW(session.addWrite(std::string("PSECT@0x1D8:") + path), std::runtime_error);
+  EXPECT_NO_THROW(session.addWrite(std::string("PSECT@0x1D0:") + path));
+}
+
+TEST_F(Session_addWrite, failsOnInvalidSpec){
+  Session session;
+  EXPECT_THROW(session.addWrite(path), std::runtime_error);
+  EXPECT_THROW(session.addWrite("FLASH:"), std::runtime_error);
+  EXPECT_THROW(session.addWrite(std::string("FLASH@xyz:") + path), std::runtime_error);
+}
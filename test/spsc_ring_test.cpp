@@ -0,0 +1,64 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include <spsc_ring.h>
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+TEST(SpscRing, wrapsAround){
+  SpscRing<8> ring;
+  uint8_t in[] = {1, 2, 3, 4, 5, 6};
+  uint8_t out[8] = {};
+  EXPECT_EQ(ring.write(in, 6), 6u);
+  EXPECT_EQ(ring.read(out, 4), 4u);
+  EXPECT_EQ(ring.space(), 6u);
+
+  /* 2 bytes left at the end, the rest goes to the start of the buffer */
+  EXPECT_EQ(ring.write(in, 6), 6u);
+  EXPECT_EQ(ring.write(in, 6), 0u);
+  EXPECT_EQ(ring.size(), 8u);
+  EXPECT_EQ(ring.read(out, 8), 8u);
+  EXPECT_EQ(std::vector<uint8_t>(out, out + 8), std::vector<uint8_t>({5, 6, 1, 2, 3, 4, 5, 6}));
+  EXPECT_EQ(ring.read(out, 8), 0u);
+}
+
+TEST(SpscRing, passesBytesBetweenThreadsInOrder){
+  SpscRing<64> ring;
+  const std::size_t total = 100000;
+  std::thread producer([&ring, total]{
+    std::size_t sent = 0;
+    while(sent < total){
+      uint8_t chunk[7];
+      auto n = std::min<std::size_t>(sizeof(chunk), total - sent);
+      for(std::size_t i=0;i<n;i++){
+        chunk[i] = (sent + i) & 0xFF;
+      }
+      std::size_t written = 0;
+      while(written < n){
+        written += ring.write(chunk + written, n - written);
+      }
+      sent += n;
+    }
+  });
+
+  std::size_t received = 0;
+  bool inOrder = true;
+  while(received < total){
+    uint8_t chunk[13];
+    auto n = ring.read(chunk, sizeof(chunk));
+    for(std::size_t i=0;i<n;i++){
+      inOrder &= chunk[i] == ((received + i) & 0xFF);
+    }
+    received += n;
+  }
+  producer.join();
+  EXPECT_TRUE(inOrder);
+  EXPECT_EQ(ring.size(), 0u);
+}
@@ -0,0 +1,110 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <station.h>
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using ::testing::ContainerEq;
+
+class Station_run : public testing::Test{
+public:
+  void plug(const std::string& name){
+    std::ofstream(dir + "/" + name);
+  }
+  void unplug(const std::string& name){
+    std::remove((dir + "/" + name).c_str());
+  }
+
+  void start(Station::Match match=[](const std::string&){ return true; }){
+    station.reset(new Station(dir + "/ttyUSB*", match, [this](const std::string& dev){
+      std::lock_guard<std::mutex> lock(mutex);
+      flashed.push_back(dev);
+      cv.notify_all();
+    }, std::chrono::milliseconds(0)));
+    thread = std::thread([this](){ station->run(); });
+  }
+  void stop(){
+    station->stop();
+    thread.join();
+  }
+  bool waitFor(std::size_t count){
+    std::unique_lock<std::mutex> lock(mutex);
+    return cv.wait_for(lock, std::chrono::seconds(5), [&](){ return flashed.size() >= count; });
+  }
+
+  TempDir tmp{"station"};
+  std::string dir = tmp.path;
+  std::unique_ptr<Station> station;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<std::string> flashed;
+};
+
+TEST_F(Station_run, flashesNewDevicesOncePerPlug){
+  start();
+  plug("ttyS0");
+  plug("ttyUSB0");
+  ASSERT_TRUE(waitFor(1));
+  /* a re-plug while the previous board is still being flashed is ignored */
+  for(int i=0;i<500 && station->passed() == 0;i++){
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  unplug("ttyUSB0");
+  plug("ttyUSB0");
+  ASSERT_TRUE(waitFor(2));
+  stop();
+  EXPECT_THAT(flashed, ContainerEq(std::vector<std::string>{dir + "/ttyUSB0", dir + "/ttyUSB0"}));
+  EXPECT_EQ(station->passed(), 2u);
+}
+
+TEST_F(Station_run, ignoresDevicesPresentAtStartup){
+  plug("ttyUSB0");
+  start();
+  plug("ttyUSB1");
+  ASSERT_TRUE(waitFor(1));
+  stop();
+  EXPECT_THAT(flashed, ContainerEq(std::vector<std::string>{dir + "/ttyUSB1"}));
+}
+
+TEST_F(Station_run, skipsDevicesThatDoNotMatch){
+  start([this](const std::string& dev){ return dev == dir + "/ttyUSB1"; });
+  plug("ttyUSB0");
+  plug("ttyUSB1");
+  ASSERT_TRUE(waitFor(1));
+  stop();
+  EXPECT_THAT(flashed, ContainerEq(std::vector<std::string>{dir + "/ttyUSB1"}));
+  EXPECT_EQ(station->failed(), 0u);
+}
+
+TEST_F(Station_run, countsFailedBoards){
+  station.reset(new Station(dir + "/ttyUSB*", [](const std::string&){ return true; }, [](const std::string&){
+    throw std::runtime_error("Could not enable ISP Mode");
+  }, std::chrono::milliseconds(0)));
+  thread = std::thread([this](){ station->run(); });
+  plug("ttyUSB0");
+  for(int i=0;i<500 && station->failed() == 0;i++){
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  stop();
+  EXPECT_EQ(station->failed(), 1u);
+  EXPECT_EQ(station->passed(), 0u);
+}
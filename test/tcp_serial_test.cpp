@@ -0,0 +1,234 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include <mcu.h>
+#include <tcp_serial.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+TEST(TcpSerial_parse, splitsProtocolHostAndPort){
+  TcpSerial::Protocol protocol;
+  std::string host;
+  std::string port;
+  TcpSerial::parse("rfc2217://fixture-3:4001", protocol, host, port);
+  EXPECT_EQ(protocol, TcpSerial::Protocol::rfc2217);
+  EXPECT_EQ(host, "fixture-3");
+  EXPECT_EQ(port, "4001");
+  TcpSerial::parse("tcp://[::1]:7000", protocol, host, port);
+  EXPECT_EQ(protocol, TcpSerial::Protocol::raw);
+  EXPECT_EQ(host, "::1");
+  EXPECT_EQ(port, "7000");
+
+  EXPECT_TRUE(TcpSerial::isRemote("tcp://host:1"));
+  EXPECT_FALSE(TcpSerial::isRemote("/dev/ttyUSB0"));
+  EXPECT_THROW(TcpSerial::parse("tcp://host", protocol, host, port), std::runtime_error);
+  EXPECT_THROW(TcpSerial::parse("udp://host:1", protocol, host, port), std::runtime_error);
+}
+
+/* a serial server stand-in on loopback, the test plays the server side */
+class TcpSerial_loopback : public testing::Test{
+public:
+  virtual void SetUp(){
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listener, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQ(listen(listener, 1), 0);
+    socklen_t length = sizeof(address);
+    ASSERT_EQ(getsockname(listener, reinterpret_cast<struct sockaddr*>(&address), &length), 0);
+    port = std::to_string(ntohs(address.sin_port));
+  };
+  virtual void TearDown(){
+    if(server >= 0){
+      close(server);
+    }
+    close(listener);
+  };
+
+  /* the connection is queued by the kernel, so accepting after open does not block */
+  void connect(TcpSerial& serial, const std::string& protocol){
+    serial.open(protocol + "://127.0.0.1:" + port);
+    server = accept(listener, nullptr, nullptr);
+    ASSERT_GE(server, 0);
+  }
+
+  /* everything the client sent until it paused */
+  std::vector<uint8_t> received(){
+    std::vector<uint8_t> data;
+    struct pollfd pfd = {server, POLLIN, 0};
+    while(poll(&pfd, 1, 100) == 1){
+      uint8_t buf[256];
+      auto n = read(server, buf, sizeof(buf));
+      if(n <= 0){
+        break;
+      }
+      data.insert(data.end(), buf, buf + n);
+    }
+    return data;
+  }
+
+  void reply(const std::vector<uint8_t>& data){
+    ASSERT_EQ(write(server, data.data(), data.size()), (ssize_t)data.size());
+  }
+
+  std::vector<uint8_t> readAll(TcpSerial& serial, std::size_t size){
+    std::vector<uint8_t> data;
+    while(data.size() < size){
+      auto chunk = serial.readData();
+      if(chunk.empty()){
+        break;
+      }
+      data.insert(data.end(), chunk.begin(), chunk.end());
+    }
+    return data;
+  }
+
+  static bool contains(const std::vector<uint8_t>& data, const std::vector<uint8_t>& part){
+    return std::search(data.begin(), data.end(), part.begin(), part.end()) != data.end();
+  }
+
+  int listener = -1;
+  int server = -1;
+  std::string port;
+};
+
+TEST_F(TcpSerial_loopback, rfc2217NegotiatesAndEscapes){
+  TcpSerial serial;
+  connect(serial, "rfc2217");
+  serial.setReadTimeout(1000);
+
+  auto setup = received();
+  EXPECT_TRUE(contains(setup, {0xFF, 0xFB, 44}));
+  /* 115200 baud, 8 data bits */
+  EXPECT_TRUE(contains(setup, {0xFF, 0xFA, 44, 1, 0x00, 0x01, 0xC2, 0x00, 0xFF, 0xF0}));
+  EXPECT_TRUE(contains(setup, {0xFF, 0xFA, 44, 2, 8, 0xFF, 0xF0}));
+
+  EXPECT_EQ(serial.writeData({0x01, 0xFF, 0x02}), 3);
+  EXPECT_EQ(received(), std::vector<uint8_t>({0x01, 0xFF, 0xFF, 0x02}));
+
+  /* option answers, a refused echo and a baudrate acknowledgement around the data */
+  reply({0xFF, 0xFD, 44, 0xFF, 0xFB, 1, 0x10, 0xFF, 0xFA, 44, 101, 0x00, 0x01, 0xC2, 0x00, 0xFF, 0xF0, 0xFF, 0xFF});
+  reply({0x20});
+  EXPECT_EQ(readAll(serial, 3), std::vector<uint8_t>({0x10, 0xFF, 0x20}));
+  EXPECT_EQ(received(), std::vector<uint8_t>({0xFF, 0xFE, 1}));
+
+  EXPECT_EQ(serial.setBaudrate(1000000), 0);
+  EXPECT_TRUE(contains(received(), {0xFF, 0xFA, 44, 1, 0x00, 0x0F, 0x42, 0x40, 0xFF, 0xF0}));
+}
+
+TEST_F(TcpSerial_loopback, rfc2217DrivesModemLines){
+  TcpSerial serial;
+  connect(serial, "rfc2217");
+  received();
+  serial.setLineMapping(UARTLinux::parseLineMapping("reset=dtr,isp=rts"));
+  /* released: DTR and RTS off */
+  auto released = received();
+  EXPECT_TRUE(contains(released, {0xFF, 0xFA, 44, 5, 9, 0xFF, 0xF0}));
+  EXPECT_TRUE(contains(released, {0xFF, 0xFA, 44, 5, 12, 0xFF, 0xF0}));
+
+  FTDI::CBUSPins pins = {};
+  pins.modeCBUS0 = FTDI::CBUSMode::OUTPUT;
+  pins.modeCBUS2 = FTDI::CBUSMode::OUTPUT;
+  EXPECT_EQ(serial.setCBUSPins(pins), 0);
+  auto asserted = received();
+  EXPECT_TRUE(contains(asserted, {0xFF, 0xFA, 44, 5, 8, 0xFF, 0xF0}));
+  EXPECT_TRUE(contains(asserted, {0xFF, 0xFA, 44, 5, 11, 0xFF, 0xF0}));
+}
+
+TEST_F(TcpSerial_loopback, rawPassesBytesUnchanged){
+  TcpSerial serial;
+  connect(serial, "tcp");
+  EXPECT_TRUE(serial.is_open());
+  EXPECT_LT(serial.latency(), std::chrono::microseconds(1000000));
+
+  EXPECT_EQ(serial.writeData({0x01, 0xFF, 0x02}), 3);
+  EXPECT_EQ(received(), std::vector<uint8_t>({0x01, 0xFF, 0x02}));
+  reply({0xFF, 0xFB, 0x01});
+  serial.setReadTimeout(1000);
+  EXPECT_EQ(readAll(serial, 3), std::vector<uint8_t>({0xFF, 0xFB, 0x01}));
+
+  EXPECT_LT(serial.setBaudrate(1000000), 0);
+  EXPECT_THROW(serial.setLineMapping(UARTLinux::parseLineMapping("reset=dtr")), std::runtime_error);
+}
+
+TEST_F(TcpSerial_loopback, flushDiscardsPendingBytesAndKeepsTimeout){
+  TcpSerial serial;
+  connect(serial, "tcp");
+  serial.setReadTimeout(1000);
+  reply({0x01, 0x02, 0x03});
+  serial.flushInput();
+
+  reply({0x04});
+  EXPECT_EQ(readAll(serial, 1), std::vector<uint8_t>({0x04}));
+}
+
+TEST_F(TcpSerial_loopback, readReturnsOnceTheServerClosed){
+  TcpSerial serial;
+  connect(serial, "tcp");
+  serial.setReadTimeout(0);
+  close(server);
+  server = -1;
+  EXPECT_TRUE(serial.readData().empty());
+  EXPECT_TRUE(serial.readData().empty());
+}
+
+TEST_F(TcpSerial_loopback, failsIfNobodyListens){
+  close(listener);
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  TcpSerial serial;
+  EXPECT_THROW(serial.open("tcp://127.0.0.1:" + port), std::runtime_error);
+}
+
+TEST_F(TcpSerial_loopback, connectGivesUpAtTheTimeout){
+  /* once the accept queue is full further handshakes are dropped */
+  ASSERT_EQ(listen(listener, 0), 0);
+  TcpSerial first;
+  first.open("tcp://127.0.0.1:" + port);
+  TcpSerial serial;
+  serial.setTimeout(std::chrono::milliseconds(200));
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_THROW(serial.open("tcp://127.0.0.1:" + port), std::runtime_error);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+  EXPECT_FALSE(serial.is_open());
+}
+
+TEST_F(TcpSerial_loopback, connectStopsOnCancel){
+  ASSERT_EQ(listen(listener, 0), 0);
+  TcpSerial first;
+  first.open("tcp://127.0.0.1:" + port);
+  std::atomic<bool> cancel{true};
+  TcpSerial serial;
+  serial.setCancel(&cancel);
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_THROW(serial.open("tcp://127.0.0.1:" + port), MCU::Cancelled);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+
+TEST_F(TcpSerial_loopback, sendGivesUpWhenTheServerStopsReading){
+  TcpSerial serial;
+  serial.setTimeout(std::chrono::milliseconds(200));
+  connect(serial, "tcp");
+  /* far more than the socket buffers of both ends hold */
+  std::vector<uint8_t> data(64 * 1024 * 1024, 0x5A);
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(serial.writeData(data), -1);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
@@ -0,0 +1,65 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#ifndef _TEMP_FILE_H_
+#define _TEMP_FILE_H_
+
+#include <cstdio>
+#include <ftw.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/* empty file below /tmp, removed again with the object. Tests may replace
+ * or remove it in between */
+class TempFile{
+public:
+  explicit TempFile(const std::string& prefix){
+    auto name = pattern(prefix);
+    int fd = mkstemp(name.data());
+    if(fd < 0){
+      throw std::runtime_error(std::string("Could not create temporary file for ") + prefix);
+    }
+    close(fd);
+    path = name.data();
+  }
+  ~TempFile(){
+    std::remove(path.c_str());
+  }
+  TempFile(const TempFile&) = delete;
+  TempFile& operator=(const TempFile&) = delete;
+
+  static std::vector<char> pattern(const std::string& prefix){
+    auto name = std::string("/tmp/") + prefix + "XXXXXX";
+    return std::vector<char>(name.c_str(), name.c_str() + name.size() + 1);
+  }
+
+  std::string path;
+};
+
+/* directory below /tmp, removed again with everything created in it */
+class TempDir{
+public:
+  explicit TempDir(const std::string& prefix){
+    auto name = TempFile::pattern(prefix);
+    if(mkdtemp(name.data()) == nullptr){
+      throw std::runtime_error(std::string("Could not create temporary directory for ") + prefix);
+    }
+    path = name.data();
+  }
+  ~TempDir(){
+    nftw(path.c_str(), [](const char* entry, const struct stat*, int, struct FTW*){ return std::remove(entry); }, 16, FTW_DEPTH | FTW_PHYS);
+  }
+  TempDir(const TempDir&) = delete;
+  TempDir& operator=(const TempDir&) = delete;
+
+  std::string path;
+};
+
+#endif /* _TEMP_FILE_H_ */
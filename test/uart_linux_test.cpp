@@ -0,0 +1,122 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+#include <uart_linux.h>
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+TEST(UARTLinux_parseLineMapping, parsesLinesAndInversion){
+  auto lines = UARTLinux::parseLineMapping("reset=DTR, isp=!rts");
+  EXPECT_EQ(lines.reset, UARTLinux::LineMapping::dtr);
+  EXPECT_FALSE(lines.resetInverted);
+  EXPECT_EQ(lines.isp, UARTLinux::LineMapping::rts);
+  EXPECT_TRUE(lines.ispInverted);
+}
+
+TEST(UARTLinux_parseLineMapping, failsOnInvalidMapping){
+  EXPECT_THROW(UARTLinux::parseLineMapping("reset"), std::runtime_error);
+  EXPECT_THROW(UARTLinux::parseLineMapping("reset=cts"), std::runtime_error);
+  EXPECT_THROW(UARTLinux::parseLineMapping("boot=dtr"), std::runtime_error);
+  EXPECT_THROW(UARTLinux::parseLineMapping("reset=dtr,isp=dtr"), std::runtime_error);
+}
+
+TEST(UARTLinux_modemBits, followsIspEntrySequence){
+  auto lines = UARTLinux::parseLineMapping("reset=dtr,isp=rts");
+  FTDI::CBUSPins pins = {};
+  pins.modeCBUS0 = FTDI::CBUSMode::OUTPUT;
+  pins.modeCBUS1 = FTDI::CBUSMode::OUTPUT;
+  pins.modeCBUS2 = FTDI::CBUSMode::OUTPUT;
+  pins.modeCBUS3 = FTDI::CBUSMode::OUTPUT;
+  /* reset and ISP select low */
+  EXPECT_EQ(UARTLinux::modemBits(lines, pins, TIOCM_CTS), TIOCM_CTS | TIOCM_DTR | TIOCM_RTS);
+  /* reset released, ISP select still low */
+  pins.outputCBUS2 = 1;
+  EXPECT_EQ(UARTLinux::modemBits(lines, pins, 0), TIOCM_RTS);
+  /* CBUS mode disabled, everything released */
+  EXPECT_EQ(UARTLinux::modemBits(lines, FTDI::CBUSPins{}, TIOCM_DTR | TIOCM_RTS), 0);
+}
+
+TEST(UARTLinux_modemBits, invertsLines){
+  auto lines = UARTLinux::parseLineMapping("reset=!rts");
+  EXPECT_EQ(UARTLinux::modemBits(lines, FTDI::CBUSPins{}, TIOCM_DTR), TIOCM_DTR | TIOCM_RTS);
+}
+
+/* the pty slave stands in for the tty of an adapter, the test talks to it through the master */
+TEST(UARTLinux_ioThread, exchangesFramesThroughTheRings){
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_GE(master, 0);
+  ASSERT_EQ(grantpt(master), 0);
+  ASSERT_EQ(unlockpt(master), 0);
+
+  std::atomic<bool> started{false};
+  {
+    UARTLinux uart;
+    uart.open(ptsname(master));
+    uart.startIoThread([&started]{ started = true; });
+
+    std::vector<uint8_t> frame(3000);
+    for(std::size_t i=0;i<frame.size();i++){
+      frame[i] = i;
+    }
+    ASSERT_EQ(uart.writeData(frame), (int)frame.size());
+    std::vector<uint8_t> sent;
+    while(sent.size() < frame.size()){
+      struct pollfd pfd = {master, POLLIN, 0};
+      ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+      uint8_t buf[512];
+      auto n = read(master, buf, sizeof(buf));
+      ASSERT_GT(n, 0);
+      sent.insert(sent.end(), buf, buf + n);
+    }
+    EXPECT_EQ(sent, frame);
+    EXPECT_TRUE(started);
+
+    uint8_t response[] = {0x01, 0x02, 0x03};
+    ASSERT_EQ(write(master, response, sizeof(response)), (ssize_t)sizeof(response));
+    uart.setReadTimeout(1000);
+    std::vector<uint8_t> received;
+    while(received.size() < sizeof(response)){
+      auto data = uart.readData();
+      ASSERT_FALSE(data.empty());
+      received.insert(received.end(), data.begin(), data.end());
+    }
+    EXPECT_EQ(received, std::vector<uint8_t>(response, response + sizeof(response)));
+
+    uart.setReadTimeout(20);
+    EXPECT_TRUE(uart.readData().empty());
+  }
+  close(master);
+}
+
+TEST(UARTLinux_flushInput, discardsUnreadBytes){
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_GE(master, 0);
+  ASSERT_EQ(grantpt(master), 0);
+  ASSERT_EQ(unlockpt(master), 0);
+  {
+    UARTLinux uart;
+    uart.open(ptsname(master));
+    EXPECT_EQ(uart.latency(), std::chrono::microseconds(0));
+    uint8_t stale[] = {0x01, 0x02, 0x03};
+    ASSERT_EQ(write(master, stale, sizeof(stale)), (ssize_t)sizeof(stale));
+    /* let the pty move the bytes to the slave */
+    usleep(20000);
+    uart.flushInput();
+
+    uart.setReadTimeout(20);
+    EXPECT_TRUE(uart.readData().empty());
+  }
+  close(master);
+}
@@ -0,0 +1,162 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2020 Albert Krenz
+ * 
+ * This code is licensed under BSD + Patent (see LICENSE.txt for full license text)
+ *******************************************************************************/
+
+ /* SPDX-License-Identifier: BSD-2-Clause-Patent */
+
+#include "temp_file.h"
+#include <usb_enumerator.h>
+#include <gmock/gmock.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+using ::testing::HasSubstr;
+
+/* builds a minimal sysfs tree of USB serial adapters */
+class UsbEnumerator_scan : public testing::Test{
+public:
+  virtual void SetUp(){
+    run(std::string("mkdir -p ") + root + "/class/tty " + root + "/bus/usb/drivers/ftdi_sio " + root + "/bus/usb/drivers/cdc_acm " + root + "/bus/usb/devices");
+  };
+
+  void run(const std::string& cmd){
+    ASSERT_EQ(std::system(cmd.c_str()), 0);
+  }
+  void attribute(const std::string& path, const std::string& value){
+    std::ofstream(path) << value << "\n";
+  }
+
+  /* usb-serial drivers put the tty below a port directory of the
+   * interface, cdc_acm below the interface itself */
+  void plug(const std::string& tty, const std::string& busPath, const std::string& vid, const std::string& pid,
+            const std::string& serial, const std::string& driver, int interfaceNumber=0){
+    auto device = root + "/devices/pci0000:00/usb1/" + busPath;
+    auto interface = device + "/" + busPath + ":1." + std::to_string(interfaceNumber);
+    auto port = driver == "cdc_acm" ? interface : interface + "/" + tty;
+    run(std::string("mkdir -p ") + port + "/tty/" + tty);
+    attribute(device + "/idVendor", vid);
+    attribute(device + "/idProduct", pid);
+    attribute(device + "/busnum", busPath.substr(0, busPath.find('-')));
+    attribute(device + "/devnum", std::to_string(++address));
+    attribute(device + "/bNumInterfaces", std::string(" ") + std::to_string(interfaceNumber + 1));
+    run(std::string("ln -sfn ") + device + " " + root + "/bus/usb/devices/" + busPath);
+    run(std::string("ln -sfn ") + interface + " " + root + "/bus/usb/devices/" + busPath + ":1." + std::to_string(interfaceNumber));
+    if(!serial.empty()){
+      attribute(device + "/serial", serial);
+    }
+    attribute(interface + "/bInterfaceNumber", "0" + std::to_string(interfaceNumber));
+    run(std::string("ln -sfn ") + root + "/bus/usb/drivers/" + driver + " " + interface + "/driver");
+    run(std::string("ln -sfn ") + port + " " + port + "/tty/" + tty + "/device");
+    run(std::string("ln -sfn ") + port + "/tty/" + tty + " " + root + "/class/tty/" + tty);
+  }
+
+  TempDir sysfs{"sysfs"};
+  std::string root = sysfs.path;
+  int address = 0;
+};
+
+TEST_F(UsbEnumerator_scan, mapsTtysToAdapters){
+  plug("ttyUSB10", "1-1.3", "0403", "6015", "A50285BI", "ftdi_sio");
+  plug("ttyUSB2", "1-1.2", "0403", "6010", "FT4232", "ftdi_sio", 1);
+  plug("ttyACM0", "2-4", "1fc9", "0021", "", "cdc_acm");
+  run(std::string("mkdir -p ") + root + "/devices/platform/serial8250/tty/ttyS0 && ln -s " + root + "/devices/platform/serial8250 " + root + "/devices/platform/serial8250/tty/ttyS0/device && ln -s " + root + "/devices/platform/serial8250/tty/ttyS0 " + root + "/class/tty/ttyS0");
+  run(std::string("mkdir -p ") + root + "/class/tty/tty0");
+
+  UsbEnumerator enumerator(root);
+  auto devices = enumerator.scan();
+  ASSERT_EQ(devices.size(), 3u);
+  EXPECT_EQ(devices[0].tty, "/dev/ttyACM0");
+  EXPECT_EQ(devices[0].busPath, "2-4");
+  EXPECT_EQ(devices[0].driver, "cdc_acm");
+  EXPECT_EQ(devices[0].serial, "");
+  EXPECT_EQ(devices[1].tty, "/dev/ttyUSB2");
+  EXPECT_EQ(devices[1].busPath, "1-1.2");
+  EXPECT_EQ(devices[1].vid, 0x0403);
+  EXPECT_EQ(devices[1].pid, 0x6010);
+  EXPECT_EQ(devices[1].interfaceNumber, 1);
+  EXPECT_EQ(devices[1].serial, "FT4232");
+  EXPECT_EQ(devices[2].tty, "/dev/ttyUSB10");
+  EXPECT_EQ(devices[2].driver, "ftdi_sio");
+
+  std::stringstream ss;
+  UsbEnumerator::print(ss, devices);
+  EXPECT_THAT(ss.str(), HasSubstr("/dev/ttyUSB2   1-1.2       0403:6010  1   ftdi_sio    FT4232"));
+}
+
+TEST_F(UsbEnumerator_scan, lookupRescansOnlyForNewOrReplugedDevices){
+  plug("ttyUSB0", "1-1.2", "0403", "6015", "AAAA", "ftdi_sio");
+  UsbEnumerator enumerator(root);
+  EXPECT_EQ(enumerator.lookup("/dev/ttyUSB0").serial, "AAAA");
+  EXPECT_THROW(enumerator.lookup("/dev/ttyUSB1"), std::runtime_error);
+
+  plug("ttyUSB1", "1-1.3", "0403", "6015", "BBBB", "ftdi_sio");
+  EXPECT_EQ(enumerator.lookup("ttyUSB1").busPath, "1-1.3");
+
+  /* another adapter gets the name of an unplugged one */
+  run(std::string("rm -rf ") + root + "/class/tty/ttyUSB0 " + root + "/devices/pci0000:00/usb1/1-1.2");
+  plug("ttyUSB0", "1-1.4", "10c4", "ea60", "CCCC", "ftdi_sio");
+  auto device = enumerator.lookup("/dev/ttyUSB0");
+  EXPECT_EQ(device.busPath, "1-1.4");
+  EXPECT_EQ(device.vid, 0x10c4);
+}
+
+TEST_F(UsbEnumerator_scan, findsUsbDeviceByTtyBusPathOrSerial){
+  plug("ttyUSB0", "1-1.2", "0403", "6015", "AAAA", "ftdi_sio");
+  plug("ttyUSB1", "3-2", "0403", "6015", "BBBB", "ftdi_sio");
+  UsbEnumerator enumerator(root);
+
+  auto usb = enumerator.findUsbDevice("serial:BBBB");
+  EXPECT_EQ(usb.busPath, "3-2");
+  EXPECT_EQ(usb.bus, 3);
+  EXPECT_EQ(usb.address, 2);
+  EXPECT_EQ(enumerator.findUsbDevice("usb:1-1.2").serial, "AAAA");
+  EXPECT_EQ(enumerator.findUsbDevice("/dev/ttyUSB1").address, 2);
+  EXPECT_EQ(enumerator.ttyOf("serial:AAAA"), "/dev/ttyUSB0");
+  EXPECT_TRUE(UsbEnumerator::isUsbSelector("usb:1-1.2"));
+  EXPECT_FALSE(UsbEnumerator::isUsbSelector("/dev/ttyUSB0"));
+
+  EXPECT_THROW(enumerator.findUsbDevice("serial:CCCC"), std::runtime_error);
+  EXPECT_THROW(enumerator.findUsbDevice("usb:1-9"), std::runtime_error);
+  plug("ttyUSB2", "1-1.3", "0403", "6015", "AAAA", "ftdi_sio");
+  EXPECT_THROW(enumerator.findUsbDevice("serial:AAAA"), std::runtime_error);
+}
+
+TEST_F(UsbEnumerator_scan, selectsChannelOfMultiChannelParts){
+  plug("ttyUSB0", "1-2", "0403", "6011", "FT4232", "ftdi_sio", 0);
+  plug("ttyUSB1", "1-2", "0403", "6011", "FT4232", "ftdi_sio", 1);
+  plug("ttyUSB2", "1-2", "0403", "6011", "FT4232", "ftdi_sio", 2);
+  plug("ttyUSB3", "1-2", "0403", "6011", "FT4232", "ftdi_sio", 3);
+  UsbEnumerator enumerator(root);
+
+  EXPECT_EQ(enumerator.findUsbDevice("serial:FT4232").channel, 0);
+  auto usb = enumerator.findUsbDevice("serial:FT4232#c");
+  EXPECT_EQ(usb.channel, 3);
+  EXPECT_EQ(usb.interfaces, 4);
+  EXPECT_EQ(enumerator.findUsbDevice("/dev/ttyUSB1").channel, 2);
+  EXPECT_EQ(enumerator.ttyOf("usb:1-2#D"), "/dev/ttyUSB3");
+  EXPECT_THROW(enumerator.findUsbDevice("usb:1-2#E"), std::runtime_error);
+  EXPECT_THROW(enumerator.findUsbDevice("usb:1-2#AB"), std::runtime_error);
+}
+
+TEST_F(UsbEnumerator_scan, remembersBusPathOfDetachedTty){
+  plug("ttyUSB0", "1-1.2", "0403", "6015", "AAAA", "ftdi_sio");
+  plug("ttyUSB1", "1-2", "0403", "6010", "FT2232", "ftdi_sio", 1);
+  UsbEnumerator enumerator(root);
+  EXPECT_EQ(enumerator.selectorOf("/dev/ttyUSB0"), "usb:1-1.2#A");
+  EXPECT_EQ(enumerator.selectorOf("/dev/ttyUSB1"), "usb:1-2#B");
+  EXPECT_EQ(enumerator.selectorOf("serial:AAAA"), "serial:AAAA");
+
+  /* libftdi detached ftdi_sio, the tty is gone but the adapter is not */
+  run(std::string("rm -f ") + root + "/class/tty/ttyUSB0");
+  EXPECT_THROW(enumerator.lookup("/dev/ttyUSB0"), std::runtime_error);
+  EXPECT_EQ(enumerator.selectorOf("/dev/ttyUSB0"), "usb:1-1.2#A");
+  EXPECT_EQ(enumerator.findUsbDevice(enumerator.selectorOf("/dev/ttyUSB0")).serial, "AAAA");
+  EXPECT_THROW(enumerator.selectorOf("/dev/ttyUSB7"), std::runtime_error);
+}